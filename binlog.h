@@ -0,0 +1,901 @@
+/*
+ *	BINARY LOG
+ *
+ *	Log files made of fixed-layout binary records, written through a
+ *	preallocated buffer that is flushed in LOG_BLOCK aligned blocks: the
+ *	file stays open, there is no fopen/fclose and no formatting per line.
+ *
+ *	File layout:
+ *		- header, padded to LOG_BLOCK bytes: LogFileHeader and one
+ *		  LogColumn per field (name, type, offset, text precision),
+ *		  the file describes its own records
+ *		- records of [record_size] bytes
+ *
+ *	Flush policy: the buffer is written when it holds [flush_bytes] or when
+ *	its oldest record is [flush_ms] old. Every write starts on a block
+ *	boundary of the file: the last, partial block is kept in the buffer and
+ *	written again, completed, by the next flush. fdatasync() follows every
+ *	flush (LOG_SYNC_FLUSH), at most every [sync_ms] (LOG_SYNC_PERIOD) or is
+ *	left to the kernel (LOG_SYNC_NONE).
+ *
+ *	A partial record at the end of a file (power loss during a write) is
+ *	ignored by the readers: records = (size - header_size) / record_size.
+ *	utils/logcat exports a log file as CSV.
+ *
+ *	Framed files ([framed] set before log_open, LOG_FLAG_FRAMED): every
+ *	record is preceded by a LogFrame, its number and a CRC-32 of the number
+ *	and the record. A torn or stale tail (power loss between a write and
+ *	its fdatasync, blocks of zeros) fails the check, the readers stop at the
+ *	first bad frame and log_recover() cuts the file there. With [max_loss_ms]
+ *	set, a record is never left more than that long without fdatasync: the
+ *	writer flushes and syncs when the oldest unsynced record is half as old,
+ *	[loss_max_ms] is the worst age seen when a sync completed.
+ *
+ *	Packed files ([packed] set before log_open, LOG_FLAG_PACKED in the
+ *	header): every LOG_BLOCK of the file after the header is an independent
+ *	block, LogBlockHeader then the records, each one encoded against the
+ *	previous record of its block (all zero for the first one):
+ *		- bitmap of the 32-bit words that changed, 1 bit per word
+ *		- one varint per changed word: zigzag of the difference for the
+ *		  integer columns, XOR of the bits for the floats
+ *	A block ends when the next record doesn't fit, the rest is zero. The
+ *	unchanged fields (modes, parameters) cost one bit, a block can be decoded
+ *	without the rest of the file and a power loss affects the last block
+ *	only. Readers stream through the blocks with log_reader_next().
+ *
+ *	Sidecar index [path].idx (schemas with a [time_column], see log_index.h):
+ *		- LogIndexHeader, then the latest record written, between two
+ *		  copies of its sequence number: rewritten in place (page cache)
+ *		  after every record, it replaces "tail -1"
+ *		- from LOG_BLOCK, one LogIndexEntry per file block: time and
+ *		  number of the first record that starts in the block, appended
+ *		  after the block is written
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#define LOG_MAGIC	0x474f4c53		// "SLOG"
+#define LOG_VERSION	1
+#define LOG_BLOCK	4096			// [bytes] file write unit
+#define LOG_BUFFER	(64*1024)		// [bytes] buffer of a writer, multiple of LOG_BLOCK
+#define LOG_NAME_LEN	24
+#define LOG_FLAG_PACKED	1			// delta + bit-packed blocks
+#define LOG_FLAG_FRAMED	2			// numbered, checksummed records
+#define LOG_INDEX_MAGIC	0x58444953		// "SIDX"
+#define LOG_INDEX_PENDING	32		// index entries buffered between two flushes
+
+enum LogType { LOG_U32, LOG_I32, LOG_F32 };
+enum LogSync { LOG_SYNC_NONE, LOG_SYNC_FLUSH, LOG_SYNC_PERIOD };
+
+// field of a record, stored as is in the file header
+typedef struct {
+	char     name[LOG_NAME_LEN];
+	uint16_t type;				// LogType
+	uint16_t offset;			// in the record
+	int16_t  precision;			// decimals of the text export, -1: %f
+	uint16_t reserved;
+} LogColumn;
+
+#define LOG_COLUMN(record, field, type, precision)	{ #field, type, offsetof(record, field), precision, 0 }
+
+typedef struct {
+	uint32_t magic, version;
+	uint32_t header_size;			// [bytes] before the first record, multiple of LOG_BLOCK
+	uint32_t record_size;
+	uint32_t columns;
+	uint32_t flags;				// LOG_FLAG_*
+	int64_t  created;			// unix time
+	char     name[32];			// schema name
+} LogFileHeader;
+
+// before each record of a framed file
+typedef struct {
+	uint32_t seq;				// record number (low 32 bits)
+	uint32_t crc;				// CRC-32 of seq and the record
+} LogFrame;
+
+// first bytes of each block of a packed file
+typedef struct {
+	uint16_t records;
+	uint16_t bytes;				// used, header included
+} LogBlockHeader;
+
+typedef struct {
+	const char * name;
+	const LogColumn * column;
+	int columns;
+	uint32_t record_size;
+	int time_column;			// LOG_U32 unix time of the records for the index, -1: no index
+} LogSchema;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t record_size;
+	uint32_t time_offset;			// of the time column in a record
+	uint32_t entries_off;			// [bytes] first LogIndexEntry
+} LogIndexHeader;
+
+typedef struct {
+	uint32_t time;				// of the first record of the block
+	uint32_t block;				// file offset / LOG_BLOCK
+	uint64_t record;			// number of the first record of the block
+} LogIndexEntry;
+
+typedef struct {
+	const LogSchema * schema;
+	int    fd;				// -1 when closed
+	char * buf;				// LOG_BUFFER bytes, block aligned
+	size_t fill;				// bytes in [buf]
+	size_t flushed;				// bytes of [buf] already in the file (last partial block)
+	off_t  file_off;			// file offset of buf[0], multiple of LOG_BLOCK
+	int64_t first_ms;			// time of the oldest record not written yet, 0 if none
+	int64_t sync_ms_last;
+	char * prev;				// [packed] previous record of the block
+	uint8_t * word_type;			// LogType of each 32-bit word of a record
+
+	// sidecar index
+	int    idx_fd;				// -1 when closed or without index
+	off_t  idx_off;				// next entry
+	char * latest;				// sequence, latest record, sequence
+	LogIndexEntry idx_pending[LOG_INDEX_PENDING];
+	int    idx_count;
+
+	// policy
+	size_t flush_bytes;
+	int    flush_ms;
+	int    sync;				// LogSync
+	int    sync_ms;
+	int    max_loss_ms;			// [ms] longest a record may wait for fdatasync, 0: no bound
+	int    packed;				// write packed files
+	int    framed;				// write framed files (not packed)
+
+	// current file
+	uint64_t file_records;			// records written to it
+	int64_t unsynced_ms;			// time of the oldest record not synced, 0 if none
+	uint64_t flushed_records;		// records in the file
+	uint64_t synced_records;		// records on the disk
+
+	// statistics
+	uint64_t records, writes, syncs, errors;
+	int64_t loss_max_ms;			// oldest unsynced record when a sync completed
+	uint64_t loss_overruns;			// syncs that completed after [max_loss_ms]
+} LogWriter;
+
+
+static inline int64_t log_now_ms()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec*1000 + t.tv_nsec/1000000;
+}
+
+/*
+ *	CRC-32 (IEEE) of [len] bytes, continuing [crc] (0 to start).
+ *	log_crc_init() fills the table, called by the writers and readers.
+ */
+uint32_t log_crc_table[256];
+
+void log_crc_init()
+{
+	uint32_t c;
+	int k, b;
+
+	if (log_crc_table[1] != 0) return;
+	for (k = 255; k > 0; k--) {
+		for (c = k, b = 0; b < 8; b++) c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+		log_crc_table[k] = c;
+	}
+}
+
+static inline uint32_t log_crc32(uint32_t crc, const void * data, size_t len)
+{
+	const uint8_t * p = (const uint8_t *)data;
+
+	crc = ~crc;
+	while (len--) crc = log_crc_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+static inline uint32_t log_frame_crc(uint32_t seq, const void * record, uint32_t size)
+{
+	return log_crc32(log_crc32(0, &seq, 4), record, size);
+}
+
+/*
+ *	PACKED RECORDS
+ */
+
+// largest packed record: bitmap and 5 varint bytes per word
+#define LOG_PACKED_MAX(words)	(((words)+7)/8 + 5*(words))
+
+static inline uint32_t log_zigzag(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+static inline int32_t log_unzigzag(uint32_t v) { return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+
+/*
+ *	Type of each 32-bit word of the records, from the columns (LOG_F32 for the padding)
+ */
+void log_word_types(uint8_t * type, const LogColumn * column, int columns, uint32_t record_size)
+{
+	int k;
+
+	memset(type, LOG_F32, record_size/4);
+	for (k = 0; k < columns; k++)
+		if (column[k].offset % 4 == 0 && column[k].offset + 4 <= record_size) type[column[k].offset/4] = column[k].type;
+}
+
+/*
+ *	Encode [record] against [prev] into [out]. Return the encoded size.
+ */
+size_t log_pack_record(uint8_t * out, const char * record, const char * prev, const uint8_t * type, int words)
+{
+	uint8_t * p = out + (words+7)/8;
+	uint32_t cur, old, d;
+	int k;
+
+	memset(out, 0, (words+7)/8);
+	for (k = 0; k < words; k++) {
+		memcpy(&cur, record + 4*k, 4);
+		memcpy(&old, prev + 4*k, 4);
+		if (cur == old) continue;
+		out[k >> 3] |= 1 << (k & 7);
+		d = type[k] == LOG_F32 ? cur ^ old : log_zigzag((int32_t)(cur - old));
+		while (d >= 0x80) {
+			*p++ = (d & 0x7f) | 0x80;
+			d >>= 7;
+		}
+		*p++ = d;
+	}
+	return p - out;
+}
+
+/*
+ *	Decode a record of [len] bytes at most from [in], [record] holds the
+ *	previous record and receives the new one. Return the encoded size, -1 if
+ *	the data is truncated.
+ */
+int log_unpack_record(const uint8_t * in, size_t len, char * record, const uint8_t * type, int words)
+{
+	const uint8_t * p = in + (words+7)/8, * end = in + len;
+	uint32_t old, d;
+	int k, shift;
+
+	if (p > end) return -1;
+	for (k = 0; k < words; k++) {
+		if (!(in[k >> 3] & (1 << (k & 7)))) continue;
+		d = 0;
+		for (shift = 0; ; shift += 7) {
+			if (p >= end || shift > 28) return -1;
+			d |= (uint32_t)(*p & 0x7f) << shift;
+			if (!(*p++ & 0x80)) break;
+		}
+		memcpy(&old, record + 4*k, 4);
+		old = type[k] == LOG_F32 ? d ^ old : old + (uint32_t)log_unzigzag(d);
+		memcpy(record + 4*k, &old, 4);
+	}
+	return p - in;
+}
+
+
+/*
+ *	WRITER
+ */
+
+/*
+ *	Allocate the buffer of a writer for [schema]. Return -1 on error.
+ */
+int log_writer_init(LogWriter * w, const LogSchema * schema)
+{
+	memset(w, 0, sizeof(LogWriter));
+	w->schema = schema;
+	w->fd = -1;
+	w->idx_fd = -1;
+	w->flush_bytes = 4*LOG_BLOCK;
+	w->flush_ms = 5000;
+	w->sync = LOG_SYNC_FLUSH;
+	w->sync_ms = 5000;
+	if (schema->record_size % 4 != 0 || LOG_PACKED_MAX(schema->record_size/4) > LOG_BLOCK - sizeof(LogBlockHeader)) return -1;
+	if (posix_memalign((void **)&w->buf, LOG_BLOCK, LOG_BUFFER) != 0) return -1;
+	memset(w->buf, 0, LOG_BUFFER);
+	w->prev = calloc(1, schema->record_size);
+	w->word_type = malloc(schema->record_size/4);
+	w->latest = calloc(1, schema->record_size + 16);
+	if (w->prev == NULL || w->word_type == NULL || w->latest == NULL) return -1;
+	if (schema->time_column >= schema->columns) return -1;
+	log_word_types(w->word_type, schema->column, schema->columns, schema->record_size);
+	log_crc_init();
+	return 0;
+}
+
+/*
+ *	True when the oldest unsynced record is half [max_loss_ms] old
+ */
+static inline int log_loss_due(const LogWriter * w, int64_t now)
+{
+	return w->max_loss_ms > 0 && w->unsynced_ms != 0 && now - w->unsynced_ms >= w->max_loss_ms / 2;
+}
+
+void log_sync(LogWriter * w, int64_t now)
+{
+	int64_t age;
+
+	if (w->sync == LOG_SYNC_NONE) return;
+	if (w->sync == LOG_SYNC_PERIOD && now - w->sync_ms_last < w->sync_ms && !log_loss_due(w, now)) return;
+	if (fdatasync(w->fd) < 0) {
+		w->errors++;
+		return;
+	}
+	w->syncs++;
+	w->sync_ms_last = now;
+	w->synced_records = w->flushed_records;
+	if (w->unsynced_ms != 0) {
+		age = log_now_ms() - w->unsynced_ms;
+		if (age > w->loss_max_ms) w->loss_max_ms = age;
+		if (w->max_loss_ms > 0 && age > w->max_loss_ms) w->loss_overruns++;
+	}
+	if (w->synced_records == w->file_records) w->unsynced_ms = 0;
+}
+
+/*
+ *	SIDECAR INDEX
+ */
+
+void log_index_flush(LogWriter * w)
+{
+	size_t len = w->idx_count * sizeof(LogIndexEntry);
+
+	if (w->idx_fd < 0 || w->idx_count == 0) return;
+	if (pwrite(w->idx_fd, w->idx_pending, len, w->idx_off) != (ssize_t)len) w->errors++;
+	else w->idx_off += len;
+	w->idx_count = 0;
+}
+
+/*
+ *	[record] is the first one starting in the block at file offset [offset]
+ */
+void log_index_add(LogWriter * w, const void * record, off_t offset)
+{
+	LogIndexEntry * e;
+
+	if (w->idx_fd < 0) return;
+	if (w->idx_count == LOG_INDEX_PENDING) log_index_flush(w);	// the data isn't written yet, rare
+	e = &w->idx_pending[w->idx_count++];
+	memcpy(&e->time, (const char *)record + w->schema->column[w->schema->time_column].offset, 4);
+	e->block = offset / LOG_BLOCK;
+	e->record = w->file_records;
+}
+
+/*
+ *	Replace the latest record of the index, one pwrite: a reader that
+ *	finds the same sequence number on both sides has a whole record
+ */
+void log_index_latest(LogWriter * w, const void * record)
+{
+	uint32_t size = w->schema->record_size;
+	uint64_t seq = w->file_records;
+
+	if (w->idx_fd < 0) return;
+	memcpy(w->latest, &seq, 8);
+	memcpy(w->latest + 8, record, size);
+	memcpy(w->latest + 8 + size, &seq, 8);
+	if (pwrite(w->idx_fd, w->latest, size + 16, sizeof(LogIndexHeader)) != (ssize_t)(size + 16)) w->errors++;
+}
+
+/*
+ *	Write the buffer from its first unwritten block. The whole blocks leave
+ *	the buffer, the partial one stays to be completed.
+ */
+void log_flush(LogWriter * w)
+{
+	size_t start, whole;
+	ssize_t n;
+
+	if (w->fd < 0 || w->fill == w->flushed) return;
+
+	start = w->flushed / LOG_BLOCK * LOG_BLOCK;
+	n = pwrite(w->fd, w->buf + start, w->fill - start, w->file_off + start);
+	w->writes++;
+	if (n != (ssize_t)(w->fill - start)) {
+		w->errors++;
+		return;				// kept in the buffer, written again by the next flush
+	}
+	w->flushed = w->fill;
+	w->first_ms = 0;
+	w->flushed_records = w->file_records;
+	log_index_flush(w);			// entries of blocks now in the file
+
+	whole = w->fill / LOG_BLOCK * LOG_BLOCK;
+	if (whole > 0) {
+		memmove(w->buf, w->buf + whole, w->fill - whole);
+		w->fill -= whole;
+		w->flushed -= whole;
+		w->file_off += whole;
+	}
+	log_sync(w, log_now_ms());
+}
+
+/*
+ *	Flush when the size or the time threshold is reached
+ */
+void log_poll(LogWriter * w)
+{
+	int64_t now;
+
+	if (w->fd < 0) return;
+	if (w->max_loss_ms > 0) {
+		now = log_now_ms();
+		if (log_loss_due(w, now)) {
+			if (w->fill != w->flushed) log_flush(w);
+			else log_sync(w, now);
+			return;
+		}
+	}
+	if (w->fill == w->flushed) return;
+	if (w->fill - w->flushed >= w->flush_bytes) { log_flush(w); return; }
+	now = log_now_ms();
+	if (w->first_ms != 0 && now - w->first_ms >= w->flush_ms) log_flush(w);
+}
+
+/*
+ *	Append one packed record to the current block, or to a new one
+ */
+void log_write_packed(LogWriter * w, const void * record)
+{
+	uint8_t packed[LOG_BLOCK];
+	uint32_t size = w->schema->record_size;
+	size_t n = 0, used = w->fill % LOG_BLOCK;
+	LogBlockHeader * h;
+
+	if (used != 0) n = log_pack_record(packed, record, w->prev, w->word_type, size/4);
+	if (used != 0 && used + n > LOG_BLOCK) {
+		// close the block, the new record starts the next one
+		memset(w->buf + w->fill, 0, LOG_BLOCK - used);
+		w->fill += LOG_BLOCK - used;
+		used = 0;
+	}
+	if (used == 0) {
+		// first record of a block: encoded against zero
+		memset(w->prev, 0, size);
+		n = log_pack_record(packed, record, w->prev, w->word_type, size/4);
+	}
+	if (w->fill + LOG_BLOCK > LOG_BUFFER) {
+		log_flush(w);
+		if (w->fill + LOG_BLOCK > LOG_BUFFER) { w->errors++; return; }	// the disk is failing
+	}
+	h = (LogBlockHeader *)(w->buf + w->fill - used);
+	if (used == 0) {
+		log_index_add(w, record, w->file_off + w->fill);
+		h->records = 0;
+		h->bytes = sizeof(LogBlockHeader);
+		w->fill += sizeof(LogBlockHeader);
+	}
+	memcpy(w->buf + w->fill, packed, n);
+	w->fill += n;
+	h->records++;
+	h->bytes += n;
+	memcpy(w->prev, record, size);
+	w->records++;
+	w->file_records++;
+	log_index_latest(w, record);
+	if (w->first_ms == 0) w->first_ms = log_now_ms();
+	if (w->unsynced_ms == 0) w->unsynced_ms = w->first_ms;
+	log_poll(w);
+}
+
+/*
+ *	Append one record (schema->record_size bytes)
+ */
+void log_write(LogWriter * w, const void * record)
+{
+	uint32_t size = w->schema->record_size, frame = size + (w->framed ? sizeof(LogFrame) : 0);
+	LogFrame f;
+
+	if (w->fd < 0) return;
+	if (w->packed) {
+		log_write_packed(w, record);
+		return;
+	}
+	if (w->fill + frame > LOG_BUFFER) {
+		log_flush(w);
+		if (w->fill + frame > LOG_BUFFER) { w->errors++; return; }	// the disk is failing
+	}
+	if ((w->file_off + w->fill) % LOG_BLOCK < frame) log_index_add(w, record, w->file_off + w->fill);
+	if (w->framed) {
+		f.seq = w->file_records;
+		f.crc = log_frame_crc(f.seq, record, size);
+		memcpy(w->buf + w->fill, &f, sizeof(f));
+		w->fill += sizeof(f);
+	}
+	memcpy(w->buf + w->fill, record, size);
+	w->fill += size;
+	w->records++;
+	w->file_records++;
+	log_index_latest(w, record);
+	if (w->first_ms == 0) w->first_ms = log_now_ms();
+	if (w->unsynced_ms == 0) w->unsynced_ms = w->first_ms;
+	log_poll(w);
+}
+
+/*
+ *	Flush everything and close the file
+ */
+void log_close(LogWriter * w)
+{
+	if (w->fd < 0) return;
+	log_flush(w);
+	if (w->sync != LOG_SYNC_NONE) {
+		if (fdatasync(w->fd) < 0) w->errors++;
+		else w->synced_records = w->flushed_records;
+	}
+	close(w->fd);
+	w->fd = -1;
+	w->fill = w->flushed = 0;
+	w->unsynced_ms = 0;
+	if (w->idx_fd >= 0) {
+		log_index_flush(w);
+		close(w->idx_fd);
+		w->idx_fd = -1;
+	}
+}
+
+/*
+ *	Size of the header of [schema], LogFileHeader and the columns rounded up to LOG_BLOCK
+ */
+uint32_t log_header_size(const LogSchema * schema)
+{
+	size_t n = sizeof(LogFileHeader) + schema->columns * sizeof(LogColumn);
+	return (n + LOG_BLOCK - 1) / LOG_BLOCK * LOG_BLOCK;
+}
+
+/*
+ *	Close the current file and create [path] with the schema header. Return -1 on error.
+ */
+int log_open(LogWriter * w, const char * path)
+{
+	LogFileHeader * h;
+	LogIndexHeader ih;
+	char idx_path[256];
+
+	log_close(w);
+	w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (w->fd < 0) { w->errors++; return -1; }
+
+	// sidecar index, the log works without it
+	if (w->schema->time_column >= 0) {
+		snprintf(idx_path, sizeof(idx_path), "%s.idx", path);
+		w->idx_fd = open(idx_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		ih.magic = LOG_INDEX_MAGIC;
+		ih.record_size = w->schema->record_size;
+		ih.time_offset = w->schema->column[w->schema->time_column].offset;
+		ih.entries_off = LOG_BLOCK;
+		if (w->idx_fd >= 0 && pwrite(w->idx_fd, &ih, sizeof(ih), 0) != sizeof(ih)) {
+			close(w->idx_fd);
+			w->idx_fd = -1;
+		}
+		if (w->idx_fd < 0) w->errors++;
+		w->idx_off = LOG_BLOCK;
+		w->idx_count = 0;
+	}
+
+	// the header goes through the buffer like the records
+	memset(w->buf, 0, log_header_size(w->schema));
+	h = (LogFileHeader *)w->buf;
+	h->magic = LOG_MAGIC;
+	h->version = LOG_VERSION;
+	h->header_size = log_header_size(w->schema);
+	h->record_size = w->schema->record_size;
+	h->columns = w->schema->columns;
+	h->flags = w->packed ? LOG_FLAG_PACKED : w->framed ? LOG_FLAG_FRAMED : 0;
+	h->created = time(NULL);
+	snprintf(h->name, sizeof(h->name), "%s", w->schema->name);
+	memcpy(w->buf + sizeof(LogFileHeader), w->schema->column, w->schema->columns * sizeof(LogColumn));
+	w->fill = h->header_size;
+	w->flushed = 0;
+	w->file_off = 0;
+	w->file_records = w->flushed_records = w->synced_records = 0;
+	memset(w->prev, 0, w->schema->record_size);
+	log_flush(w);
+	return 0;
+}
+
+
+/*
+ *	READER
+ */
+
+typedef struct {
+	LogFileHeader header;
+	LogColumn * column;
+	int fd;
+	off_t size;				// [bytes] of the file
+	uint32_t frame;				// [bytes] stored per record, LogFrame included
+	uint64_t records;			// complete records in the file
+	uint64_t next;				// record returned by the next log_reader_next()
+
+	// packed files
+	uint8_t * word_type;
+	uint8_t * block;			// current block, LOG_BLOCK bytes
+	off_t    block_off;			// file offset of [block], 0 before the first one
+	uint32_t block_pos;			// next record in [block]
+	uint32_t block_left;			// records left in [block]
+	uint32_t block_end;
+	char *   prev;				// last record decoded
+} LogReader;
+
+/*
+ *	Read the block of a packed file at [off]. Return its number of records, -1 on error.
+ */
+int log_reader_block(LogReader * r, off_t off)
+{
+	const LogBlockHeader * h = (const LogBlockHeader *)r->block;
+	ssize_t n = pread(r->fd, r->block, LOG_BLOCK, off);
+
+	if (n < (ssize_t)sizeof(LogBlockHeader) || h->bytes < sizeof(LogBlockHeader) || h->bytes > n) return -1;
+	r->block_off = off;
+	r->block_pos = sizeof(LogBlockHeader);
+	r->block_end = h->bytes;
+	r->block_left = h->records;
+	memset(r->prev, 0, r->header.record_size);
+	return h->records;
+}
+
+void log_reader_close(LogReader * r)
+{
+	free(r->column);
+	free(r->word_type);
+	free(r->block);
+	free(r->prev);
+	close(r->fd);
+}
+
+/*
+ *	Open a log file and read its schema. Return -1 if it isn't a binary log.
+ */
+int log_reader_open(LogReader * r, const char * path)
+{
+	LogBlockHeader h;
+	struct stat st;
+	size_t len;
+	off_t off;
+
+	memset(r, 0, sizeof(LogReader));
+	r->fd = open(path, O_RDONLY);
+	if (r->fd < 0) return -1;
+	if (read(r->fd, &r->header, sizeof(LogFileHeader)) != sizeof(LogFileHeader) || r->header.magic != LOG_MAGIC
+		|| r->header.version != LOG_VERSION || r->header.record_size == 0 || r->header.record_size % 4 != 0
+		|| r->header.columns > 1024 || r->header.header_size < sizeof(LogFileHeader)
+		|| r->header.record_size + sizeof(LogFrame) > LOG_BLOCK) {
+		close(r->fd);
+		return -1;
+	}
+	len = r->header.columns * sizeof(LogColumn);
+	r->column = malloc(len);
+	r->word_type = malloc(r->header.record_size/4);
+	r->block = malloc(LOG_BLOCK);
+	r->prev = calloc(1, r->header.record_size);
+	if (r->column == NULL || r->word_type == NULL || r->block == NULL || r->prev == NULL
+		|| pread(r->fd, r->column, len, sizeof(LogFileHeader)) != (ssize_t)len || fstat(r->fd, &st) < 0) {
+		log_reader_close(r);
+		return -1;
+	}
+	r->size = st.st_size;
+	r->frame = r->header.record_size + (r->header.flags & LOG_FLAG_FRAMED ? sizeof(LogFrame) : 0);
+	log_word_types(r->word_type, r->column, r->header.columns, r->header.record_size);
+	log_crc_init();
+
+	if (!(r->header.flags & LOG_FLAG_PACKED))
+		r->records = r->size > r->header.header_size ? (r->size - r->header.header_size) / r->frame : 0;
+	else {
+		// count the records from the block headers
+		for (off = r->header.header_size; off + (off_t)sizeof(h) <= r->size; off += LOG_BLOCK) {
+			if (pread(r->fd, &h, sizeof(h), off) != sizeof(h)) break;
+			r->records += h.records;
+		}
+	}
+	return 0;
+}
+
+/*
+ *	Decode the next record of a packed file into [prev], reading the next
+ *	block when needed. Return -1 at the end of the file.
+ */
+int log_reader_unpack(LogReader * r)
+{
+	int n;
+
+	while (r->block_left == 0) {
+		if (log_reader_block(r, r->block_off ? r->block_off + LOG_BLOCK : r->header.header_size) < 0) return -1;
+	}
+	n = log_unpack_record(r->block + r->block_pos, r->block_end - r->block_pos, r->prev, r->word_type, r->header.record_size/4);
+	if (n < 0) return -1;
+	r->block_pos += n;
+	r->block_left--;
+	r->next++;
+	return 0;
+}
+
+/*
+ *	Read the frame of record [r->next] into [block] and check it. Return -1
+ *	if it is torn or stale.
+ */
+int log_reader_frame(LogReader * r)
+{
+	off_t off = r->header.header_size + (off_t)r->next * r->frame;
+	LogFrame f;
+
+	if (pread(r->fd, r->block, r->frame, off) != (ssize_t)r->frame) return -1;
+	memcpy(&f, r->block, sizeof(f));
+	if (f.seq != (uint32_t)r->next || f.crc != log_frame_crc(f.seq, r->block + sizeof(f), r->header.record_size)) return -1;
+	return 0;
+}
+
+/*
+ *	Next record of the file into [record]. Return -1 at the end of the file
+ *	(or at the first bad frame of a framed file).
+ */
+int log_reader_next(LogReader * r, void * record)
+{
+	off_t off;
+
+	if (r->next >= r->records) return -1;
+	if (r->header.flags & LOG_FLAG_FRAMED) {
+		if (log_reader_frame(r) < 0) return -1;
+		memcpy(record, r->block + sizeof(LogFrame), r->header.record_size);
+		r->next++;
+		return 0;
+	}
+	if (!(r->header.flags & LOG_FLAG_PACKED)) {
+		off = r->header.header_size + (off_t)r->next * r->header.record_size;
+		if (pread(r->fd, record, r->header.record_size, off) != (ssize_t)r->header.record_size) return -1;
+		r->next++;
+		return 0;
+	}
+	if (log_reader_unpack(r) < 0) return -1;
+	memcpy(record, r->prev, r->header.record_size);
+	return 0;
+}
+
+/*
+ *	Position the reader of a packed file on record [k], in the block at
+ *	[off] whose first record is [first] (see log_index.h)
+ */
+int log_reader_seek_block(LogReader * r, off_t off, uint64_t first, uint64_t k)
+{
+	if (log_reader_block(r, off) < 0) return -1;
+	for (r->next = first; r->next < k; )
+		if (log_reader_unpack(r) < 0) return -1;
+	return 0;
+}
+
+/*
+ *	Position the reader on record [k]: a packed file is walked block header
+ *	by block header, then decoded from the start of the block of [k].
+ *	Return -1 if there is no record [k].
+ */
+int log_reader_seek(LogReader * r, uint64_t k)
+{
+	LogBlockHeader h;
+	uint64_t first = 0;
+	off_t off;
+
+	if (k >= r->records) return -1;
+	r->next = k;
+	if (!(r->header.flags & LOG_FLAG_PACKED)) return 0;
+
+	for (off = r->header.header_size; off < r->size; off += LOG_BLOCK) {
+		if (pread(r->fd, &h, sizeof(h), off) != sizeof(h)) return -1;
+		if (k < first + h.records) break;
+		first += h.records;
+	}
+	return log_reader_seek_block(r, off, first, k);
+}
+
+/*
+ *	Read record [k] into [record] (header.record_size bytes). Return -1 on error.
+ *	Sequential reads of a packed file go through log_reader_next().
+ */
+int log_reader_get(LogReader * r, uint64_t k, void * record)
+{
+	off_t off = r->header.header_size + (off_t)k * r->header.record_size;
+
+	if (r->header.flags & (LOG_FLAG_PACKED | LOG_FLAG_FRAMED)) {
+		if (log_reader_seek(r, k) < 0) return -1;
+		return log_reader_next(r, record);
+	}
+	return pread(r->fd, record, r->header.record_size, off) == (ssize_t)r->header.record_size ? 0 : -1;
+}
+
+
+/*
+ *	RECOVERY
+ */
+
+typedef struct {
+	uint64_t records;			// valid records kept
+	off_t    removed;			// [bytes] cut from the end
+} LogRecovery;
+
+/*
+ *	Cut the tail a power loss left in the log file [path]: the partial
+ *	record of a plain file, everything from the first bad frame of a framed
+ *	file, from the first block that doesn't decode of a packed file. The
+ *	index entries past the new end are dropped and its latest record slot
+ *	cleared. Return 1 if the file was cut, 0 if it was whole, -1 if it isn't
+ *	a binary log or cannot be cut.
+ */
+int log_recover(const char * path, LogRecovery * out)
+{
+	LogReader r;
+	LogIndexHeader ih;
+	LogIndexEntry e;
+	char idx_path[256], * rec;
+	uint64_t zero = 0;
+	off_t end, off;
+	int fd, n;
+
+	if (log_reader_open(&r, path) < 0) return -1;
+	rec = malloc(r.header.record_size);
+	if (rec == NULL) {
+		log_reader_close(&r);
+		return -1;
+	}
+	out->records = 0;
+	end = r.header.header_size;
+	if (r.header.flags & LOG_FLAG_PACKED) {
+		for (off = r.header.header_size; off + (off_t)sizeof(LogBlockHeader) <= r.size; off += LOG_BLOCK) {
+			if ((n = log_reader_block(&r, off)) < 0) break;
+			while (r.block_left > 0 && log_reader_unpack(&r) == 0);
+			if (r.block_left > 0) break;
+			out->records += n;
+			end = off + r.block_end;
+		}
+	}
+	else {
+		while (log_reader_next(&r, rec) == 0) out->records++;
+		end += (off_t)out->records * r.frame;
+	}
+	out->removed = r.size > end ? r.size - end : 0;
+	free(rec);
+	log_reader_close(&r);
+	if (out->removed == 0) return 0;
+	if (truncate(path, end) < 0) return -1;
+
+	snprintf(idx_path, sizeof(idx_path), "%s.idx", path);
+	fd = open(idx_path, O_RDWR);
+	if (fd < 0) return 1;
+	if (pread(fd, &ih, sizeof(ih), 0) == sizeof(ih) && ih.magic == LOG_INDEX_MAGIC) {
+		for (off = ih.entries_off; pread(fd, &e, sizeof(e), off) == sizeof(e); off += sizeof(e))
+			if (e.record >= out->records || (off_t)e.block * LOG_BLOCK >= end) break;
+		n = ftruncate(fd, off) == 0 && pwrite(fd, &zero, sizeof(zero), sizeof(ih)) == sizeof(zero);
+	}
+	close(fd);
+	return 1;				// the log is cut, with or without its index
+}
+
+/*
+ *	Format a field of [record] as text
+ */
+int log_format_field(char * out, size_t len, const LogColumn * c, const void * record)
+{
+	const char * p = (const char *)record + c->offset;
+	uint32_t u;
+	int32_t  i;
+	float    f;
+
+	switch (c->type) {
+		case LOG_U32: memcpy(&u, p, 4); return snprintf(out, len, "%u", u);
+		case LOG_I32: memcpy(&i, p, 4); return snprintf(out, len, "%d", i);
+		case LOG_F32:
+			memcpy(&f, p, 4);
+			if (c->precision < 0) return snprintf(out, len, "%f", f);
+			return snprintf(out, len, "%.*f", c->precision, f);
+	}
+	return snprintf(out, len, "?");
+}
@@ -0,0 +1,178 @@
+/*
+ *	BOAT DYNAMICS
+ *
+ *	4-DOF model of the boat (surge, sway, yaw, roll), the alternative to
+ *	the kinematic model of boat_sim.h (see sim_step_4dof()). The sail, the
+ *	keel and the rudder are foils with lift and drag, the hull adds its
+ *	resistance and damping, the ballast the righting moment:
+ *
+ *		M11 du/dt = M22 v r + X		X, Y, N, K: forces and moments of
+ *		M22 dv/dt = -M11 u r + Y	the sail, keel, rudder and hull
+ *		IZ  dr/dt = N
+ *		IX  dp/dt = K,  dphi/dt = p,  dpsi/dt = r cos(phi)
+ *
+ *	Body frame: x forwards, y to starboard; heading clockwise from north,
+ *	roll positive to starboard. The sail takes the leeward side, out to the
+ *	wind direction or the sheet, whichever is closer (it luffs when the
+ *	sheet is eased beyond the wind). Integration: fixed-step RK4, the
+ *	actuators ramp linearly over a step.
+ *
+ *	Boat of about 4 m, boom of controller_core.h: 2.3 m/s on a beam reach
+ *	and 12 degrees of heel upwind in 5 m/s of wind.
+ */
+
+#define DYN_M11		85		// [kg] mass and added mass, surge
+#define DYN_M22		130		// [kg] sway
+#define DYN_IZ		80		// [kg m^2] yaw inertia
+#define DYN_IX		25		// [kg m^2] roll inertia
+#define DYN_RIGHTING	700		// [N m] m*g*GM, righting moment sin(phi)
+#define DYN_ROLL_DAMP	60		// [N m s] roll damping
+#define DYN_YAW_DAMP	20		// [N m s] yaw damping, linear
+#define DYN_YAW_DAMP2	40		// [N m s^2] quadratic
+#define DYN_SURGE_RES	2		// [N s/m] hull resistance, linear
+#define DYN_SURGE_RES2	8		// [N s^2/m^2] quadratic
+#define DYN_SWAY_RES2	40		// [N s^2/m^2] hull sway resistance
+
+#define DYN_RHO_AIR	1.2		// [kg/m^3]
+#define DYN_RHO_WATER	1025
+
+#define DYN_SAIL_AREA	3.7		// [m^2]
+#define DYN_SAIL_X	-0.2		// [m] centre of effort ahead of the centre of gravity
+#define DYN_SAIL_H	1.5		// [m] and above it
+#define DYN_KEEL_AREA	0.25
+#define DYN_KEEL_X	0.1		// [m] centre of the keel ahead of the centre of gravity
+#define DYN_KEEL_H	0.5		// [m] centre of the keel below the centre of gravity
+#define DYN_RUDDER_AREA	0.05
+#define DYN_RUDDER_X	-1.6		// [m] rudder behind the centre of gravity
+
+#define DYN_SUBSTEPS	5		// RK4 steps per control loop
+
+typedef struct {
+	float u, v;			// [m/s] surge, sway
+	float r, p;			// [rad/s] yaw rate, roll rate
+	float phi, psi;			// [rad] roll, heading
+	double x, y;			// [m] east, north
+} DynState;
+
+typedef struct {
+	float rudder;			// [rad] positive: the boat turns to port
+	float sheet;			// [rad] largest boom angle the sheet allows
+	float wind_angle;		// [rad] true wind direction
+	float wind_speed;		// [m/s]
+} DynInput;
+
+
+/*
+ *	Force [fx], [fy] on a foil of [area] with its chord at [chord] rad,
+ *	moving at [vx], [vy] through a fluid of density [rho]:
+ *	CL = [cl] sin(2 alpha), CD = [cd0] + [cd] sin^2(alpha). With the flow
+ *	onto the trailing edge (a sail sheeted in before the wind, a boat
+ *	going astern) a flat plate: only the force normal to the chord.
+ */
+static inline void dyn_foil(float vx, float vy, float chord, float rho, float area, float cl, float cd0, float cd, float * fx, float * fy)
+{
+	float v2 = vx*vx + vy*vy, v, alpha, lift, drag, q = 0.5f*rho*area*v2;
+
+	*fx = *fy = 0;
+	if (v2 < 1e-6) return;
+	alpha = atan2f(vy, vx) - chord;
+	if (cosf(alpha) < 0) {
+		*fx = q * (cd0 + cd) * sinf(alpha) * sinf(chord);
+		*fy = -q * (cd0 + cd) * sinf(alpha) * cosf(chord);
+		return;
+	}
+	v = sqrtf(v2);
+	lift = q * cl*sinf(2*alpha);
+	drag = q * (cd0 + cd*sinf(alpha)*sinf(alpha));
+	*fx = (-drag*vx + lift*vy) / v;
+	*fy = (-drag*vy - lift*vx) / v;
+}
+
+/*
+ *	Time derivative [d] of the state [s] with the inputs [in]
+ */
+void dyn_derivatives(const DynState * s, const DynInput * in, DynState * d)
+{
+	float cphi = cosf(s->phi), sphi = sinf(s->phi), cpsi = cosf(s->psi), spsi = sinf(s->psi);
+	float ax, ay, awa, boom, sx, sy, kx, ky, rx, ry, X, Y, N, K;
+
+	// sail: velocity of the boat through the air, the heeled sail sees cos(phi) of its side part
+	ax = s->u + in->wind_speed * cosf(in->wind_angle - s->psi);
+	ay = (s->v + in->wind_speed * sinf(in->wind_angle - s->psi)) * cphi;
+	awa = atan2f(ay, ax);
+	boom = fabsf(awa) < in->sheet ? fabsf(awa) : in->sheet;
+	dyn_foil(ax, ay, awa >= 0 ? boom : -boom, DYN_RHO_AIR, DYN_SAIL_AREA, 1.3, 0.1, 1.2, &sx, &sy);
+
+	// keel and rudder, the rudder in the flow of the yaw rate
+	dyn_foil(s->u, s->v + s->r*DYN_KEEL_X, 0, DYN_RHO_WATER, DYN_KEEL_AREA, 1.0, 0.01, 1.0, &kx, &ky);
+	dyn_foil(s->u, s->v + s->r*DYN_RUDDER_X, in->rudder, DYN_RHO_WATER, DYN_RUDDER_AREA, 1.2, 0.02, 1.2, &rx, &ry);
+
+	X = sx + kx + rx - DYN_SURGE_RES*s->u - DYN_SURGE_RES2*s->u*fabsf(s->u);
+	Y = sy*cphi + ky + ry - DYN_SWAY_RES2*s->v*fabsf(s->v);
+	N = DYN_SAIL_X*sy*cphi - DYN_SAIL_H*sphi*sx + DYN_KEEL_X*ky + DYN_RUDDER_X*ry - DYN_YAW_DAMP*s->r - DYN_YAW_DAMP2*s->r*fabsf(s->r);
+	K = DYN_SAIL_H*sy - DYN_KEEL_H*ky - DYN_RIGHTING*sphi - DYN_ROLL_DAMP*s->p;
+
+	d->u = (DYN_M22*s->v*s->r + X) / DYN_M11;
+	d->v = (-DYN_M11*s->u*s->r + Y) / DYN_M22;
+	d->r = N / DYN_IZ;
+	d->p = K / DYN_IX;
+	d->phi = s->p;
+	d->psi = s->r * cphi;
+	d->x = s->u*spsi + s->v*cphi*cpsi;
+	d->y = s->u*cpsi - s->v*cphi*spsi;
+}
+
+// [s] + [h]*[d]
+static inline void dyn_add(const DynState * s, const DynState * d, float h, DynState * out)
+{
+	out->u = s->u + h*d->u;
+	out->v = s->v + h*d->v;
+	out->r = s->r + h*d->r;
+	out->p = s->p + h*d->p;
+	out->phi = s->phi + h*d->phi;
+	out->psi = s->psi + h*d->psi;
+	out->x = s->x + h*d->x;
+	out->y = s->y + h*d->y;
+}
+
+// inputs at [w] (0..1) from [a] to [b]
+static inline void dyn_input_at(const DynInput * a, const DynInput * b, float w, DynInput * out)
+{
+	out->rudder = a->rudder + w*(b->rudder - a->rudder);
+	out->sheet = a->sheet + w*(b->sheet - a->sheet);
+	out->wind_angle = a->wind_angle;
+	out->wind_speed = a->wind_speed;
+}
+
+/*
+ *	Advance [s] by [dt] seconds in [n] RK4 steps, the actuators moving
+ *	linearly from [from] to [to] (the wind of [from])
+ */
+void dyn_step(DynState * s, const DynInput * from, const DynInput * to, float dt, int n)
+{
+	DynState k1, k2, k3, k4, t;
+	DynInput i0, i1, i2;
+	float h = dt / n;
+	int j;
+
+	for (j = 0; j < n; j++) {
+		dyn_input_at(from, to, (float)j / n, &i0);
+		dyn_input_at(from, to, (j + 0.5f) / n, &i1);
+		dyn_input_at(from, to, (float)(j + 1) / n, &i2);
+		dyn_derivatives(s, &i0, &k1);
+		dyn_add(s, &k1, h/2, &t);
+		dyn_derivatives(&t, &i1, &k2);
+		dyn_add(s, &k2, h/2, &t);
+		dyn_derivatives(&t, &i1, &k3);
+		dyn_add(s, &k3, h, &t);
+		dyn_derivatives(&t, &i2, &k4);
+		s->u += h/6 * (k1.u + 2*k2.u + 2*k3.u + k4.u);
+		s->v += h/6 * (k1.v + 2*k2.v + 2*k3.v + k4.v);
+		s->r += h/6 * (k1.r + 2*k2.r + 2*k3.r + k4.r);
+		s->p += h/6 * (k1.p + 2*k2.p + 2*k3.p + k4.p);
+		s->phi += h/6 * (k1.phi + 2*k2.phi + 2*k3.phi + k4.phi);
+		s->psi += h/6 * (k1.psi + 2*k2.psi + 2*k3.psi + k4.psi);
+		s->x += h/6 * (k1.x + 2*k2.x + 2*k3.x + k4.x);
+		s->y += h/6 * (k1.y + 2*k2.y + 2*k3.y + k4.y);
+	}
+}
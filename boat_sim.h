@@ -0,0 +1,229 @@
+/*
+ *	BOAT SIMULATION
+ *
+ *	Kinematic model of the boat used in Simulation mode: heading from the
+ *	rudder angle, speed and heeling from the polar table of the boat (see
+ *	polar_table.h) or the polynomials of the apparent wind it is generated
+ *	from, sail and rudder actuators moving at a constant rate. One step
+ *	lasts one control loop (1/SEC seconds). The wind of each step is an
+ *	input (constant, or a WindField of sim_wind.h).
+ *
+ *	The model has no I/O and its whole state is in a SimBoat, so several
+ *	boats can be simulated in parallel (see controller_core.h).
+ *
+ *	[model] of the SimBoat selects the 4-DOF model of boat_dyn.h instead
+ *	(sim_step_4dof()): same inputs and outputs, the speed is the surge
+ *	and the heeling the roll angle [rad].
+ */
+
+#define SIM_SOG		8		// [meters/seconds] boat speed over ground during simulation
+#define SIM_ROT		5		// [degrees/seconds] rate of turn
+#define SIM_ACT_INC	160		// [millimiters/seconds] sail actuator increment per second
+
+// default polar table: 1 degree x 5 m/s, the polynomials don't depend on the wind speed
+#define SIM_POLAR_TWA_STEP	1
+#define SIM_POLAR_TWS_STEP	5
+#define SIM_POLAR_TWS_MAX	30
+
+enum SimModel { SIM_MODEL_KINEMATIC, SIM_MODEL_4DOF, SIM_MODELS };
+const char * sim_model_names[SIM_MODELS] = { "kinematic", "4dof" };
+
+typedef struct {
+	float Heading, Latitude, Longitude;
+	int   Sail_Feedback, Rudder_Feedback;
+	float v_poly;			// [m/s] boat speed
+	float heel_sim;			// heeling
+	const PolarTable * polar;	// speed and heeling, NULL: sim_polynomials()
+	int   model;			// SIM_MODEL_*
+	DynState dyn;			// 4-DOF: state, position from [lat0], [lon0]
+	double lat0, lon0;
+} SimBoat;
+
+
+/*
+ *	Model named [name], -1 if there is none
+ */
+int sim_model_find(const char * name) {
+
+	int k;
+
+	for (k = 0; k < SIM_MODELS; k++) if (strcmp(sim_model_names[k], name) == 0) return k;
+	return -1;
+}
+
+
+/*
+ *	Boat speed (without the sail dependence) and heeling at the apparent
+ *	wind angle [app_wind] (radians, 0..PI)
+ */
+void sim_polynomials(float app_wind, float * v, float * heel) {
+
+	// calculate boat velocity
+	if ( app_wind > 0.22 && app_wind < PI ) {
+		*v = ((((((-0.0147*app_wind + 0.2772)*app_wind - 2.1294)*app_wind + 8.5197)*app_wind - 18.464)*app_wind + 19.847)*app_wind - 3.4774)*1.6/4.7;
+		*v = *v*10;
+		}
+	else { 	/*if ( app_wind > PI && app_wind < 6.06 ) {
+			v_poly = (-0.0147*power((2*3.1121-app_wind),6) + 0.2772*power((2*3.1121-app_wind),5) - 2.1294*power((2*3.1121-app_wind),4) + 8.5197*power((2*3.1121-app_wind),3) - 18.464*power((2*3.1121-app_wind),2) + 19.847*(2*3.1121-app_wind) - 3.4774)*1.6/4.7;
+			} else {*/
+		*v=0;
+		}
+
+	/*if ( app_wind > 0.22 && app_wind < 6.09 ) {
+		v_poly = (-0.0147*power(app_wind,6) + 0.2772*power(app_wind,5) - 2.1294*power(app_wind,4) + 8.5197*power(app_wind,3) - 18.464*power(app_wind,2) + 19.847*app_wind - 3.4774)*1.6/4.7;
+		}
+	else {v_poly=0;} */
+
+	// Calculate heeling angle
+	*heel = (((((0.0588*app_wind - 0.6542)*app_wind + 2.8009)*app_wind - 5.6456)*app_wind + 5.0785)*app_wind - 1.3435)*app_wind + 0.1104;
+}
+
+/*
+ *	Polar table of the polynomials, the default of the simulation.
+ *	The node at 180 degrees takes the value just below (the polynomial
+ *	is cut at PI, which the apparent wind never reaches).
+ *	Return -1 if it can't be allocated.
+ */
+int sim_polar_default(PolarTable * t) {
+
+	int a, s;
+	float v, heel, angle;
+
+	if (polar_alloc(t, 180/SIM_POLAR_TWA_STEP + 1, 0, SIM_POLAR_TWA_STEP,
+		SIM_POLAR_TWS_MAX/SIM_POLAR_TWS_STEP + 1, 0, SIM_POLAR_TWS_STEP) < 0) return -1;
+	for (a = 0; a < t->n_twa; a++) {
+		angle = a*SIM_POLAR_TWA_STEP*PI/180;
+		sim_polynomials(angle < PI - 1e-4 ? angle : PI - 1e-4, &v, &heel);
+		for (s = 0; s < t->n_tws; s++) {
+			t->speed[a*t->n_tws + s] = v;
+			t->heel[a*t->n_tws + s] = heel;
+		}
+	}
+	return 0;
+}
+
+/*
+ *	Largest boom angle [rad] the sheet allows at the sail actuator
+ *	[position] (inverse of sail_position() in controller_core.h)
+ */
+float sim_sheet_angle(int position) {
+
+	float c0 = sqrt(SCLength*SCLength + BoomLength*BoomLength - 2*SCLength*BoomLength + SCHeight*SCHeight);
+	float c = c0 + position*2*strokelength/ACT_MAX;
+	float cosa = (SCLength*SCLength + BoomLength*BoomLength + SCHeight*SCHeight - c*c) / (2*SCLength*BoomLength);
+
+	return acos(cosa > 1 ? 1 : cosa < -1 ? -1 : cosa);
+}
+
+// heading [degrees, 0..360) of [psi] radians, as the compass
+float sim_compass(float psi) {
+
+	float h = fmod(psi*180/PI, 360);
+	return h < 0 ? h + 360 : h;
+}
+
+/*
+ *	sim_step() of the 4-DOF model (see boat_dyn.h): the actuators move at
+ *	their rates up to the commands, and the boat with them over the loop.
+ *	A position or heading changed from outside since the last step (the
+ *	controller reads them back from the sensor files) restarts from it.
+ */
+void sim_step_4dof(SimBoat * b, int rudder, int sail, float wind_angle, float wind_speed) {
+
+	DynInput from, to;
+	int increment;
+
+	if ((float)(b->lat0 + b->dyn.y/CONVLAT) != b->Latitude || (float)(b->lon0 + b->dyn.x/CONVLON) != b->Longitude) {
+		b->lat0 = b->Latitude;
+		b->lon0 = b->Longitude;
+		b->dyn.x = b->dyn.y = 0;
+	}
+	if (sim_compass(b->dyn.psi) != b->Heading) b->dyn.psi = b->Heading*PI/180;
+
+	from.rudder = b->Rudder_Feedback*PI/180;
+	from.sheet = sim_sheet_angle(b->Sail_Feedback);
+	from.wind_angle = wind_angle*PI/180;
+	from.wind_speed = wind_speed;
+
+	// actuators: constant rate, stopping at the command
+	increment = SIM_ACT_INC/SEC;
+	if (abs(sail - b->Sail_Feedback) <= increment) b->Sail_Feedback = sail;
+	else b->Sail_Feedback += sail > b->Sail_Feedback ? increment : -increment;
+	increment = 16/SEC;
+	if (abs(rudder - b->Rudder_Feedback) <= increment) b->Rudder_Feedback = rudder;
+	else b->Rudder_Feedback += rudder > b->Rudder_Feedback ? increment : -increment;
+
+	to = from;
+	to.rudder = b->Rudder_Feedback*PI/180;
+	to.sheet = sim_sheet_angle(b->Sail_Feedback);
+	dyn_step(&b->dyn, &from, &to, 1/SEC, DYN_SUBSTEPS);
+
+	b->Heading = sim_compass(b->dyn.psi);
+	b->Latitude = b->lat0 + b->dyn.y/CONVLAT;
+	b->Longitude = b->lon0 + b->dyn.x/CONVLON;
+	b->v_poly = b->dyn.u;
+	b->heel_sim = b->dyn.phi;
+}
+
+/*
+ *	Move the boat for one control loop with the rudder at [rudder] degrees,
+ *	the sail actuator driven towards [sail] and the wind from [wind_angle]
+ *	at [wind_speed] m/s
+ */
+void sim_step(SimBoat * b, int rudder, int sail, float wind_angle, float wind_speed) {
+
+	if (b->model == SIM_MODEL_4DOF) {
+		sim_step_4dof(b, rudder, sail, wind_angle, wind_speed);
+		return;
+	}
+
+	// update boat heading
+	double delta_Heading = (SIM_ROT/SEC)*(-(double)rudder/30)*SIM_SOG;
+	b->Heading = b->Heading + delta_Heading;
+
+	// update sail actuator position
+	int increment=SIM_ACT_INC/SEC;
+	int desACTpos_sim=sail;
+
+	if (b->Sail_Feedback > desACTpos_sim) b->Sail_Feedback-=increment;
+	else {if(b->Sail_Feedback < desACTpos_sim)	{ b->Sail_Feedback+=increment; }}
+
+	// calculate apparent wind
+	float app_wind = (b->Heading-wind_angle)*PI/180;	// apparent wind direction
+	app_wind = atan2(sin(app_wind),cos(app_wind));	// avoiding singularities
+	if (debug5) printf("2 app_wind = %f \n", app_wind*180/PI);	// printing to check
+	app_wind = fabs(app_wind);
+	//if ( app_wind < 0 ) app_wind = 2*PI+app_wind;	// putting on a scale from 0 to 2*PI
+	if (debug5) printf("3 app_wind = %f \n", app_wind*180/PI);	// printing to check
+
+	// boat velocity and heeling angle
+	if (b->polar != NULL) polar_lookup(b->polar, app_wind*180/PI, wind_speed, &b->v_poly, &b->heel_sim);
+	else sim_polynomials(app_wind, &b->v_poly, &b->heel_sim);
+
+	// Adding sail position dependence (which isn't totally correct, but makes things work ;-] )
+	b->v_poly = b->v_poly - 0.000005285*b->Sail_Feedback*b->Sail_Feedback + 0.0045983*b->Sail_Feedback;
+	if (debug5) printf("v_poly = %f \n", b->v_poly);	// printing to check
+	//v_poly = SIM_SOG;
+
+	if (debug5) printf("heel_sim : %f \n", b->heel_sim);
+
+	// update boat position
+	double displacement = ((double)b->v_poly)/SEC;
+	double SimLon= ( (b->Longitude*CONVLON) + displacement*sinf(b->Heading*PI/180) )/CONVLON;
+	double SimLat= ( (b->Latitude*CONVLAT)  + displacement*cosf(b->Heading*PI/180) )/CONVLAT;
+	b->Latitude=(float)SimLat;
+	b->Longitude=(float)SimLon;
+
+	if(debug2) printf("Sail_Feedback_sim: %d \n",b->Sail_Feedback);
+	if(debug_hc) printf("v_poly: %f \n",b->v_poly);
+
+
+	// update rudder position (for the GUI only)
+	increment=16/SEC;	// 16 degrees/sec
+	if (b->Rudder_Feedback > rudder) b->Rudder_Feedback-=increment;
+	else b->Rudder_Feedback+=increment;
+
+
+	// change wind conditions: the caller passes the wind of the field of
+	// sim_wind.h at the boat position
+}
@@ -0,0 +1,203 @@
+/*
+ *	BOAT SIMULATION BATCH
+ *
+ *	The kinematic boat model of boat_sim.h for many boats at once, for the
+ *	parameter sweeps: the state is a structure of arrays (heading, position
+ *	in local metres east and north of an origin, sail and rudder feedback,
+ *	speed, heeling) and one call of sim_batch_step() moves every boat by one
+ *	control loop with the commands and the wind of its input arrays.
+ *
+ *	The step is compiled for SSE2 and AVX2 on x86 (chosen at run time from
+ *	the CPU), NEON on ARM when the compiler targets it, and generic vectors
+ *	otherwise (see boat_sim_kernel.h). The speed and heeling come from the
+ *	polar table (see polar_table.h); the results match sim_step() with the
+ *	same table to float precision, except the position, which sim_step()
+ *	rounds to a float latitude and longitude every step.
+ *
+ *		SimBatch b;
+ *		sim_batch_alloc(&b, n, &polar, lat0, lon0);
+ *		sim_batch_set(&b, k, &boat);		// initial states
+ *		loop:
+ *			b.rudder[k] = ..., b.sail[k] = ..., b.wind_angle[k] = ..., b.wind_speed[k] = ...
+ *			sim_batch_step(&b);
+ */
+
+#include <stdint.h>
+
+#define SIMB_ALIGN	64		// bytes, allocation of the arrays
+#define SIMB_PAD	8		// boats, the widest vector
+
+typedef struct {
+	int n, capacity;		// boats, allocated (multiple of SIMB_PAD)
+	const PolarTable * polar;
+	float lat0, lon0;		// origin of the local metres
+
+	// state
+	float * heading;		// [degrees]
+	float * x, * y;			// [m] east and north of the origin
+	int32_t * sail_fb, * rudder_fb;
+	float * v, * heel;
+
+	// inputs of the next step
+	int32_t * rudder, * sail;	// commands
+	float * wind_angle, * wind_speed;
+} SimBatch;
+
+typedef void (*sim_batch_function)(SimBatch * b, int from, int to);
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMB_ISA	sse2
+#define SIMB_W		4
+#define SIMB_TARGET	__attribute__((target("sse2")))
+#include "boat_sim_kernel.h"
+#define SIMB_ISA	avx2
+#define SIMB_W		8
+#define SIMB_TARGET	__attribute__((target("avx2,fma")))
+#include "boat_sim_kernel.h"
+#elif defined(__ARM_NEON)
+#define SIMB_ISA	neon
+#define SIMB_W		4
+#define SIMB_TARGET
+#include "boat_sim_kernel.h"
+#else
+#define SIMB_ISA	generic
+#define SIMB_W		4
+#define SIMB_TARGET
+#include "boat_sim_kernel.h"
+#endif
+
+// kernels of this build, best first
+const struct {
+	const char * name;
+	sim_batch_function step;
+} sim_batch_isa[] = {
+#if defined(__x86_64__) || defined(__i386__)
+	{ "avx2", sim_batch_kernel_avx2 },
+	{ "sse2", sim_batch_kernel_sse2 },
+#elif defined(__ARM_NEON)
+	{ "neon", sim_batch_kernel_neon },
+#else
+	{ "generic", sim_batch_kernel_generic },
+#endif
+};
+#define SIMB_ISAS	(int)(sizeof(sim_batch_isa)/sizeof(sim_batch_isa[0]))
+
+int sim_batch_selected = -1;		// index in sim_batch_isa, -1: not chosen yet
+
+
+/*
+ *	Kernel named [name], NULL for the best one the CPU supports.
+ *	Return -1 if it isn't in this build or the CPU can't run it.
+ */
+int sim_batch_select(const char * name)
+{
+	int k;
+
+	for (k = 0; k < SIMB_ISAS; k++) {
+#if defined(__x86_64__) || defined(__i386__)
+		if (strcmp(sim_batch_isa[k].name, "avx2") == 0 && !__builtin_cpu_supports("avx2")) continue;
+#endif
+		if (name == NULL || strcmp(sim_batch_isa[k].name, name) == 0) {
+			sim_batch_selected = k;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+const char * sim_batch_isa_name()
+{
+	if (sim_batch_selected < 0) sim_batch_select(NULL);
+	return sim_batch_isa[sim_batch_selected].name;
+}
+
+void sim_batch_free(SimBatch * b)
+{
+	free(b->heading);
+	free(b->x);
+	free(b->y);
+	free(b->sail_fb);
+	free(b->rudder_fb);
+	free(b->v);
+	free(b->heel);
+	free(b->rudder);
+	free(b->sail);
+	free(b->wind_angle);
+	free(b->wind_speed);
+	memset(b, 0, sizeof(SimBatch));
+}
+
+void * sim_batch_array(int capacity)
+{
+	void * p;
+
+	if (posix_memalign(&p, SIMB_ALIGN, capacity * 4) != 0) return NULL;
+	memset(p, 0, capacity * 4);
+	return p;
+}
+
+/*
+ *	[n] boats at the origin [lat0], [lon0], moving on [polar].
+ *	Return -1 if the arrays can't be allocated.
+ */
+int sim_batch_alloc(SimBatch * b, int n, const PolarTable * polar, float lat0, float lon0)
+{
+	memset(b, 0, sizeof(SimBatch));
+	b->n = n;
+	b->capacity = (n + SIMB_PAD - 1) / SIMB_PAD * SIMB_PAD;
+	b->polar = polar;
+	b->lat0 = lat0;
+	b->lon0 = lon0;
+	b->heading = sim_batch_array(b->capacity);
+	b->x = sim_batch_array(b->capacity);
+	b->y = sim_batch_array(b->capacity);
+	b->sail_fb = sim_batch_array(b->capacity);
+	b->rudder_fb = sim_batch_array(b->capacity);
+	b->v = sim_batch_array(b->capacity);
+	b->heel = sim_batch_array(b->capacity);
+	b->rudder = sim_batch_array(b->capacity);
+	b->sail = sim_batch_array(b->capacity);
+	b->wind_angle = sim_batch_array(b->capacity);
+	b->wind_speed = sim_batch_array(b->capacity);
+	if (n <= 0 || polar == NULL || b->heading == NULL || b->x == NULL || b->y == NULL || b->sail_fb == NULL || b->rudder_fb == NULL
+		|| b->v == NULL || b->heel == NULL || b->rudder == NULL || b->sail == NULL || b->wind_angle == NULL || b->wind_speed == NULL) {
+		sim_batch_free(b);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ *	State of boat [k] from / to a SimBoat
+ */
+void sim_batch_set(SimBatch * b, int k, const SimBoat * boat)
+{
+	b->heading[k] = boat->Heading;
+	b->x[k] = ((double)boat->Longitude - b->lon0) * CONVLON;
+	b->y[k] = ((double)boat->Latitude - b->lat0) * CONVLAT;
+	b->sail_fb[k] = boat->Sail_Feedback;
+	b->rudder_fb[k] = boat->Rudder_Feedback;
+	b->v[k] = boat->v_poly;
+	b->heel[k] = boat->heel_sim;
+}
+
+void sim_batch_get(const SimBatch * b, int k, SimBoat * boat)
+{
+	boat->Heading = b->heading[k];
+	boat->Longitude = b->lon0 + (double)b->x[k] / CONVLON;
+	boat->Latitude = b->lat0 + (double)b->y[k] / CONVLAT;
+	boat->Sail_Feedback = b->sail_fb[k];
+	boat->Rudder_Feedback = b->rudder_fb[k];
+	boat->v_poly = b->v[k];
+	boat->heel_sim = b->heel[k];
+	boat->polar = b->polar;
+}
+
+/*
+ *	Move every boat by one control loop
+ */
+void sim_batch_step(SimBatch * b)
+{
+	if (sim_batch_selected < 0) sim_batch_select(NULL);
+	sim_batch_isa[sim_batch_selected].step(b, 0, b->capacity);
+}
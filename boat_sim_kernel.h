@@ -0,0 +1,143 @@
+/*
+ *	BOAT SIMULATION BATCH KERNEL
+ *
+ *	Step of the batch simulator (see boat_sim_batch.h) for one instruction
+ *	set. Included once per instruction set, with:
+ *		SIMB_ISA	suffix of the names (sse2, avx2, neon, generic)
+ *		SIMB_W		floats per vector
+ *		SIMB_TARGET	attributes of the functions
+ *	The code is written with the GCC vector extensions, the same source is
+ *	compiled for every width. It follows sim_step() of boat_sim.h line by
+ *	line, with the position in local metres.
+ */
+
+#ifndef SIMB_CAT
+#define SIMB_CAT2(a, b)		a##_##b
+#define SIMB_CAT(a, b)		SIMB_CAT2(a, b)
+#endif
+
+#define VF	SIMB_CAT(simb_vf, SIMB_ISA)
+#define VI	SIMB_CAT(simb_vi, SIMB_ISA)
+#define FN(f)	SIMB_CAT(f, SIMB_ISA)
+#define INL	static inline __attribute__((always_inline)) SIMB_TARGET
+
+typedef float   VF __attribute__((vector_size(4*SIMB_W)));
+typedef int32_t VI __attribute__((vector_size(4*SIMB_W)));
+
+
+INL VF FN(simb_load)(const float * p) { VF v; memcpy(&v, p, sizeof(v)); return v; }
+INL VI FN(simb_loadi)(const int32_t * p) { VI v; memcpy(&v, p, sizeof(v)); return v; }
+INL void FN(simb_store)(float * p, VF v) { memcpy(p, &v, sizeof(v)); }
+INL void FN(simb_storei)(int32_t * p, VI v) { memcpy(p, &v, sizeof(v)); }
+
+// [m] ? a : b, m lanes all ones or zeros
+INL VF FN(simb_select)(VI m, VF a, VF b) { return (VF)((m & (VI)a) | (~m & (VI)b)); }
+
+// nearest integer, half away from zero
+INL VI FN(simb_round)(VF x)
+{
+	return __builtin_convertvector(x + FN(simb_select)(x < 0, (VF){} - 0.5f, (VF){} + 0.5f), VI);
+}
+
+/*
+ *	sin and cos of [x] in [-PI, PI] (Cephes sinf/cosf polynomials on
+ *	[-PI/4, PI/4], quadrant from the nearest multiple of PI/2)
+ */
+INL void FN(simb_sincos)(VF x, VF * s, VF * c)
+{
+	VI j = FN(simb_round)(x * (float)(2/M_PI)), q = j & 3, swap;
+	VF jf = __builtin_convertvector(j, VF), y, z, ps, pc;
+
+	y = ((x - jf * 1.5703125f) - jf * 4.837512969970703125e-4f) - jf * 7.549789948768648e-8f;
+	z = y * y;
+	ps = y + y * z * (-1.6666654611e-1f + z * (8.3321608736e-3f + z * -1.9515295891e-4f));
+	pc = 1.0f - 0.5f * z + z * z * (4.166664568298827e-2f + z * (-1.388731625493765e-3f + z * 2.443315711809948e-5f));
+	swap = (q & 1) != 0;
+	*s = (VF)((VI)FN(simb_select)(swap, pc, ps) ^ ((q & 2) << 30));
+	*c = (VF)((VI)FN(simb_select)(swap, ps, pc) ^ (((q + 1) & 2) << 30));
+}
+
+/*
+ *	Bilinear lookup of polar_lookup() (polar_table.h) on SIMB_W points:
+ *	cells and weights in vectors, the nodes gathered lane by lane
+ */
+INL void FN(simb_polar)(const PolarTable * t, VF twa, VF tws, VF * speed, VF * heel)
+{
+	VF u = (twa - t->twa0) * t->twa_inv, w = (tws - t->tws0) * t->tws_inv, wa, ws, s00, s01, s10, s11, h00, h01, h10, h11;
+	VI a, b, k;
+	int l, n = t->n_tws;
+
+	u = FN(simb_select)(u < 0, (VF){}, FN(simb_select)(u > (float)(t->n_twa - 1), (VF){} + (float)(t->n_twa - 1), u));
+	w = FN(simb_select)(w < 0, (VF){}, FN(simb_select)(w > (float)(n - 1), (VF){} + (float)(n - 1), w));
+	a = __builtin_convertvector(u, VI);
+	b = __builtin_convertvector(w, VI);
+	a = a + (a > t->n_twa - 2);		// true is -1: last cell
+	b = b + (b > n - 2);
+	wa = u - __builtin_convertvector(a, VF);
+	ws = w - __builtin_convertvector(b, VF);
+	k = a * n + b;
+	for (l = 0; l < SIMB_W; l++) {
+		s00[l] = t->speed[k[l]];     s01[l] = t->speed[k[l]+1];
+		s10[l] = t->speed[k[l]+n];   s11[l] = t->speed[k[l]+n+1];
+		h00[l] = t->heel[k[l]];      h01[l] = t->heel[k[l]+1];
+		h10[l] = t->heel[k[l]+n];    h11[l] = t->heel[k[l]+n+1];
+	}
+	*speed = (1-wa)*((1-ws)*s00 + ws*s01) + wa*((1-ws)*s10 + ws*s11);
+	*heel  = (1-wa)*((1-ws)*h00 + ws*h01) + wa*((1-ws)*h10 + ws*h11);
+}
+
+/*
+ *	Boats [from, to) of [b], multiples of SIMB_W
+ */
+SIMB_TARGET void FN(sim_batch_kernel)(SimBatch * b, int from, int to)
+{
+	VF h, a, v, heel, fbf, d, s, c;
+	VI r, fb, des, rf, m;
+	int i;
+
+	for (i = from; i < to; i += SIMB_W) {
+		// update boat heading
+		r = FN(simb_loadi)(b->rudder + i);
+		h = FN(simb_load)(b->heading + i) + __builtin_convertvector(r, VF) * (float)(-(SIM_ROT/SEC)/30*SIM_SOG);
+		FN(simb_store)(b->heading + i, h);
+
+		// update sail actuator position
+		fb = FN(simb_loadi)(b->sail_fb + i);
+		des = FN(simb_loadi)(b->sail + i);
+		fb = fb - ((fb > des) & (int)(SIM_ACT_INC/SEC)) + ((fb < des) & (int)(SIM_ACT_INC/SEC));
+		FN(simb_storei)(b->sail_fb + i, fb);
+
+		// update rudder position (for the GUI only)
+		rf = FN(simb_loadi)(b->rudder_fb + i);
+		m = rf > r;
+		rf = rf + ((m & -(int)(16/SEC)) | (~m & (int)(16/SEC)));
+		FN(simb_storei)(b->rudder_fb + i, rf);
+
+		// apparent wind in [0, 180] degrees, for the polar table
+		a = (h - FN(simb_load)(b->wind_angle + i)) * (float)(PI/180);
+		a = a - __builtin_convertvector(FN(simb_round)(a * (float)(1/(2*M_PI))), VF) * (float)(2*M_PI);
+		a = (VF)((VI)a & 0x7FFFFFFF) * (float)(180/PI);
+
+		// boat velocity and heeling angle, sail position dependence
+		FN(simb_polar)(b->polar, a, FN(simb_load)(b->wind_speed + i), &v, &heel);
+		fbf = __builtin_convertvector(fb, VF);
+		v = v - 0.000005285f*fbf*fbf + 0.0045983f*fbf;
+		FN(simb_store)(b->v + i, v);
+		FN(simb_store)(b->heel + i, heel);
+
+		// update boat position, heading reduced to [-180, 180] for sin and cos
+		h = h - __builtin_convertvector(FN(simb_round)(h * (1.0f/360)), VF) * 360.0f;
+		FN(simb_sincos)(h * (float)(PI/180), &s, &c);
+		d = v * (float)(1/SEC);
+		FN(simb_store)(b->x + i, FN(simb_load)(b->x + i) + d * s);
+		FN(simb_store)(b->y + i, FN(simb_load)(b->y + i) + d * c);
+	}
+}
+
+#undef VF
+#undef VI
+#undef FN
+#undef INL
+#undef SIMB_ISA
+#undef SIMB_W
+#undef SIMB_TARGET
@@ -0,0 +1,131 @@
+/*
+ *	BOOTSTRAP
+ *
+ *	Create the folder structure and seed the interface files of the sailboat
+ *	processes with direct syscalls, instead of forking a shell for every
+ *	"mkdir -p", "cp" and "[ ! -f file ] && echo 0 > file".
+ *
+ *	The time spent since boot_begin() is reported by boot_report() and, for
+ *	the controller, when the first actuator command is sent.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+
+struct timespec boot_started;
+int boot_errors = 0;
+
+void boot_begin()
+{
+	clock_gettime(CLOCK_MONOTONIC, &boot_started);
+	boot_errors = 0;
+}
+
+double boot_elapsed_ms()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - boot_started.tv_sec)*1000.0 + (now.tv_nsec - boot_started.tv_nsec)/1000000.0;
+}
+
+void boot_error(const char * what, const char * path)
+{
+	fprintf(stderr, "WARNING: bootstrap: cannot %s %s (%s)\n", what, path, strerror(errno));
+	boot_errors++;
+}
+
+/*
+ *	mkdir -p [path]
+ */
+int boot_mkdir_p(const char * path)
+{
+	char tmp[256];
+	char * p;
+
+	snprintf(tmp, sizeof(tmp), "%s", path);
+	for (p = tmp + 1; ; p++) {
+		if (*p != '/' && *p != '\0') continue;
+		char c = *p;
+		*p = '\0';
+		if (mkdir(tmp, 0777) < 0 && errno != EEXIST) { boot_error("create", tmp); return -1; }
+		*p = c;
+		if (c == '\0' || *(p+1) == '\0') break;
+	}
+	return 0;
+}
+
+/*
+ *	Write [value] and a newline to [path] (as "echo value > path"), in one
+ *	write: sysfs files (gpio export, direction, value) reject a lone newline.
+ *	If [overwrite] is 0, an existing file is left untouched.
+ */
+int boot_write(const char * path, const char * value, int overwrite)
+{
+	char buf[256];
+	int fd, len = snprintf(buf, sizeof(buf), "%s\n", value), err = 0;
+
+	if (len >= (int)sizeof(buf)) { boot_error("write", path); return -1; }
+	fd = open(path, O_WRONLY | O_CREAT | (overwrite ? O_TRUNC : O_EXCL), 0666);
+	if (fd < 0) {
+		if (errno == EEXIST && !overwrite) return 0;
+		boot_error("write", path);
+		return -1;
+	}
+	if (write(fd, buf, len) != len) { boot_error("write", path); err = -1; }
+	close(fd);
+	return err;
+}
+
+/*
+ *	Seed a file with [value] only if it doesn't exist yet
+ */
+int boot_seed(const char * path, const char * value)
+{
+	return boot_write(path, value, 0);
+}
+
+/*
+ *	Copy the file [src] into the directory [dir] (as "cp src dir/")
+ */
+int boot_copy(const char * src, const char * dir)
+{
+	char dst[256], buf[4096];
+	const char * name = strrchr(src, '/');
+	int in, out, err = 0;
+	ssize_t n;
+
+	snprintf(dst, sizeof(dst), "%s/%s", dir, name ? name+1 : src);
+	in = open(src, O_RDONLY);
+	if (in < 0) { boot_error("read", src); return -1; }
+	out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (out < 0) { boot_error("write", dst); close(in); return -1; }
+
+	while ((n = read(in, buf, sizeof(buf))) > 0)
+		if (write(out, buf, n) != n) { boot_error("write", dst); err = -1; break; }
+	if (n < 0) { boot_error("read", src); err = -1; }
+
+	close(in);
+	close(out);
+	return err;
+}
+
+void boot_report(const char * process)
+{
+	printf("-> %s bootstrap done in %.2f ms (%d errors)\n", process, boot_elapsed_ms(), boot_errors);
+}
+
+/*
+ *	Report the cold start time once, when the first actuator command is sent
+ */
+void boot_first_command()
+{
+	static int done = 0;
+	if (done) return;
+	done = 1;
+	printf("-> first actuator command %.2f ms after start\n", boot_elapsed_ms());
+}
@@ -0,0 +1,50 @@
+/*
+ *	COMMAND PROTOCOL of the controller command channel
+ *
+ *	Local clients (GUI, xbee server, sailctl) connect to COMMAND_SOCKET, a
+ *	SOCK_SEQPACKET unix socket, and send one Command per packet. The controller
+ *	applies the pending commands at the next tick boundary and answers each of
+ *	them with a CommandAck carrying the tick number it was applied on.
+ */
+
+#include <stdint.h>
+
+#define COMMAND_SOCKET		"/tmp/sailboat/controller.sock"
+#define COMMAND_NAME_LEN	24
+
+enum CommandType {
+	CMD_SET_MODE = 1,	// arg_i[0] = Navigation_System
+	CMD_MANUAL,		// arg_i[0] = Manual_Control, arg_i[1] = rudder angle, arg_i[2] = sail position
+	CMD_SET_TARGET,		// arg_d[0] = latitude, arg_d[1] = longitude of the end point
+	CMD_SET_PARAM,		// name = ext_* parameter, arg_i[0] or arg_d[0] = value
+	CMD_SIMULATION,		// arg_i[0] = Simulation
+	CMD_PROFILE		// arg_i[0] = PROFILE_* action of the stage profiler
+};
+
+enum ProfileAction {
+	PROFILE_OFF = 0,
+	PROFILE_ON,
+	PROFILE_DUMP		// print the stage statistics and write the trace file, if any
+};
+
+enum CommandStatus {
+	CMD_OK = 0,
+	CMD_ERR_TYPE,		// unknown command type
+	CMD_ERR_ARG,		// invalid argument or unknown parameter name
+	CMD_ERR_BUSY		// too many pending commands, not applied
+};
+
+typedef struct {
+	uint32_t type;
+	uint32_t seq;			// chosen by the client, echoed in the ack
+	int32_t  arg_i[3];
+	double   arg_d[2];
+	char     name[COMMAND_NAME_LEN];
+} Command;
+
+typedef struct {
+	uint32_t seq;
+	uint32_t status;
+	uint64_t tick;			// base tick of the controller the command was applied on
+	uint32_t latency_us;		// time between reception and application
+} CommandAck;
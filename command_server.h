@@ -0,0 +1,160 @@
+/*
+ *	COMMAND SERVER
+ *
+ *	SOCK_SEQPACKET server of the controller command channel (protocol in
+ *	command_protocol.h). The listening socket and the clients are served by
+ *	the main loop epoll: received commands are only queued, they are applied
+ *	at the next tick boundary by commands_apply(), so a command never changes
+ *	the controller state in the middle of a tick.
+ */
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "command_protocol.h"
+
+#define COMMAND_MAX_CLIENTS	4
+#define COMMAND_MAX_PENDING	32
+
+typedef int (*command_handler)(const Command * cmd);
+
+typedef struct {
+	Command cmd;
+	int  client;			// fd the ack is sent to
+	struct timespec received;
+} PendingCommand;
+
+typedef struct {
+	int  fd;			// listening socket
+	LoopTimer * loop;
+	int  clients[COMMAND_MAX_CLIENTS];
+	int  npending;
+	PendingCommand pending[COMMAND_MAX_PENDING];
+	uint64_t applied, rejected;
+	long latency_max_us;
+} CommandServer;
+
+
+void commands_on_accept(int fd, void * arg);
+void commands_on_client(int fd, void * arg);
+
+/*
+ *	Create the socket and register it in the loop. Return -1 on error.
+ */
+int commands_init(CommandServer * cs, LoopTimer * loop, const char * path)
+{
+	struct sockaddr_un addr;
+	int n;
+
+	memset(cs, 0, sizeof(CommandServer));
+	cs->loop = loop;
+	for (n = 0; n < COMMAND_MAX_CLIENTS; n++) cs->clients[n] = -1;
+
+	cs->fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0);
+	if (cs->fd < 0) return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+	unlink(path);
+	if (bind(cs->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(cs->fd, COMMAND_MAX_CLIENTS) < 0
+		|| looptimer_add_fd(loop, cs->fd, commands_on_accept, cs) < 0) {
+		close(cs->fd);
+		cs->fd = -1;
+		return -1;
+	}
+	return 0;
+}
+
+void commands_drop_client(CommandServer * cs, int fd)
+{
+	int n;
+
+	looptimer_remove_fd(cs->loop, fd);
+	close(fd);
+	for (n = 0; n < COMMAND_MAX_CLIENTS; n++)
+		if (cs->clients[n] == fd) cs->clients[n] = -1;
+	// don't send acks to a closed (and maybe reused) descriptor
+	for (n = 0; n < cs->npending; n++)
+		if (cs->pending[n].client == fd) cs->pending[n].client = -1;
+}
+
+/*
+ *	Listening socket callback: accept a new client
+ */
+void commands_on_accept(int fd, void * arg)
+{
+	CommandServer * cs = (CommandServer *)arg;
+	int client, n;
+
+	while ((client = accept(fd, NULL, NULL)) >= 0) {
+		fcntl(client, F_SETFL, O_NONBLOCK);
+		for (n = 0; n < COMMAND_MAX_CLIENTS; n++)
+			if (cs->clients[n] < 0) break;
+		if (n == COMMAND_MAX_CLIENTS || looptimer_add_fd(cs->loop, client, commands_on_client, cs) < 0) {
+			close(client);
+			continue;
+		}
+		cs->clients[n] = client;
+	}
+}
+
+/*
+ *	Client callback: queue the received commands
+ */
+void commands_on_client(int fd, void * arg)
+{
+	CommandServer * cs = (CommandServer *)arg;
+	CommandAck ack;
+	Command cmd;
+	ssize_t r;
+
+	while ((r = recv(fd, &cmd, sizeof(cmd), 0)) > 0) {
+		if (r != sizeof(cmd)) continue;		// malformed packet
+		if (cs->npending >= COMMAND_MAX_PENDING) {
+			memset(&ack, 0, sizeof(ack));
+			ack.seq = cmd.seq;
+			ack.status = CMD_ERR_BUSY;
+			send(fd, &ack, sizeof(ack), MSG_NOSIGNAL);
+			cs->rejected++;
+			continue;
+		}
+		cmd.name[COMMAND_NAME_LEN-1] = '\0';
+		cs->pending[cs->npending].cmd = cmd;
+		cs->pending[cs->npending].client = fd;
+		clock_gettime(CLOCK_MONOTONIC, &cs->pending[cs->npending].received);
+		cs->npending++;
+	}
+	if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) commands_drop_client(cs, fd);
+}
+
+/*
+ *	Apply the pending commands with [handler] and acknowledge them with [tick]
+ */
+void commands_apply(CommandServer * cs, uint64_t tick, command_handler handler)
+{
+	struct timespec now;
+	CommandAck ack;
+	long latency;
+	int  n;
+
+	if (cs->npending == 0) return;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	for (n = 0; n < cs->npending; n++) {
+		PendingCommand * p = &cs->pending[n];
+
+		latency = timespec_diff_us(&now, &p->received);
+		if (latency > cs->latency_max_us) cs->latency_max_us = latency;
+
+		memset(&ack, 0, sizeof(ack));
+		ack.seq = p->cmd.seq;
+		ack.status = handler(&p->cmd);
+		ack.tick = tick;
+		ack.latency_us = latency;
+		if (ack.status == CMD_OK) cs->applied++;
+		else cs->rejected++;
+
+		if (p->client >= 0) send(p->client, &ack, sizeof(ack), MSG_NOSIGNAL);
+	}
+	cs->npending = 0;
+}
@@ -0,0 +1,236 @@
+/*
+ *	CONFIG WATCHER
+ *
+ *	Cache the value of small configuration files (one number per file, as
+ *	written by the GUI in /tmp/sailboat) into the controller variables.
+ *	The directory is watched with inotify: a file is read and parsed again only
+ *	when it has been written, instead of being reopened on every tick.
+ *
+ *	Two update modes are supported:
+ *		- [CFG_ALWAYS]    the variable takes the file value at every read
+ *		- [CFG_ON_CHANGE] the variable is only overwritten when the file value
+ *				  differs from the previous one read from the same file,
+ *				  so the algorithm can modify it meanwhile
+ *
+ *	[generation] is incremented every time a variable gets a new value.
+ *	config_poll() is called every tick: without inotify it reads all the
+ *	files, with it only after an update was lost (full queue, overflow of
+ *	the inotify queue).
+ *
+ *	When [queue] is set, the files are read by another thread: the parsed
+ *	values are pushed as ConfigUpdate records and only assigned to the
+ *	variables by config_apply(), in the thread that owns them. A file also
+ *	written by that thread through the output queue can be fenced with
+ *	config_fence(): values read before the write reached the file are dropped,
+ *	so an old value can't overwrite a newer one.
+ */
+
+#include <sys/inotify.h>
+
+#define CONFIG_MAX_ENTRIES	32
+#define CONFIG_EVENT_BUFFER	4096
+
+enum ConfigType { CFG_INT, CFG_FLOAT };
+enum ConfigMode { CFG_ALWAYS, CFG_ON_CHANGE };
+
+typedef struct {
+	const char * name;		// file name inside the watched directory
+	int  type, mode;
+	void * target;			// variable updated with the file value
+	int   last_i;			// last value read from the file
+	float last_f;
+	uint32_t fence;			// output sequence number of the last write of the file
+} ConfigEntry;
+
+typedef struct {
+	int   entry;
+	int   vi;
+	float vf;
+	uint32_t seen;			// output records applied when the file was read
+} ConfigUpdate;
+
+typedef struct {
+	char dir[64];
+	int  fd;			// inotify descriptor, -1 when polling
+	int  n;
+	ConfigEntry entry[CONFIG_MAX_ENTRIES];
+	uint32_t generation;		// number of variable updates so far
+	uint64_t reads;			// number of files parsed
+	int  verbose;
+	SpscRing * queue;		// updates for the owner thread, NULL to assign directly
+	volatile uint32_t * output_done;	// [done] of the output queue, for the fences
+	int  reload;			// an update was lost: read all the files at the next poll
+} ConfigWatch;
+
+
+/*
+ *	Start watching [dir]. Return -1 if inotify is not available, the
+ *	entries can still be read with config_reload_all().
+ */
+int config_init(ConfigWatch * cw, const char * dir)
+{
+	memset(cw, 0, sizeof(ConfigWatch));
+	snprintf(cw->dir, sizeof(cw->dir), "%s", dir);
+
+	cw->fd = inotify_init1(IN_NONBLOCK);
+	if (cw->fd < 0) return -1;
+	if (inotify_add_watch(cw->fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		close(cw->fd);
+		cw->fd = -1;
+		return -1;
+	}
+	return 0;
+}
+
+void config_add(ConfigWatch * cw, const char * name, int type, int mode, void * target)
+{
+	if (cw->n >= CONFIG_MAX_ENTRIES) return;
+	cw->entry[cw->n].name = name;
+	cw->entry[cw->n].type = type;
+	cw->entry[cw->n].mode = mode;
+	cw->entry[cw->n].target = target;
+	cw->n++;
+}
+
+/*
+ *	Assign a value read from the file of [e] to its variable
+ */
+void config_assign(ConfigWatch * cw, ConfigEntry * e, int vi, float vf)
+{
+	if (e->type == CFG_INT) {
+		if (*(int *)e->target == vi) return;
+		*(int *)e->target = vi;
+		if (cw->verbose) printf("current %s: %d \n", e->name, vi);
+	} else {
+		if (*(float *)e->target == vf) return;
+		*(float *)e->target = vf;
+		if (cw->verbose) printf("current %s: %f \n", e->name, vf);
+	}
+	cw->generation++;
+}
+
+/*
+ *	Parse the file of one entry and update its variable (or queue the update)
+ */
+void config_reload(ConfigWatch * cw, ConfigEntry * e)
+{
+	ConfigUpdate u;
+	char path[128];
+	FILE * f;
+	int   vi = 0;
+	float vf = 0;
+	int   r;
+
+	u.seen = cw->output_done ? *cw->output_done : 0;
+	__sync_synchronize();		// [seen] is sampled before the file is read
+	snprintf(path, sizeof(path), "%s/%s", cw->dir, e->name);
+	f = fopen(path, "r");
+	if (f == NULL) return;
+	r = (e->type == CFG_INT) ? fscanf(f, "%d", &vi) : fscanf(f, "%f", &vf);
+	fclose(f);
+	cw->reads++;
+	if (r != 1) return;
+
+	if (e->mode == CFG_ON_CHANGE && (e->type == CFG_INT ? vi == e->last_i : vf == e->last_f)) return;
+
+	if (cw->queue != NULL) {
+		// queue full: the file is read again at the next poll, the value isn't taken as seen
+		u.entry = e - cw->entry;
+		u.vi = vi;
+		u.vf = vf;
+		if (spsc_push(cw->queue, &u) < 0) {
+			cw->reload = 1;
+			return;
+		}
+	}
+	else config_assign(cw, e, vi, vf);
+	e->last_i = vi;
+	e->last_f = vf;
+}
+
+/*
+ *	Owner thread: assign the queued updates, except the ones read before
+ *	the fence of their file
+ */
+void config_apply(ConfigWatch * cw)
+{
+	ConfigUpdate u;
+
+	if (cw->queue == NULL) return;
+	while (spsc_pop(cw->queue, &u) == 0) {
+		ConfigEntry * e = &cw->entry[u.entry];
+		if (e->fence != 0 && !output_seen(u.seen, e->fence)) continue;
+		config_assign(cw, e, u.vi, u.vf);
+	}
+}
+
+/*
+ *	The owner thread wrote the file [name] with the output record [seq]
+ */
+void config_fence(ConfigWatch * cw, const char * name, uint32_t seq)
+{
+	int n;
+
+	if (seq == 0) return;
+	for (n = 0; n < cw->n; n++)
+		if (strcmp(cw->entry[n].name, name) == 0) cw->entry[n].fence = seq;
+}
+
+/*
+ *	Set the variable bound to the file [name] without reading the file
+ *	(used by the command channel). Return -1 if [name] is unknown.
+ */
+int config_set(ConfigWatch * cw, const char * name, int vi, float vf)
+{
+	int n;
+
+	for (n = 0; n < cw->n; n++) {
+		ConfigEntry * e = &cw->entry[n];
+		if (strcmp(e->name, name) != 0) continue;
+		if (e->type == CFG_INT) *(int *)e->target = vi;
+		else *(float *)e->target = vf;
+		cw->generation++;
+		return 0;
+	}
+	return -1;
+}
+
+void config_reload_all(ConfigWatch * cw)
+{
+	int n;
+	for (n = 0; n < cw->n; n++) config_reload(cw, &cw->entry[n]);
+}
+
+/*
+ *	Every tick of the reading thread: all the files without inotify or
+ *	after a lost update
+ */
+void config_poll(ConfigWatch * cw)
+{
+	if (cw->fd >= 0 && !cw->reload) return;
+	cw->reload = 0;
+	config_reload_all(cw);
+}
+
+/*
+ *	inotify callback: reload the entries whose file has been written
+ */
+void config_on_event(int fd, void * arg)
+{
+	ConfigWatch * cw = (ConfigWatch *)arg;
+	char buf[CONFIG_EVENT_BUFFER] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event * ev;
+	ssize_t len;
+	char * p;
+	int  n;
+
+	while ((len = read(fd, buf, sizeof(buf))) > 0) {
+		for (p = buf; p < buf + len; p += sizeof(struct inotify_event) + ev->len) {
+			ev = (const struct inotify_event *)p;
+			if (ev->mask & IN_Q_OVERFLOW) config_reload_all(cw);	// events lost
+			if (ev->len == 0) continue;
+			for (n = 0; n < cw->n; n++)
+				if (strcmp(ev->name, cw->entry[n].name) == 0) config_reload(cw, &cw->entry[n]);
+		}
+	}
+}
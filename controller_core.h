@@ -0,0 +1,1344 @@
+/*
+ *	CONTROLLER CORE
+ *
+ *	Guidance, rudder, sail and hill climbing algorithms of the controller,
+ *	without any I/O: the whole state of one boat controller is in a
+ *	ControllerState, the values read from the sensors and the GUI come in a
+ *	ControllerInputs and everything to be sent to the actuators or shown in
+ *	the GUI goes out in a ControllerOutputs.
+ *
+ *		ControllerState s;
+ *		controller_init(&s);
+ *		loop at SEC:
+ *			controller_step(&s, &in, &out);		// control rate group
+ *			controller_rudder_step(&s, &in, &out);	// rudder rate group
+ *
+ *	controller_step() and controller_rudder_step() run the two rate groups of
+ *	controller.c, a simulation running both at SEC reproduces the original
+ *	single loop. [out->updated] tells which outputs the step produced
+ *	(CTRL_* flags), the caller publishes them.
+ *
+ *	Any number of instances can run in parallel: the only globals are the
+ *	debug switches (traces on stdout, all off by default) and the profiler.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <complex.h>
+#include <string.h>
+
+#define SEC		4.0		// number of loops per second (control rate group)
+#define PI 		3.14159265
+
+#define TACKINGRANGE 	100		// meters
+#define RADIUSACCEPTED	5		// meters
+#define CONVLON		64078		// meters per degree
+#define CONVLAT		110742		// meters per degree
+
+#define theta_nogo	55*PI/180	// [radians] Angle of nogo zone, compared to wind direction
+#define theta_down	30*PI/180 	// [radians] Angle of downwind zone, compared to wind direction.
+#define v_min		0.5		// [meters/seconds] Min velocity for tacking
+#define angle_lim 	5*PI/180	// [degrees] threshold for jibing. The heading has to be 5 degrees close to desired Heading.
+#define ROLL_LIMIT 	15		// [degrees] Threshold for an automatic emergency sail release
+
+#define dtime		120		// [seconds] Duty Cycle Period
+
+#define INTEGRATOR_MAX	20		// [degrees], influence of the integrator
+#define RATEOFTURN_MAX	36		// [degrees/second]
+#define dHEADING_MAX	10		// [degrees] deviation, before rudder PI acts
+#define GAIN_P 		-1
+#define GAIN_I 		0
+
+#define BoomLength	1.6 		// [meters] Length of the Boom
+#define SCLength	1.43 		// [meters] horizontal distance between sheet hole and mast
+#define SCHeight	0.6		// [meters] vertical distance between sheet hole and boom.
+#define strokelength	0.5		// [meters] actuator length
+
+// Sail Hill Climbing
+#define SAIL_ACT_TIME  3		// [seconds] actuation time of the sail hillclimbing algoritm
+#define SAIL_OBS_TIME  20		// [seconds] observation time of the sail hillclimbing algoritm
+#define ACT_MAX		870		// [ticks] the max number of actuator ticks
+#define SAIL_LIMIT	150		// [ticks] max tolerated difference between desired and current actuator position
+#define MAX_DUTY_CYCLE 	0.6     	// [%] Datasheet max duty cycle
+#define ACT_PRECISION	20		// [ticks] how close the actuator gets to the Sail_Desired_Position
+
+#define VMG_BUFFER	120		// [loops] velocity buffer of the hill climbing controllers (steptime/2*SEC)
+#define WIND_BUFFER	40		// [loops] wind direction buffer of meanwind() (10 seconds)
+#define HEEL_BUFFER	40		// [loops] heeling buffer of the heeling controller (5 seconds)
+#define DUTY_BUFFER	60		// [loops] actuator history of the duty cycle observer
+
+// instrumentation, when the profiler isn't included
+#ifndef PROF_CALL
+#define PROF_BEGIN(s)
+#define PROF_END(s)
+#define PROF_CALL(s, call)	call
+#endif
+
+int   debug=0, debug2=0, debug3=0, debug4=0, debug5=0, debug6=0, debug_hc=0, debug_jibe=0;
+
+// GUI parameters (ext_* files)
+typedef struct {
+	int   sail_state, heading_state;	// sail tune and heading algorithm
+	int   steptime, stepsize, vLOS, stepDIR, DIR_init, des_heading, des_app_w, sail_stepsize, sail_pos;
+	float des_slope;
+} ControllerParams;
+
+typedef struct {
+	// weather station
+	float Heading, Roll, Latitude, Longitude, SOG, Wind_Angle;
+	int   Sail_Feedback;
+
+	// navigation system and GUI
+	int   Navigation_System, Manual_Control, Manual_Control_Rudder, Manual_Control_Sail;
+	float Point_Start_Lat, Point_Start_Lon, Point_End_Lat, Point_End_Lon;
+	ControllerParams params;
+
+	// simulation: [v_poly] and [heel_sim] are used instead of SOG and Roll
+	int   Simulation;
+	float v_poly, heel_sim;
+} ControllerInputs;
+
+enum ControllerOutput {
+	CTRL_RUDDER	= 1 << 0,	// [rudder] rudder angle command
+	CTRL_SAIL	= 1 << 1,	// [sail] sail actuator command (not sent while the duty cycle is exceeded)
+	CTRL_DUTY	= 1 << 2,	// [duty] sail actuator duty cycle
+	CTRL_GUIDANCE	= 1 << 3,	// [guidance_heading], [theta_wind], [boundary]
+	CTRL_DES_COURSE	= 1 << 4,	// [des_course] desired course, when it changes
+	CTRL_U_SAIL	= 1 << 5,	// [u_sail] sail hill climbing input
+	CTRL_MEAN_WIND	= 1 << 6,	// [mean_wind]
+	CTRL_NAVIGATION	= 1 << 7	// [navigation_system] mode change requested (waypoint reached)
+};
+
+typedef struct {
+	int   updated;			// CTRL_* flags
+	int   rudder;
+	int   sail;
+	float duty;
+	float guidance_heading;		// [degrees]
+	float theta_wind;		// [radians]
+	float _Complex boundary[4];	// tacking boundary end points, longitude + I*latitude
+	int   des_course;
+	int   u_sail;
+	int   mean_wind;
+	int   navigation_system;
+} ControllerOutputs;
+
+typedef struct {
+	// guidance
+	float _Complex X, X_T, X_T_b, X_b, X0;
+	float _Complex X1, X2, X3, X4;		// Tacking boundary end points
+	float _Complex Geo_X1, Geo_X2, Geo_X3, Geo_X4;
+	float integratorSum, Guidance_Heading;
+	float theta, theta_b, theta_d, theta_d_b, theta_d1, theta_d1_b, a_x, b_x;
+	float theta_pM, theta_pM_b, theta_d_out, theta_mean_wind;
+	int   sig, sig1, sig2, sig3;		// coordinating the guidance
+	int   roll_counter, tune_counter, counter;
+	int   jibe_status, actIn, fa_debug;
+
+	// commands
+	int   Rudder_Desired_Angle, Sail_Desired_Position, desACTpos;
+	int   des_course;			// last desired course sent to the GUI
+
+	// hill climbing
+	float ctri_heel, ctri_headsl, ctri_head, ctri_sail;
+	int   u_sail;				// u_sail=0 is equal to a sail angle close to zero.
+	int   u_headsl, u_head, u_heel;
+	int   headstep;			// Stepheading
+
+	// sail_hc_controller()
+	float v_mean_sail, v_sail, v_old_sail, u_old_sail;
+	int   intern_sail_pos, a_sail;
+	float V_vmg_sail[VMG_BUFFER];
+
+	// heading_hc_controller()
+	float v_head, v_old_head;
+	int   u_old_head, intern_DIR_head, a_head;
+	float V_vmg_head[VMG_BUFFER];
+
+	// heading_hc_slope_controller()
+	float v_old_headsl;
+	int   u_old_headsl, intern_DIR_headsl;
+
+	// heading_hc_heeling_controller()
+	int   u_old_heel, intern_DIR_heel, a_heel;
+	float heel_old, V_heeling[HEEL_BUFFER];
+
+	// stepheading()
+	int   counter_stephead, steps, intern_DIR_step;
+
+	// meanwind()
+	int   a_wind;
+	float V_angles[WIND_BUFFER];
+
+	// sail_duty_cycle() duty cycle observer
+	int   act_history[DUTY_BUFFER], actStop;
+} ControllerState;
+
+
+void guidance(ControllerState * s, const ControllerInputs * in, ControllerOutputs * out);
+void findAngle(ControllerState * s);
+void chooseManeuver(ControllerState * s, const ControllerInputs * in);
+void performManeuver(ControllerState * s, const ControllerInputs * in);
+void jibe_pass_fcn(ControllerState * s, const ControllerInputs * in);
+void rudder_pid_controller(ControllerState * s, const ControllerInputs * in, ControllerOutputs * out);
+void sail_controller(ControllerState * s, const ControllerInputs * in);
+void sail_hc_controller(ControllerState * s, const ControllerInputs * in, ControllerOutputs * out);
+void heading_hc_controller(ControllerState * s, const ControllerInputs * in);
+void heading_hc_slope_controller(ControllerState * s, const ControllerInputs * in);
+void heading_hc_heeling_controller(ControllerState * s, const ControllerInputs * in);
+void stepheading(ControllerState * s, const ControllerInputs * in);
+void meanwind(ControllerState * s, const ControllerInputs * in, ControllerOutputs * out);
+void countFCN(ControllerState * s, const ControllerParams * p);
+void sail_duty_cycle(ControllerState * s, const ControllerInputs * in, ControllerOutputs * out, int position);
+int  sign(float val);
+int  signfcn(float);
+
+
+/*
+ *	Default values of the GUI parameters (before the ext_* files are read)
+ */
+void controller_params_default(ControllerParams * p)
+{
+	p->sail_state = 1;
+	p->heading_state = 1;
+	p->steptime = 30;
+	p->stepsize = 10;
+	p->vLOS = 0;
+	p->stepDIR = 1;
+	p->DIR_init = 0;
+	p->des_heading = 100;
+	p->des_app_w = 100;
+	p->sail_stepsize = 5;
+	p->sail_pos = 0;
+	p->des_slope = 0.0015;
+}
+
+/*
+ *	Initial state of a controller
+ */
+void controller_init(ControllerState * s)
+{
+	memset(s, 0, sizeof(ControllerState));
+	s->jibe_status = 1;
+	s->des_course = -1;
+	s->u_headsl = 180;		// Initialized u_headsl going southwards
+	s->u_head = 180;
+	s->u_heel = 180;
+	s->headstep = 180;		// Initially on downwind course
+	s->v_old_sail = 20;
+	s->u_old_sail = 13;
+	s->v_old_head = 20;
+	s->u_old_head = 13;
+	s->v_old_headsl = 20;
+	s->u_old_headsl = 13;
+	s->u_old_heel = 13;
+}
+
+/*
+ *	Sail actuator position for a sail angle of [angle] degrees
+ */
+int sail_position(float angle)
+{
+	return ACT_MAX/strokelength/2*(sqrt( SCLength*SCLength + BoomLength*BoomLength - 2*SCLength*BoomLength*cos(angle*PI/180) + SCHeight*SCHeight)-sqrt( SCLength*SCLength + BoomLength*BoomLength -2*SCLength*BoomLength*cos(0) + SCHeight*SCHeight));
+}
+
+/*
+ *	CONTROL STEP (control rate group, SEC)
+ *	Mean wind, heading algorithm (guidance or hill climbing), sail controller
+ *	and duty cycle observer of the sail actuator
+ */
+void controller_step(ControllerState * s, const ControllerInputs * in, ControllerOutputs * out)
+{
+	const ControllerParams * p = &in->params;
+
+	out->updated = 0;
+	if (in->Manual_Control) {
+		s->desACTpos = in->Manual_Control_Sail;	// the actuators take the user position
+		return;
+	}
+	if (in->Navigation_System != 1 && in->Navigation_System != 3) return;
+
+	meanwind(s, in, out);
+	countFCN(s, p);
+	switch(p->heading_state)
+	{
+		case 1:
+			PROF_CALL(PROF_GUIDANCE, guidance(s, in, out));	// Calculate the desired heading
+			break;
+		case 2:
+			PROF_CALL(PROF_HEADING_HC, heading_hc_slope_controller(s, in));
+			break;
+		case 3:
+			PROF_CALL(PROF_HEADING_HC, heading_hc_controller(s, in));	// Execute the heading hillclimbing algorithm
+			break;
+		case 4:
+			PROF_CALL(PROF_HEADING_HC, stepheading(s, in));
+			break;
+		case 5:
+			break;
+		case 6:
+			PROF_CALL(PROF_HEADING_HC, heading_hc_heeling_controller(s, in));
+			break;
+		default:
+			if(debug) printf("heading_state switch case error.");
+	}
+
+	PROF_BEGIN(PROF_SAIL_CTRL);
+	switch(p->sail_state)
+	{
+		case 1:
+			s->desACTpos = sail_position(p->sail_pos);
+			break;
+		case 2:
+			sail_hc_controller(s, in, out);		// Execute the sail hillclimbing algorithm
+			break;
+		case 3:
+			if (debug_jibe) printf("actIn before sail controller: %d \n", s->actIn);
+			sail_controller(s, in);			// Execute the default sail controller
+			if (debug_jibe) printf("desACTpos after sail controller: %d \n", s->desACTpos);
+			break;
+	}
+	PROF_END(PROF_SAIL_CTRL);
+	PROF_CALL(PROF_MOVE_SAIL, sail_duty_cycle(s, in, out, s->desACTpos));
+
+	// reaching the waypoint: switch to maintain position
+	if  ( (cabs(s->X_T - s->X) < RADIUSACCEPTED) && (in->Navigation_System==1) )
+	{
+		out->navigation_system = 3;
+		out->updated |= CTRL_NAVIGATION;
+	}
+}
+
+/*
+ *	RUDDER STEP (rudder rate group)
+ *	Steer towards the desired heading, or the user position in manual control
+ */
+void controller_rudder_step(ControllerState * s, const ControllerInputs * in, ControllerOutputs * out)
+{
+	out->updated = 0;
+	if (in->Manual_Control) {
+		out->rudder = in->Manual_Control_Rudder;
+		out->updated |= CTRL_RUDDER;
+		return;
+	}
+	if (in->Navigation_System == 1 || in->Navigation_System == 3)
+		PROF_CALL(PROF_RUDDER_PID, rudder_pid_controller(s, in, out));
+}
+
+
+
+
+/*
+ *	GUIDANCE V3:
+ *
+ *	Calculate the desired Heading based on the WindDirection, StartPoint, EndPoint, CurrentPosition and velocity.
+ *
+ *	This version is able to perform tacking and jibing. Compared to V1, it needs another input theta, which is the
+ *	current heading of the vessel. Also it has two more outputs: 'sig' and 'dtheta'. They are used in tacking situations,
+ *	putting the rudder on the desired angle. This leads to changes in the rudder-pid-controller, see below.
+ *
+ *	Daniel Wrede, May 2013
+ */
+void guidance(ControllerState * s, const ControllerInputs * in, ControllerOutputs * out)
+{
+	// GUIDANCE V3: nogozone, tack and jibe capable solution
+	//  - Let's try to keep the order using sig,sig1,sig2,sig3 and theta_d,theta_d1. theta_d_b is actually needed in the chooseManeuver function.
+	//  - lat and lon translation would be better on the direct input
+	if (debug) printf("*********** Guidance **************** \n");
+	float x, y, theta_wind;
+	float _Complex Geo_X, Geo_X0, Geo_X_T;
+
+
+	//if (debug) printf("theta_d: %4.1f [deg]\n",theta_d*180/PI);
+
+	x=in->Longitude;
+	y=in->Latitude;
+	s->theta=in->Heading*PI/180;
+	theta_wind=in->Wind_Angle*PI/180;
+
+	// complex notation for x,y position of the starting point
+	Geo_X0 = in->Point_Start_Lon + 1*I*in->Point_Start_Lat;
+	s->X0 = 0 + 1*I*0;
+
+	// complex notation for x,y position of the boat
+	Geo_X = x + 1*I*y;
+	s->X=(Geo_X-Geo_X0);
+	s->X=creal(s->X)*CONVLON + I*cimag(s->X)*CONVLAT;
+
+	// complex notation for x,y position of the target point
+	Geo_X_T = in->Point_End_Lon + I*in->Point_End_Lat;
+	s->X_T=(Geo_X_T-Geo_X0);
+	s->X_T=creal(s->X_T)*CONVLON + I*cimag(s->X_T)*CONVLAT;
+	if (debug) printf("Point_End_Lon: %f \n",in->Point_End_Lon);
+	if (debug) printf("Point_End_Lat: %f \n",in->Point_End_Lat);
+
+	// ** turning matrix **
+
+	// The calculations in the guidance system are done assuming constant wind
+	// from above. To make this system work, we need to 'turn' it according to
+	// the wind direction. It is like looking on a map, you have to find the
+	// north before reading it.
+
+	// Using theta_wind to transfer X_T. Here theta_wind is expected to be zero
+	// when coming from north, going clockwise in radians.
+	s->X_T_b = ccos(atan2(cimag(s->X_T),creal(s->X_T))+theta_wind)*cabs(s->X_T) + 1*I*(csin(atan2(cimag(s->X_T),creal(s->X_T))+theta_wind)*cabs(s->X_T));
+	if (debug) printf("X_T_b: %f + I*%f \n",creal(s->X_T_b),cimag(s->X_T_b));
+	
+	s->X_b = ccos(atan2(cimag(s->X),creal(s->X))+theta_wind)*cabs(s->X) + 1*I*(csin(atan2(cimag(s->X),creal(s->X))+theta_wind)*cabs(s->X));
+	s->theta_b = theta_wind - s->theta + PI/2;
+	if (debug_jibe) printf("init SIG:[%d]\n",s->sig);
+
+	if (s->sig == 0)  
+	{
+		PROF_CALL(PROF_FINDANGLE, findAngle(s));
+		if (debug) printf("findAngle SIG1:[%d]\n",s->sig1);
+                if (s->sig1 == 1) { chooseManeuver(s, in); if (debug) printf("chooseManeuver SIG2:[%d]\n",s->sig2); }
+		else { s->sig2 = s->sig1; }
+	}
+	else
+	{
+		s->theta_d1_b = s->theta_d_b;
+                s->sig1 = s->sig;		
+                s->sig2 = s->sig1;
+	}
+
+	//if (debug) printf("theta_d1: %4.1f deg. \n",theta_d1);
+
+        if (s->sig2 > 0) { performManeuver(s, in); if (debug) printf("performManeuver SIG3:[%d]\n",s->sig3); }
+	else { s->sig3 = s->sig2; }
+
+	if (debug5) printf("SIG1: [%d] - SIG2: [%d] - SIG3: [%d] \n",s->sig1, s->sig2, s->sig3);
+
+	// Updating the history angle, telling the guidance heading from last iteration
+	s->theta_d_b = s->theta_d1_b;
+	s->sig = s->sig3;
+
+	// Inverse turning matrix
+	s->theta_d1 = s->theta_d1_b-theta_wind;
+	s->theta_pM = s->theta_pM_b-theta_wind;
+
+	// Finding Geo_Xn. 3 Steps. Correcting for wind, CONVLON/LAT, geographic location
+	s->X1 = ccos(atan2(cimag(s->X1),creal(s->X1))-theta_wind)*cabs(s->X1) + 1*I*(csin(atan2(cimag(s->X1),creal(s->X1))-theta_wind)*cabs(s->X1));
+	s->X1 = creal(s->X1)/CONVLON + I*cimag(s->X1)/CONVLAT;
+	s->Geo_X1 = s->X1 + Geo_X0;
+	
+	s->X2 = ccos(atan2(cimag(s->X2),creal(s->X2))-theta_wind)*cabs(s->X2) + 1*I*(csin(atan2(cimag(s->X2),creal(s->X2))-theta_wind)*cabs(s->X2));
+	s->X2 = creal(s->X2)/CONVLON + I*cimag(s->X2)/CONVLAT;
+	s->Geo_X2 = s->X2 + Geo_X0;
+
+	s->X3 = ccos(atan2(cimag(s->X3),creal(s->X3))-theta_wind)*cabs(s->X3) + 1*I*(csin(atan2(cimag(s->X3),creal(s->X3))-theta_wind)*cabs(s->X3));
+	s->X3 = creal(s->X3)/CONVLON + I*cimag(s->X3)/CONVLAT;
+	s->Geo_X3 = s->X3 + Geo_X0;
+
+	s->X4 = ccos(atan2(cimag(s->X4),creal(s->X4))-theta_wind)*cabs(s->X4) + 1*I*(csin(atan2(cimag(s->X4),creal(s->X4))-theta_wind)*cabs(s->X4));
+	s->X4 = creal(s->X4)/CONVLON + I*cimag(s->X4)/CONVLAT;
+	s->Geo_X4 = s->X4 + Geo_X0;
+
+	//if (debug3) printf("\nTacking boundary end points:\n");
+	//if (debug3) printf("GeoX0: %f + I*%f \n",creal(Geo_X0),cimag(Geo_X0));
+	//if (debug3) printf("GeoXT: %f + I*%f \n",creal(Geo_X_T),cimag(Geo_X_T));
+	//if (debug3) printf("GeoX1: %f + I*%f \n",creal(Geo_X1),cimag(Geo_X1));
+	//if (debug3) printf("GeoX2: %f + I*%f \n",creal(Geo_X2),cimag(Geo_X2));
+	//if (debug3) printf("GeoX3: %f + I*%f \n",creal(Geo_X3),cimag(Geo_X3));
+	//if (debug3) printf("GeoX4: %f + I*%f \n",creal(Geo_X4),cimag(Geo_X4));
+
+
+	if ( s->sig3>0 ) { s->theta_d_out = s->theta_pM; }
+	else { s->theta_d_out = s->theta_d1; }
+	s->Guidance_Heading = (PI/2 - s->theta_d_out) * 180/PI; 
+
+	if (debug) printf("FA_DEBUG:[%d]\n",s->fa_debug);
+
+	// guidance heading, wind and tacking boundaries to be displayed in the GUI
+	out->guidance_heading = s->Guidance_Heading;
+	out->theta_wind = theta_wind;
+	out->boundary[0] = s->Geo_X1;
+	out->boundary[1] = s->Geo_X2;
+	out->boundary[2] = s->Geo_X3;
+	out->boundary[3] = s->Geo_X4;
+	out->updated |= CTRL_GUIDANCE;
+
+}
+
+void findAngle(ControllerState * s)
+{
+//	bool inrange;
+	float theta_LOS, theta_LOS0, theta_l, theta_r, theta_dl, theta_dr;
+	float _Complex Xl, Xr, Xdl, Xdr;
+
+	// DEADzone limit direction
+	Xl = -sin(theta_nogo)*2.8284 + I*cos(theta_nogo)*2.8284;	//-2 + 2*1*I;
+	Xr = sin(theta_nogo)*2.8284 + I*cos(theta_nogo)*2.8284;		// 2 + 2*1*I;        
+
+	// DOWNzone limit direction
+        Xdl = -sin(theta_down)*2.8284 - I*cos(theta_down)*2.8284;        //-2 - 2*1*I;
+        Xdr = sin(theta_down)*2.8284 - I*cos(theta_down)*2.8284;        // 2 - 2*1*I;        
+
+	// definition of angles
+	theta_LOS = atan2(cimag(s->X_T_b)-cimag(s->X_b),creal(s->X_T_b)-creal(s->X_b));
+	theta_LOS0 = atan2(cimag(s->X_T_b)-cimag(s->X0),creal(s->X_T_b)-creal(s->X0));
+	theta_l = atan2(cimag(exp(-1*I*theta_LOS)*Xl),creal(cexp(-1*I*theta_LOS)*Xl));
+	theta_r = atan2(cimag(exp(-1*I*theta_LOS)*Xr),creal(cexp(-1*I*theta_LOS)*Xr));
+	// downwind angles
+	theta_dl = atan2(cimag(exp(-1*I*theta_LOS)*Xdl),creal(cexp(-1*I*theta_LOS)*Xdl));
+	theta_dr = atan2(cimag(exp(-1*I*theta_LOS)*Xdr),creal(cexp(-1*I*theta_LOS)*Xdr));
+
+	// tacking boundaries
+	// Line: x = a_x*y +/- b_x
+	if (creal(s->X_T_b-s->X0) != 0) { s->a_x = creal(s->X_T_b-s->X0)/cimag(s->X_T_b-s->X0); }
+	else {s->a_x=0;}
+
+
+	//if (debug) printf("theta_LOS: %f \n",theta_LOS);
+	//if (debug) printf("angle(Xdr): %f \n",atan2(cimag(Xdr),creal(Xdr)));
+	//if (debug) printf("angle(Xdl): %f \n",atan2(cimag(Xdl),creal(Xdl)));
+
+	//if (debug) printf("a_x: %f \n",a_x);
+	s->b_x = TACKINGRANGE / (2 * sin(theta_LOS0));
+	if (debug3) printf("\nTacking boundary end points:\n");
+	if (debug3) printf("X0: %f + I*%f \n",creal(s->X0),cimag(s->X0));
+	if (debug3) printf("X_T_b: %f + I*%f \n",creal(s->X_T_b),cimag(s->X_T_b));
+
+	// Calculating tacking boundary points. X1 and X2 for left line, X3 and X4 right line.
+	// y1 = ( creal(X_T)*(b_x+creal(X0))+cimag(X_T)*cimag(X0) )/( creal(X_T)*a_x+cimag(X_T) );
+	s->X1 = 0 + I*( creal(s->X_T_b)*(s->b_x+creal(s->X0)) +cimag(s->X_T_b)*cimag(s->X0) )/( creal(s->X_T_b)*s->a_x+cimag(s->X_T_b) );
+	s->X1 = s->a_x*cimag(s->X1)-s->b_x + I*cimag(s->X1);
+	if (debug3) printf("X1: %f + I*%f \n",creal(s->X1),cimag(s->X1));
+
+	s->X2 = 0 + I*( creal(s->X_T_b)*(s->b_x+creal(s->X_T_b)) +cimag(s->X_T_b)*cimag(s->X_T_b) )/( creal(s->X_T_b)*s->a_x+cimag(s->X_T_b) );
+	s->X2 = s->a_x*cimag(s->X2)-s->b_x + I*cimag(s->X2);
+	if (debug3) printf("X2: %f + I*%f \n",creal(s->X2),cimag(s->X2));
+
+	s->X3 = 0 + I*( creal(s->X_T_b)*(-s->b_x+creal(s->X_T_b)) +cimag(s->X_T_b)*cimag(s->X_T_b) )/( creal(s->X_T_b)*s->a_x+cimag(s->X_T_b) );
+	s->X3 = s->a_x*cimag(s->X3)+s->b_x + I*cimag(s->X3);
+	if (debug3) printf("X3: %f + I*%f \n",creal(s->X3),cimag(s->X3));
+
+	s->X4 = 0 + I*( creal(s->X_T_b)*(-s->b_x+creal(s->X0))+   cimag(s->X_T_b)*cimag(s->X0) )/( creal(s->X_T_b)*s->a_x+cimag(s->X_T_b) );
+	s->X4 = s->a_x*cimag(s->X4)+s->b_x + I*cimag(s->X4);
+	if (debug3) printf("X4: %f + I*%f \n",creal(s->X4),cimag(s->X4));
+
+
+	// compute the next theta_d, ie at time t+1
+	// (main algorithm)
+		// Execution order:
+		// 1. Is the LOS in deadzone?
+		// 2. Is the LOS in downzone?
+		// 3. the LOS is outside the zones, go straight.
+		
+		// LOS in dead zone
+		if ( (atan2(cimag(Xr),creal(Xr))-PI/9)<=theta_LOS  &&  theta_LOS<=(atan2(cimag(Xl),creal(Xl))+PI/9) )
+		{
+			if (debug) printf("theta_d_b: %f \n",s->theta_d_b);
+			//if (debug) printf("atan2(Xl): %f \n",atan2(cimag(Xl),creal(Xl)));
+			//if (debug) printf("atan2(Xr): %f \n",atan2(cimag(Xr),creal(Xr)));
+
+			if (s->theta_d_b >= atan2(cimag(Xl),creal(Xl))-PI/36  && s->theta_d_b <= atan2(cimag(Xl),creal(Xl))+PI/36 )
+			{
+				if (creal(s->X_b) < s->a_x*cimag(s->X_b)-s->b_x) { s->theta_d1_b = atan2(cimag(Xr),creal(Xr)); if (debug) printf(">> debug 3 \n"); s->fa_debug=3; s->sig1=1;}     
+				else { s->theta_d1_b = s->theta_d_b; if (debug) printf(">> debug 4 \n"); s->fa_debug=4; s->sig1=0;}
+			} 
+			else
+			{
+				if (  (s->theta_d_b >= (atan2(cimag(Xr),creal(Xr))-(PI/36)))  &&  (s->theta_d_b <= (atan2(cimag(Xr),creal(Xr))+(PI/36))) )
+				{
+					if (creal(s->X_b) > s->a_x*cimag(s->X_b)+s->b_x) { s->theta_d1_b = atan2(cimag(Xl),creal(Xl)); if (debug) printf(">> debug 5 \n"); s->fa_debug=5; s->sig1=1;}
+					else { s->theta_d1_b = s->theta_d_b; if (debug) printf(">> debug 6 \n"); s->fa_debug=6; s->sig1=0;}
+				}
+				else
+				{
+					if(cabs(theta_l) < cabs(theta_r)) { s->theta_d1_b = atan2(cimag(Xl),creal(Xl)); if (debug) printf(">> debug 7 \n"); s->fa_debug=7; s->sig1=1;}
+					else { s->theta_d1_b = atan2(cimag(Xr),creal(Xr)); if (debug) printf(">> debug 8 \n"); s->fa_debug=8; s->sig1=1;}
+				}
+			}
+		}
+		else
+		{
+			// LOS in down zone
+			if ( atan2(cimag(Xdr),creal(Xdr)) >= theta_LOS  &&  theta_LOS >= atan2(cimag(Xdl),creal(Xdl)) )
+			{
+                                //if (debug) printf("theta_d_b: %f \n",theta_d_b);
+				//if (debug) printf("atan2 Xdl: %f \n",atan2(cimag(Xdl),creal(Xdl)));
+				//if (debug) printf("atan2 Xdr: %f \n",atan2(cimag(Xdr),creal(Xdr)));
+
+				if (s->theta_d_b >= atan2(cimag(Xdl),creal(Xdl))-PI/36  && s->theta_d_b <= atan2(cimag(Xdl),creal(Xdl))+PI/36 )
+				{
+					if (creal(s->X_b) > s->a_x*cimag(s->X_b)-s->b_x) { s->theta_d1_b = atan2(cimag(Xdr),creal(Xdr)); if (debug) printf(">> debug 13 \n"); s->fa_debug=13; s->sig1=1;}     
+					else { s->theta_d1_b = s->theta_d_b; if (debug) printf(">> debug 14 \n"); s->fa_debug=14; s->sig1=0;}
+				} 
+				else
+				{
+					if (  (s->theta_d_b >= (atan2(cimag(Xdr),creal(Xdr))-(PI/36)))  &&  (s->theta_d_b <= (atan2(cimag(Xdr),creal(Xdr))+(PI/36))) )
+					{
+						if (creal(s->X_b) < s->a_x*cimag(s->X_b)+s->b_x) { s->theta_d1_b = atan2(cimag(Xdl),creal(Xdl)); if (debug) printf(">> debug 15 \n"); s->fa_debug=15; s->sig1=1;}
+						else { s->theta_d1_b = s->theta_d_b; if (debug) printf(">> debug 16 \n"); s->fa_debug=16; s->sig1=0;}
+					}
+					else
+					{
+						if(cabs(theta_dl) < cabs(theta_dr)) { s->theta_d1_b = atan2(cimag(Xdl),creal(Xdl)); if (debug) printf(">> debug 17 \n"); s->fa_debug=17; s->sig1=1;}
+						else { s->theta_d1_b = atan2(cimag(Xdr),creal(Xdr)); if (debug) printf(">> debug 18 \n"); s->fa_debug=18; s->sig1=1;}
+						if (debug) printf("---- Downwind theta_d1_b: %f \n",s->theta_d1_b);
+					}
+				}
+			}
+			else
+			{
+				// if theta_LOS is outside of the deadzone
+				s->theta_d1_b = theta_LOS;
+				s->sig1 = 1;
+				if (debug) printf(">> debug 2 \n");
+				s->fa_debug=2;
+			}
+		}
+	//if (debug) printf("theta_LOS = %f \n",theta_LOS);
+	//if (debug) printf("X_T_b = %.1f + I*%.1f \n",creal(X_T_b),cimag(X_T_b));
+	//if (debug) printf("X_b = %.1f + I*%.1f \n",creal(X_b),cimag(X_b));
+	//if (debug) printf("Xl = %f + I*%f \n",creal(Xl),cimag(Xl));
+	//if (debug) printf("Xr = %f + I*%f \n",creal(Xr),cimag(Xr));
+	//if (debug) printf("Xdl = %f + I*%f \n",creal(Xdl),cimag(Xdl));
+	//if (debug) printf("Xdr = %f + I*%f \n",creal(Xdr),cimag(Xdr));
+}        
+
+void chooseManeuver(ControllerState * s, const ControllerInputs * in)
+{
+	// The maneuver function does the maneuvers. This function performs each/every course change. 
+	// Here it decides whether there is need for a tack, jibe or just a little course change. 
+	// This decision incorporates two steps: 1. Is the desired heading on the other side of the deadzone? 
+	// Then we need to jibe or tack. 2. Do we have enough speed for tacking? According to this it chooses sig.
+
+	// float dAngle, d1Angle;
+	float _Complex X_d_b, X_d1_b;
+
+	// Definition of X_d1_b and X_d_b
+	X_d_b = ccos(s->theta_d_b) + I*(csin(s->theta_d_b));
+	X_d1_b = ccos(s->theta_d1_b) + I*(csin(s->theta_d1_b));
+
+	if ( sign(creal(X_d_b)) == sign(creal(X_d1_b)) )
+	{ s->sig2=0; }			//course change
+	else
+	{
+		if ( cimag(X_d_b) > 0 && cimag(X_d1_b) > 0 && in->SOG > v_min )
+		{ s->sig2=0; }	//tack
+		else
+		{		//jibe
+			if ( creal(X_d_b) < 0 )
+			{ s->sig2=1; }	//left
+			else
+			{ s->sig2=2; }	//right
+		}
+	}
+	//if (debug) printf("X_d_b = %f + I*%f \n",creal(X_d_b),cimag(X_d_b));
+	//if (debug) printf("X_d1_b = %f + I*%f \n",creal(X_d1_b),cimag(X_d1_b));
+}
+
+int sign(float val){
+	if (val > 0) return 1;	// is greater then zero
+	if (val < 0) return -1;	// is less then zero
+	return 0;		// is zero
+}
+
+
+
+void performManeuver(ControllerState * s, const ControllerInputs * in)
+{
+	// float v_b1, v_b2, v_d1_b1, v_d1_b2;
+	float _Complex Xdl, Xdr;
+	s->fa_debug=7353;
+
+	//if (debug) printf("theta_b: %f\n",theta_b);
+	//if (debug) printf("theta_d1_b: %f\n",theta_d1_b);
+	if (s->sig2==1) if (debug) printf("Jibe left ... \n");
+	if (s->sig2==2) if (debug) printf("Jibe right ... \n");
+
+	// DOWNzone limit direction ***** These variables are already defined in the findAngle-function. ***
+        Xdl = -sin(theta_down)*2.8284 - I*cos(theta_down)*2.8284;
+        Xdr = sin(theta_down)*2.8284 - I*cos(theta_down)*2.8284;
+	
+	//Jibe direction -> jibe status -> defines the headings during the maneuver.
+	switch(s->sig2)
+	{
+		case 1: // Jibe left
+			switch(s->jibe_status)
+			{
+				case 1: //begin Jibe: get on course
+					s->theta_pM_b = atan2(cimag(Xdl),creal(Xdl));
+					jibe_pass_fcn(s, in);
+					break;
+				case 2: //tighten sail (hold course)
+					s->theta_pM_b = atan2(cimag(Xdl),creal(Xdl));
+					s->actIn = 1;
+					jibe_pass_fcn(s, in);
+					break;
+				case 3: //perform jibe (hold sail tight)
+					s->theta_pM_b = atan2(cimag(Xdr),creal(Xdr));
+					s->actIn = 1;
+					jibe_pass_fcn(s, in);
+					break;
+				case 4: //release sail (hold course)
+					s->theta_pM_b = atan2(cimag(Xdr),creal(Xdr));
+					s->actIn = 0;
+					jibe_pass_fcn(s, in);
+					break;
+				case 5: //find new course
+					jibe_pass_fcn(s, in);
+					break;
+			}
+			break;
+		case 2: // Jibe right
+			switch(s->jibe_status)
+			{
+				case 1: //begin Jibe: get on course
+					s->theta_pM_b = atan2(cimag(Xdr),creal(Xdr));
+					jibe_pass_fcn(s, in);
+					break;
+				case 2: //tighten sail (hold course)
+					s->theta_pM_b = atan2(cimag(Xdr),creal(Xdr));
+					s->actIn = 1;
+					jibe_pass_fcn(s, in);
+					break;
+				case 3: //perform jibe (hold sail tight)
+					s->theta_pM_b = atan2(cimag(Xdl),creal(Xdl));
+					s->actIn = 1;
+					jibe_pass_fcn(s, in);
+					break;
+				case 4: //release sail (hold course)
+					s->theta_pM_b = atan2(cimag(Xdl),creal(Xdl));
+					s->actIn = 0;
+					jibe_pass_fcn(s, in);
+					break;
+				case 5: //find new course
+					jibe_pass_fcn(s, in);
+					break;
+			}
+			break;
+	} // end switch(sig2)
+	//if (debug) printf("theta_pM_b = %f \n",theta_pM_b);
+	if (debug_jibe) printf("jibe status = %d \n",s->jibe_status);
+	if (debug_jibe) printf("actIn = %d \n",s->actIn);
+	//if (debug) printf("Xdl = %f + I*%f \n",creal(Xdl),cimag(Xdl));
+	//if (debug) printf("Xdr = %f + I*%f \n",creal(Xdr),cimag(Xdr));
+}
+
+/*	JIBE PASS FUNCTION
+ *	increase the value of 'jibe_status' when needed and define sig3.
+ */
+void 	jibe_pass_fcn(ControllerState * s, const ControllerInputs * in) {
+	float _Complex X_h, X_pM;
+
+	// defining direction unit vectors
+	X_h = -sin(s->theta_b) + I*cos(s->theta_b);
+	X_pM = -sin(s->theta_pM_b) + I*cos(s->theta_pM_b);
+
+	//if (debug5) printf("jibe_pass_fcn: Sail_Feedback: %d\n",Sail_Feedback);
+
+	if ( cos(angle_lim) < (creal(X_h)*creal(X_pM) + cimag(X_h)*cimag(X_pM)) && s->jibe_status<5) 
+	{	// When the heading approaches the desired heading and the sail is tight, the jibe is performed.
+		if ( s->actIn==0 && in->Sail_Feedback>300 ) s->jibe_status++;
+		if ( s->actIn && in->Sail_Feedback<20 ) { s->jibe_status++; }
+	}
+	
+	if ( s->jibe_status==5 ) {
+		s->sig3=0;
+		s->jibe_status=1; }
+	else { s->sig3=s->sig2; }
+	if (debug) printf("X_h = %f + I*%f \n",creal(X_h),cimag(X_h));
+	if (debug) printf("X_pM = %f + I*%f \n",creal(X_pM),cimag(X_pM));
+}
+
+
+
+
+/*
+ *	RUDDER PID CONTROLLER:
+ *
+ *	Calculate the desired RUDDER ANGLE position based on the Target Heading and Current Heading.
+ *	The result is a rounded value of the angle stored in the [Rudder_Desired_Angle] global variable.
+ *	Daniel Wrede, May 2013
+ */
+void rudder_pid_controller(ControllerState * s, const ControllerInputs * in, ControllerOutputs * out) {
+
+	const ControllerParams * p = &in->params;
+	float dHeading, pValue, temp_ang, deshead; //,integralValue;
+	
+	switch (p->heading_state)
+	{
+		case 1:
+			deshead = s->Guidance_Heading; 	// in degrees
+			break;
+		case 2:
+			deshead = s->u_headsl;		// Steering after hill climbing controller
+			break;
+		case 3:
+			deshead = s->u_head; 		// Steering after hill climbing controller
+			break;
+		case 4:
+			deshead = s->headstep;		// Using the step heading algorithm
+			break;
+		case 5:
+			deshead = p->des_heading;	// Heading straight in a direction
+			break;
+		case 6:
+			deshead = s->theta_mean_wind + p->des_app_w;
+			break;
+		case 7:
+			deshead = s->u_heel;
+			break;
+		default:
+			deshead = in->Wind_Angle;		// Into the deadzone
+			if (debug5) printf("heading_state switch case error.");
+	}
+	
+	dHeading = deshead-in->Heading;
+	deshead = acos(cos(deshead*PI/180))*180/PI;
+	if ((int)deshead != s->des_course) {		// GUI file, only rewritten when it changes
+		s->des_course = (int)deshead;
+		out->des_course = s->des_course;
+		out->updated |= CTRL_DES_COURSE;
+	}
+
+	// Singularity translation
+	dHeading = dHeading*PI/180;
+	dHeading = atan2(sin(dHeading),cos(dHeading));
+	dHeading = dHeading*180/PI;        
+
+	//if (debug) printf("dHeading: %f\n",dHeading);
+
+	//if (debug) fprintf(stdout,"targetHeafing: %f, deltaHeading: %f\n",targetHeading, dHeading);
+	//if (abs(dHeading) > dHEADING_MAX && abs(Rate) > RATEOFTURN_MAX) // Limit control statement
+	//{
+
+		// P controller
+		pValue = GAIN_P * dHeading;
+
+		// Integration part
+		// The following checks, will keep integratorSum within -0.2 and 0.2
+		// if (integratorSum < -INTEGRATOR_MAX && dHeading > 0) {
+		// 	integratorSum = dHeading + integratorSum;
+		// } else if (integratorSum > INTEGRATOR_MAX && dHeading < 0) {
+		// 	integratorSum = dHeading + integratorSum;
+		// } else {
+		// 	integratorSum = integratorSum;
+		// }
+		// integralValue = GAIN_I * integratorSum;
+
+		// result
+		temp_ang = pValue; //+ integralValue; // Angle in radians
+
+	//}
+	// fprintf(stdout,"pValue: %f, integralValue: %f\n",pValue,integralValue);
+	// fprintf(stdout,"Rudder_Desired_Angle: %d\n\n",Rudder_Desired_Angle);
+
+	s->Rudder_Desired_Angle = round(temp_ang);
+	if(s->Rudder_Desired_Angle > 35) {s->Rudder_Desired_Angle=35; }
+	if(s->Rudder_Desired_Angle < -35) {s->Rudder_Desired_Angle=-35; }
+
+	// Move rudder
+	out->rudder = s->Rudder_Desired_Angle;
+	out->updated |= CTRL_RUDDER;
+}
+
+
+
+/*
+ *	SAIL CONTROLLER (default)
+ *
+ *	Controls the angle of the sail and implements an Emergency sail release when the boat's
+ *	roll value exceeds a predefined threshold. Input to this function is [Wind_Angle]
+ *        Daniel Wrede & Mikkel Heeboell Callesen, December 2013
+ */
+void sail_controller(ControllerState * s, const ControllerInputs * in) {
+
+	float C=0, C_zero=0; 		// sheet lengths
+	float BWA=0, theta_sail=0; 	// angle of wind according to heading, desired sail angle
+
+
+	float _Complex X_h, X_w;
+
+	X_h = csin(in->Heading*PI/180) + I*(ccos(in->Heading*PI/180));
+	X_w = csin(in->Wind_Angle*PI/180) + I*(ccos(in->Wind_Angle*PI/180));
+	BWA = acos( cimag(X_h)*cimag(X_w) + creal(X_h)*creal(X_w) );
+
+	// Deriving the function for theta_sail:
+	// theta_sail(BWA) = a*BWA+b
+	// Having two points, theta_sail(theta_nogo)=0 and theta_sail(3/4*PI)=1.23
+	// a=1.23/(3/4*PI-theta_nogo) , b=-a*theta_nogo
+	// This is inserted below.
+
+	if ( BWA < theta_nogo ) { theta_sail = 0; }
+	else
+	{
+		if ( BWA < PI*3/4 ) { theta_sail = 1.23/( 3/4*PI-theta_nogo )*BWA - 1.23/(3/4*PI-theta_nogo)*theta_nogo; }
+		else
+		{
+			if ( BWA < (PI*17/18) ) { theta_sail=1.23; }
+			else { theta_sail = 0; }
+		}
+	}
+
+	C = sqrt( SCLength*SCLength + BoomLength*BoomLength -2*SCLength*BoomLength*cos(theta_sail) + SCHeight*SCHeight);
+	C_zero = sqrt( SCLength*SCLength + BoomLength*BoomLength -2*SCLength*BoomLength*cos(0) + SCHeight*SCHeight);
+
+	// Assuming the actuator to be out at ACT_MAX and in at 0:
+	//(C-C_zero)=0 -> sail tight when C=C_zero . ACT_MAX/500 is the ratio between ticks and stroke. 1000[mm]/3 is a unit change + 
+	s->Sail_Desired_Position = round( (C-C_zero)/3*ACT_MAX/strokelength ); 
+	if ( s->Sail_Desired_Position > ACT_MAX ) s->Sail_Desired_Position=ACT_MAX; 
+	if ( s->Sail_Desired_Position < 0 )   s->Sail_Desired_Position=0; 
+
+	// If the boat tilts too much
+	if(fabs(in->Roll)>ROLL_LIMIT) // we multiply by 3.26, to transform the input to degrees.
+	{ 
+                // Start Loosening the sail
+		s->desACTpos = ACT_MAX;      
+		s->roll_counter = 0;
+		// if (debug) printf("max roll reached. \n" );
+	} 
+	else
+	{
+		if(s->roll_counter<10*SEC) { s->roll_counter++; }
+	}
+
+	// if (debug) printf("sail_controller readout: SIG3 = %d \n",sig3);
+	// If it is time to jibe
+	if (s->actIn) 
+	{
+		// Start Tightening the sail
+		s->desACTpos = 0;
+	}
+	else
+	{
+		// sail tuning according to wind
+		if(s->roll_counter > 5*SEC && (fabs(s->Sail_Desired_Position-in->Sail_Feedback)>SAIL_LIMIT || s->tune_counter>10*SEC) )
+		{
+			s->desACTpos = s->Sail_Desired_Position;
+			s->tune_counter=0;
+			//if (debug2) printf("- - - Sail tuning - - -\n");
+		}
+		else
+		{
+		s->tune_counter++;
+		}
+	}
+	//if (debug2) printf("desACTpos: %d \n",desACTpos);
+	//if (debug2) printf("Sail_Feedback: %d \n",Sail_Feedback);
+}
+
+/*
+ *		Sign function finding pos or neg value
+ */
+int signfcn(float val)
+{	
+	//if (debug5) printf("sgnfcn in = %f \n", val);
+	int sgn;
+	if (val >= 0) { sgn = 1; }
+	else { sgn = -1; }
+	//if (debug5) printf("sgnfcn out = %d \n", sgn);
+	return sgn;
+}
+
+/*
+ *		Global count function, to synchronize hill climbing functions
+ *
+ */
+void countFCN(ControllerState * s, const ControllerParams * p)
+{
+	if (s->counter >= p->steptime*SEC-1) s->counter=0;
+	else s->counter++;
+	if (debug6) printf("global counter : %d \n", s->counter);
+}
+
+/*
+ *	SAIL CONTROLLER (based on hillclimbing function) [from "thesis" branch]
+ *
+ *	Actuates the sail in one direction for [SAIL_ACT_TIME] seconds
+ *	Calculate the mean velocity of the boat on a period of [SAIL_OBS_TIME] seconds
+ *	If the velocity is increasing keep moving in the same direction, otherwise change direction
+ */
+
+
+void sail_hc_controller(ControllerState * s, const ControllerInputs * in, ControllerOutputs * out) {
+
+	const ControllerParams * p = &in->params;
+	int news;
+	float dv, du;
+	int signv, signu;
+	int k_sail=5;			// stepsize in degrees //
+	k_sail = p->sail_stepsize;
+	int Heading_des = 0;
+	Heading_des = p->vLOS;
+	int m = p->steptime/2*SEC, n=0;
+	if (m > VMG_BUFFER) m = VMG_BUFFER;
+	
+// CALCULATE MEAN VELOCITY by: using a circular buffer to store the velocities
+	if (s->a_sail > m-1) s->a_sail=0;
+	if (p->sail_state == 2 && (p->heading_state == 3 || p->heading_state == 6) )
+	{
+		if (in->Simulation) s->V_vmg_sail[s->a_sail] = in->v_poly*cosf((in->Heading-Heading_des)*PI/180);
+		else s->V_vmg_sail[s->a_sail] = in->SOG*cosf((in->Heading-Heading_des)*PI/180);
+		
+		//if (debug) printf("Combined run. \n");
+	}
+	else
+	{
+		if (in->Simulation) s->V_vmg_sail[s->a_sail] = in->v_poly;
+		else s->V_vmg_sail[s->a_sail] = in->SOG;
+	}
+	s->a_sail++;
+	if (debug) printf("Velocity Made Good		vmg: %f [m/s] \n", in->v_poly*cosf((in->Heading-Heading_des)*PI/180));
+	// and taking the mean of the velocity vector
+	if (s->counter == p->steptime*SEC/2 - 1 || s->counter == 0)
+	{
+		s->v_mean_sail=0;
+		for ( n=0; n<m; n++) s->v_mean_sail = s->v_mean_sail + s->V_vmg_sail[n];
+		s->v_mean_sail = s->v_mean_sail/(m);			// mean velocity value
+		if (debug) printf("MEAN CALC	v_mean: %f [m/s] \n", s->v_mean_sail);
+	}
+	
+//  ****************************************************************************
+
+	
+// GETTING THE CORRECT CONTROL INPUT
+	if (p->sail_state == 2 && p->heading_state == 3 && s->counter == 0)
+	{	
+		s->v_sail = s->v_mean_sail;
+		
+		if (debug) printf("Update Sail. 	v_sail=%f \n", s->v_sail);
+	}
+	else{if ( p->heading_state != 3 )
+	{
+		if (in->Simulation) s->v_sail = in->v_poly;
+		else s->v_sail = in->SOG;
+
+		//if (debug) printf("Single mode SAIL. \n");
+	}}
+	
+//  ****************************************************************************
+		
+		
+// USING HILL-CLIMBING METHOD
+	if (s->counter == p->steptime*SEC/2 - 1)
+	{
+		dv = s->v_sail-s->v_old_sail;
+		//if (dv >= 0) signv=1;
+		//else signv=-1;
+		if (debug) printf("Control: 	v_sail=%f \n", s->v_sail);
+		signv = signfcn(dv);
+
+		du = s->u_sail-s->u_old_sail;
+		//if (du >= 0) signu=1;
+		//else signu=-1;
+		signu = signfcn(du);
+
+		news = signv*signu;
+		s->ctri_sail = s->v_sail;		// global variable 'control input', saved.
+		s->v_old_sail = s->v_sail;
+		s->u_old_sail = s->u_sail;
+		s->u_sail = s->u_sail + k_sail*news;
+		if (s->u_sail < 0) s->u_sail=s->u_old_sail + k_sail;
+		if (s->u_sail > 90) s->u_sail=s->u_old_sail - k_sail;
+		s->desACTpos = sail_position(s->u_sail);
+		
+		out->u_sail = s->u_sail;
+		out->updated |= CTRL_U_SAIL;
+	}
+	
+//  ****************************************************************************
+
+	
+	if (p->sail_pos != s->intern_sail_pos) {
+		s->intern_sail_pos = p->sail_pos; 	// When the input changes, all variables are updated
+		s->u_sail = p->sail_pos; 		// to the new input value. Here intern_sail_pos is used
+		s->desACTpos = sail_position(p->sail_pos);			// to track input changes.
+		}
+	
+	/*if(debug_hc && counter_sail==0) printf("---- Sail Hill Climbing ----\n");
+	if(debug_hc && counter_sail==0) printf("u_sail: %d \n",u_sail);
+	if(debug_hc && counter_sail==0) printf("Sail_Feedback: %d \n",Sail_Feedback);
+	if(debug_hc && counter_sail==0) printf("v_poly: %f \n",v_poly);
+	if(debug_hc && counter_sail==0) printf("signv: %d \n",signv);
+	if(debug_hc && counter_sail==0) printf("signu: %d \n",signu); */
+}
+
+
+
+
+/*
+ * Heading Hill Climbing COS Controller
+ *
+ * Changes the heading to reach an increased velocity
+ * in the desired direction.
+ */
+
+void heading_hc_controller(ControllerState * s, const ControllerInputs * in)
+{	
+	const ControllerParams * p = &in->params;
+	int news;
+	float dv, du, v_mean=0;
+	int signv, signu;
+	int k_head = 10;            		// angular steps in degrees
+	int Heading_des = 0;			// degrees // desired heading
+	int m = p->steptime/2*SEC, n=0;
+	if (m > VMG_BUFFER) m = VMG_BUFFER;
+	
+	k_head = p->stepsize;
+	Heading_des = p->vLOS;
+	
+// CALCULATE MEAN VELOCITY by: using a circular buffer to store the velocities
+	if (s->a_head > m-1) s->a_head=0;
+	if (in->Simulation) s->V_vmg_head[s->a_head] = in->v_poly*cosf((in->Heading-Heading_des)*PI/180);
+	else s->V_vmg_head[s->a_head] = in->SOG*cosf((in->Heading-Heading_des)*PI/180);
+	s->a_head++;
+	if (debug) printf("Velocity Made Good				vmg: %f [m/s] \n", in->v_poly*cosf((in->Heading-Heading_des)*PI/180));
+	// and taking the mean of the velocity vector
+	if (s->counter == p->steptime*SEC/2 - 1 || s->counter == 0)
+	{
+		v_mean=0;
+		for ( n=0; n<m; n++) v_mean = v_mean + s->V_vmg_head[n];
+		v_mean = v_mean/(m);			// mean velocity value
+		if (debug) printf("MEAN CALC				v_mean: %f [m/s] \n", v_mean);
+	}
+	
+//  ****************************************************************************
+
+
+	
+// GETTING THE CORRECT CONTROL INPUT
+	if (p->sail_state == 2 && p->heading_state == 3 && s->counter == p->steptime*SEC/2 - 1)
+	{	
+		s->v_head = v_mean;
+		
+		if (debug) printf("Update VMG Heading. 			v_head=%f \n", s->v_head);
+	}
+	else{if ( p->sail_state != 2 && s->counter == 0)
+	{
+		//if (debug) printf("Single mode VMG. \n");
+		s->v_head = v_mean;
+	}}
+	
+//  ****************************************************************************
+	
+// USING HILL-CLIMBING METHOD
+	if (s->counter == 0) {
+		//if (debug5) printf("2 We're alright \n");
+		dv = s->v_head-s->v_old_head;
+		if (debug) printf("Control: 				v_head=%f \n", s->v_head);
+		signv = signfcn(dv);
+
+		du = s->u_head-s->u_old_head;
+		signu = signfcn(du);
+
+		news = signv*signu;
+		s->ctri_head = s->v_head;		// global variable 'control input', saved.
+		s->v_old_head = s->v_head;
+		s->u_old_head = s->u_head;
+		s->u_head = s->u_head + k_head*news;
+	}
+
+//  ****************************************************************************
+	
+	if (s->intern_DIR_head != p->DIR_init) {
+		if (debug5) printf("DIR_init=%d, u_head=%d \n", p->DIR_init, s->u_head);
+		s->intern_DIR_head = p->DIR_init;
+		s->u_head = p->DIR_init;
+		}
+	
+	if(debug_hc && s->counter==0) printf("Heading: %f \n",in->Heading);
+	if(debug_hc && s->counter==0) printf("v_poly: %f \n",in->v_poly);
+}
+
+
+/*
+ * Heading Hill Climbing Slope Controller
+ *
+ * Changes the heading to reach a velocity slope (wrt heading)
+ * defining the upwind edge.
+ */
+
+void heading_hc_slope_controller(ControllerState * s, const ControllerInputs * in)
+{	
+	const ControllerParams * p = &in->params;
+	int news;
+	float du, v_headsl, inthesign;
+	int signu, k_headsl=10;               	// angular steps in degrees
+	
+	if (in->Simulation) v_headsl = in->v_poly;
+	else v_headsl = in->SOG;
+	k_headsl=p->stepsize;
+
+	if (s->counter == 0)
+	{ // Sequence: Calculate the value "news". Update "old" variables. Change u_headsl.
+		//if (debug5) printf("**** Printsession Start **** \n");
+		du = s->u_old_headsl-s->u_headsl;
+		//if (debug5) printf("du = %f \n", du);
+		signu = signfcn(du);
+		//if (debug5) printf("signu = %d \n", signu);
+
+				
+		inthesign = signu*(s->v_old_headsl-v_headsl)/k_headsl - p->des_slope;
+		//if (debug5) printf("des_slope: %f \n", des_slope);
+		//if (debug5) printf("Results in slope estimate: %f \n", signu*(v_old_headsl-v_headsl)/k_headsl);
+		//if (debug5) printf("inthesign: %f \n", inthesign);
+		news = signfcn(inthesign);
+		//if (debug5) printf("news = %d \n", news);
+		
+		s->ctri_headsl = v_headsl;		// global variable 'control input', saved.
+		s->v_old_headsl = v_headsl;
+		s->u_old_headsl = s->u_headsl;
+			
+		s->u_headsl = s->u_headsl + k_headsl*news;
+		
+		//if (debug5) printf("v_old_headsl = %.2f \n", v_old_headsl);
+		//if (debug5) printf("v_headsl = %.2f \n", v_headsl);
+		//if (debug5) printf("u_old_headsl = %d \n", u_old_headsl);
+		//if (debug5) printf("u_headsl = %d \n", u_headsl);
+		//if (debug5) printf("**** Printsession End **** \n");
+	}
+	//if (debug5) printf("counter_headsl = %d \n", counter_headsl);
+	if (s->intern_DIR_headsl != p->DIR_init) {
+		if (debug5) printf("DIR_init=%d, u_headsl=%d \n", p->DIR_init, s->u_headsl);
+		s->intern_DIR_headsl = p->DIR_init;
+		s->u_headsl = p->DIR_init; }
+}
+
+/*
+ *		The following algorithm uses the heeling to track the upwind course,
+ *		by assuming to sail upwind, when max heeling is reached.
+ */
+ 
+void heading_hc_heeling_controller(ControllerState * s, const ControllerInputs * in)
+{	
+	const ControllerParams * p = &in->params;
+	int signh, signu;
+	float dh, du, heeling;
+	int meantime = 5;			// [sec] Duration for mean calculation
+	int m = meantime*SEC, n=0;
+
+	if (in->Simulation) heeling = in->heel_sim;
+	else heeling = in->Roll;
+	heeling = fabs(heeling);		// ensure the value being positive always
+	
+	// Using a circular buffer to store the wind angles
+	if (s->a_heel > m-1) s->a_heel=0;
+	s->V_heeling[s->a_heel] = heeling;
+	s->a_heel++;
+	
+	// taking the mean of the heeling vector
+	heeling=0;
+	for ( n=0; n<m; n++) heeling = heeling + s->V_heeling[n];
+	heeling = heeling/m;			// mean heeling value
+	if (debug6) printf("mean heeling: %f [rad] \n", heeling);
+	
+	if (s->counter == 0)
+	{
+
+		dh = heeling - s->heel_old;
+		signh = signfcn(dh);
+		du = s->u_heel-s->u_old_heel;
+		signu = signfcn(du);
+
+		s->ctri_heel = heeling;		// global variable 'control input', saved.
+		s->heel_old = heeling;
+		s->u_old_heel = s->u_heel;
+		s->u_heel = s->u_heel + p->stepsize*signh*signu;
+		
+		if (debug6) printf("Heeling chosen heading: %d [deg] \n", s->u_heel);
+	}
+
+	if (s->intern_DIR_heel != p->DIR_init) {
+		if (debug5) printf("DIR_init=%d, u_heel=%d \n", p->DIR_init, s->u_heel);
+		s->intern_DIR_heel = p->DIR_init;
+		s->u_heel = p->DIR_init; }
+}
+
+
+/*
+ *		The stepheading function changes the heading in time steps.
+ *			Hence sireceiving well developed data for plots.
+ */
+
+void stepheading(ControllerState * s, const ControllerInputs * in)
+{	
+	const ControllerParams * p = &in->params;
+	int dirsteps=1;
+	int apparent[23]= {180, 180, 160, 140, 120, 100, 90, 80, 70, 65, 60, 55, 50, 45, 40, 35, 30, 25, 20, 15, 10, 5, 0};
+	if (p->stepDIR >= 0) dirsteps = -1;
+	else dirsteps = 1;
+
+	if (s->counter_stephead >= p->steptime*SEC) { s->counter_stephead = 0; s->steps++; if (debug6) printf("---\n Heading: %f \n v_poly = %f \n", s->headstep-s->theta_mean_wind, in->v_poly);}
+	else s->counter_stephead++;
+
+	if (s->intern_DIR_step != p->DIR_init) {
+		s->intern_DIR_step = p->DIR_init;
+		s->steps = 0; }
+		
+	if (s->steps >= 22) { s->steps=0; if (debug5) printf("Task Completed\n"); }
+	//if (debug5) printf("Counter_stephead: %d \n", counter_stephead);
+	s->headstep = s->theta_mean_wind + dirsteps*apparent[s->steps];
+}
+
+/*
+ *	Mean wind function, finding the mean wind. 
+ */
+
+void meanwind(ControllerState * s, const ControllerInputs * in, ControllerOutputs * out) {
+	int meantime = 10;			// [sec] Duration for mean wind direction
+	int m = meantime*SEC, n=0;
+	float _Complex V_WIND=0;
+
+	//for ( n=0; n<m; n++) V_angles[m-n] = V_angles[m-n-1];
+	
+	// Using a circular buffer to store the wind angles
+	if (s->a_wind > m-1) s->a_wind=0;
+	s->V_angles[s->a_wind] = in->Wind_Angle;
+	//if (debug5) printf("V_angles[%d]=%f \n", a, V_angles[a]);
+	s->a_wind++;
+	
+	// summing up a wind vector, containing all stored directions
+	for ( n=0; n<m; n++) V_WIND = V_WIND + ( sinf(s->V_angles[n]*PI/180) + I*cosf(s->V_angles[n]*PI/180) );
+	s->theta_mean_wind = round( atan2( creal(V_WIND) , cimag(V_WIND) )*180/PI );
+	//if (debug5) printf("theta_mean_wind = %f \n", theta_mean_wind);
+	
+	out->mean_wind = (int)s->theta_mean_wind;
+	out->updated |= CTRL_MEAN_WIND;
+	
+	//if (debug6) printf("theta mean wind: %f \n",theta_mean_wind);
+}
+
+/*
+ *	Duty cycle observer: move the main sail to the desired position unless the
+ *	actuator has been running too much, the command goes out in [out->sail]
+ */
+void sail_duty_cycle(ControllerState * s, const ControllerInputs * in, ControllerOutputs * out, int position) {
+	
+	// Duty cycle observer
+	int n, i, dutysum=0, m=DUTY_BUFFER; 	//dtime*SEC;
+	float mm=m;
+
+	float duty=0;
+	for (n=1; n<m; n++) s->act_history[m-n] = s->act_history[m-n-1];
+
+	if ( abs(in->Sail_Feedback-position) > ACT_PRECISION && s->actStop==0) { s->act_history[0] = 1;}
+	else { s->act_history[0] = 0;}
+	
+	for (i=0; i<m; i++) {dutysum = dutysum + s->act_history[i];}
+	duty = dutysum / mm;	
+	if (duty > MAX_DUTY_CYCLE) s->actStop=1;
+	else{if (duty <= 0.25) {   s->actStop=0; } } // When a low duty cycle % is reached, the actStop is reset.
+
+	if (s->actStop==0)
+	{
+		out->sail = position;
+		out->updated |= CTRL_SAIL;
+		if(debug2) printf("move_sail: desACTpos = %d \n", position);
+	}
+	
+
+	if (debug4) printf("Sail_Feedback - position (of the sail)= abs: %d - %d = %d \n",in->Sail_Feedback, position, in->Sail_Feedback-position);	
+	//if (debug4) printf("dutysum: %d \n",dutysum);
+	if (debug4) printf("duty: %f \n",duty);
+	if (debug4) printf("actStop: %d \n",s->actStop);
+	if (debug4) printf("** end move sail");
+
+	// "duty" for the GUI
+	out->duty = duty;
+	out->updated |= CTRL_DUTY;
+}
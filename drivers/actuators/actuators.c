@@ -19,6 +19,8 @@
  */
 
 #include "actuators.h"
+#include "../../bootstrap.h"
+#include "../../rt_mode.h"
 
 int desired_angle, desired_length = 0;
 int adc_value = 0;
@@ -62,9 +64,24 @@ void move_rudder_left(int duty_loc);
 void move_sail_left(int duty_loc);
 void move_sail_right(int duty_loc);
 
-int main() {
+int main(int argc, char ** argv) {
+	int opt;
+
+	while ((opt = getopt(argc, argv, "R:C:")) != -1) {
+		switch (opt) {
+			case 'R': rt.enabled = 1; rt.priority = atoi(optarg); break;
+			case 'C': rt.cpu = atoi(optarg); break;
+			default:
+				fprintf(stderr, "usage: %s [-R rt_priority] [-C cpu]\n", argv[0]);
+				exit(1);
+		}
+	}
+
+	boot_begin();
 	initFiles();
 	init_io();
+	boot_report("actuators");
+	rt_setup("actuators");
 	//find zero position of sail actuator.
 	move_sail_right(90); //
 		sleep_ms(20000);	//force move
@@ -197,11 +214,11 @@ int main() {
  */
 void initFiles() {
 	fprintf(stdout, "file init\n");
-	system("mkdir -p /tmp/actuators");
-	system("echo 0 > /tmp/sailboat/Rudder_Feedback");
-	system("echo 0 > /tmp/sailboat/Navigation_System_Rudder");
-	system("echo 0 > /tmp/sailboat/Sail_Feedback");
-	system("echo 0 > /tmp/sailboat/Navigation_System_Sail");
+	boot_mkdir_p("/tmp/actuators");
+	boot_write("/tmp/sailboat/Rudder_Feedback", "0", 1);
+	boot_write("/tmp/sailboat/Navigation_System_Rudder", "0", 1);
+	boot_write("/tmp/sailboat/Sail_Feedback", "0", 1);
+	boot_write("/tmp/sailboat/Navigation_System_Sail", "0", 1);
 }
 
 void init_io() {
@@ -230,18 +247,18 @@ void init_io() {
 	system("devmem2 0x480021cc h 0x10c"); //GPIO 173
 	system("devmem2 0x480021ce h 0x10c"); //GPIO 174
 	system("devmem2 0x480021d0 h 0x10c"); //GPIO 175
-	system("echo 170 > /sys/class/gpio/export");
-	system("echo 171 > /sys/class/gpio/export");
-	system("echo out > /sys/class/gpio/gpio170/direction");
-	system("echo out > /sys/class/gpio/gpio171/direction");
+	boot_write("/sys/class/gpio/export", "170", 1);
+	boot_write("/sys/class/gpio/export", "171", 1);
+	boot_write("/sys/class/gpio/gpio170/direction", "out", 1);
+	boot_write("/sys/class/gpio/gpio171/direction", "out", 1);
 	
 	//install pwm module
 	system("insmod pwm.ko");
 	//install hall module
 	system("insmod hall.ko");
 
-	system("echo 0 > /sys/class/gpio/gpio170/value");	//Disable LOW, thereby working actuator.
-	system("echo 0 > /sys/class/gpio/gpio171/value");	//Enable HIGH (inversed signal), meaning motor driver is on.
+	boot_write("/sys/class/gpio/gpio170/value", "0", 1);	//Disable LOW, thereby working actuator.
+	boot_write("/sys/class/gpio/gpio171/value", "0", 1);	//Enable HIGH (inversed signal), meaning motor driver is on.
 
 }
 
@@ -13,6 +13,7 @@
  */
 
 #include "energy.h"
+#include "../../bootstrap.h"
 
 double complete_watt = 0;						//used for storring the full system consuption
 double complete_current = 0;					//used for storring the full system current 
@@ -47,8 +48,10 @@ void write_log_file();
 
 
 int main() {
+	boot_begin();
 	initFiles();
 	init_io();
+	boot_report("energy");
 	for (;;) {
 		complete_watt = 0;
 		electronic_watt = 0;  
@@ -84,8 +87,8 @@ int main() {
  */
 void initFiles() {
 	fprintf(stdout, "file init\n");
-	system("mkdir /tmp/current_sensors");
-	system("mkdir -p sailboat-energy/");
+	boot_mkdir_p("/tmp/current_sensors");
+	boot_mkdir_p("sailboat-energy");
 }
 
 void init_io() {
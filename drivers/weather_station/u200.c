@@ -2,8 +2,10 @@
 
 Read raw binary data from an AIRMAR U200 NMEA2000 to USB converter
 (Actisense NGT-1 chip) and decode it into a readable text format.
-A set of files is created in /tmp directory for each field of the
-selected PGNs as interface for the sailboat-controller program.
+The fields of the selected PGNs are published as one snapshot in a
+shared memory segment (see sensor_shm.h) as interface for the
+sailboat-controller program. With the -f option a set of files is
+also created in /tmp directory for each field (used by the GUI).
 
 Credits for reading data from a CANbus format and decoding the
 NMEA2000 protocol from raw binary data into readable text go to
@@ -14,6 +16,8 @@ https://github.com/canboat/canboat.git
 
 
 #include "u200.h"
+#include "../../sensor_shm.h"
+#include "../../bootstrap.h"
 
 // read
 static int  debug = 0;
@@ -54,6 +58,12 @@ char tmpchar[50];
 ListItem currentList[20];
 enum Labels { Rate, Heading, Deviation, Variation, Yaw, Pitch, Roll, Latitude, Longitude, COG, SOG, Wind_Speed, Wind_Angle, TTOT };
 time_t timer_curr[TTOT], timer_last[TTOT];
+
+// shared memory snapshot
+static bool exportFiles = false;	// also write the /tmp/u200 text files
+SensorSegment * sensorSeg;
+SensorData sensorData;
+
 void initFiles();
 void removefiles();
 void addtolist();
@@ -74,6 +84,10 @@ int main(int argc, char ** argv)
 		{
 		  debug = 1;
 		}
+		else if (strcasecmp(argv[1], "-f") == 0)
+		{
+		  exportFiles = true;
+		}
 		else if (!device)
 		{
 		  device = argv[1];
@@ -134,8 +148,21 @@ int main(int argc, char ** argv)
 		timer_last[i] = timer_curr[i]-3;
 	}	
 
-	printf("-> Initializing /tmp files..\n");
-	initFiles();
+	printf("-> Initializing shared memory snapshot..\n");
+	sensorSeg = sensor_shm_open(1);
+	if (sensorSeg == NULL)
+	{
+		fprintf(stderr, "ERROR: Cannot map shared memory segment %s\n", SENSOR_SHM_NAME);
+		exit(1);
+	}
+
+	if (exportFiles)
+	{
+		printf("-> Initializing /tmp files..\n");
+		boot_begin();
+		initFiles();
+		boot_report("u200");
+	}
 
 	printf("-> U200 process is running..\n\n");
 	for (;;)
@@ -152,7 +179,7 @@ int main(int argc, char ** argv)
 	}
 
 	fprintf(stderr, "ERROR: u200 process terminated.\n");
-	removefiles();
+	if (exportFiles) removefiles();
 
 	close(handle);
 	return 0;
@@ -1223,21 +1250,21 @@ void addtolist(char name[], char value[])
  */
 void initFiles(){
 	//system("mkdir /tmp/{127251,127250,127257,129025,129026,130306}");
-	system("mkdir -p /tmp/u200");
-
-	system("[ ! -f /tmp/u200/Rate ] 		&& echo 0 > /tmp/u200/Rate");
-	system("[ ! -f /tmp/u200/Heading ] 		&& echo 0 > /tmp/u200/Heading");
-	system("[ ! -f /tmp/u200/Deviation ] 	&& echo 0 > /tmp/u200/Deviation");
-	system("[ ! -f /tmp/u200/Variation ] 	&& echo 0 > /tmp/u200/Variation");
-	system("[ ! -f /tmp/u200/Yaw ] 			&& echo 0 > /tmp/u200/Yaw");
-	system("[ ! -f /tmp/u200/Pitch ] 		&& echo 0 > /tmp/u200/Pitch");
-	system("[ ! -f /tmp/u200/Roll ] 		&& echo 0 > /tmp/u200/Roll");
-	system("[ ! -f /tmp/u200/Latitude ] 	&& echo 0 > /tmp/u200/Latitude");
-	system("[ ! -f /tmp/u200/Longitude ] 	&& echo 0 > /tmp/u200/Longitude");
-	system("[ ! -f /tmp/u200/COG ] 			&& echo 0 > /tmp/u200/COG");
-	system("[ ! -f /tmp/u200/SOG ] 			&& echo 0 > /tmp/u200/SOG");
-	system("[ ! -f /tmp/u200/Wind_Speed ] 	&& echo 0 > /tmp/u200/Wind_Speed");
-	system("[ ! -f /tmp/u200/Wind_Angle ] 	&& echo 0 > /tmp/u200/Wind_Angle");
+	boot_mkdir_p("/tmp/u200");
+
+	boot_seed("/tmp/u200/Rate", "0");
+	boot_seed("/tmp/u200/Heading", "0");
+	boot_seed("/tmp/u200/Deviation", "0");
+	boot_seed("/tmp/u200/Variation", "0");
+	boot_seed("/tmp/u200/Yaw", "0");
+	boot_seed("/tmp/u200/Pitch", "0");
+	boot_seed("/tmp/u200/Roll", "0");
+	boot_seed("/tmp/u200/Latitude", "0");
+	boot_seed("/tmp/u200/Longitude", "0");
+	boot_seed("/tmp/u200/COG", "0");
+	boot_seed("/tmp/u200/SOG", "0");
+	boot_seed("/tmp/u200/Wind_Speed", "0");
+	boot_seed("/tmp/u200/Wind_Angle", "0");
 }
 
 
@@ -1246,16 +1273,27 @@ void initFiles(){
  */
 void removefiles()
 {
-	system("rm /tmp/u200/*");
+	const char * names[] = { "Rate", "Heading", "Deviation", "Variation", "Yaw", "Pitch", "Roll",
+		"Latitude", "Longitude", "COG", "SOG", "Wind_Speed", "Wind_Angle" };
+	char path[64];
+	unsigned int n;
+
+	for (n = 0; n < sizeof(names)/sizeof(names[0]); n++) {
+		snprintf(path, sizeof(path), "/tmp/u200/%s", names[n]);
+		unlink(path);
+	}
 }
 
 
 /*
- *	Write each notnull [NAME-VALUE] entry of the current PGN to the relevant file
+ *	Store each notnull [NAME-VALUE] entry of the current PGN in the sensor snapshot
+ *	and publish it to the shared memory segment. If the file export is enabled,
+ *	write the entry to the relevant file too.
  */
 void writeondisk()
 {
 	FILE *file; 
+	bool updated = false;
 
 	//fprintf(stdout,"\n");
 
@@ -1303,6 +1341,13 @@ void writeondisk()
 			if (strcmp(currentList[i].name,"Wind_Speed") == 0) 	{ k = 11; }
 			if (strcmp(currentList[i].name,"Wind_Angle") == 0) 	{ k = 12; }
 
+			// update the snapshot (always, the file throttling below doesn't apply here)
+			sensorData.value[k] = strtod(currentList[i].value, NULL);
+			sensorData.valid |= 1 << k;
+			updated = true;
+
+			if (!exportFiles) continue;
+
 			//update timer for current entry
 			timer_curr[k] = time(NULL);
 
@@ -1330,5 +1375,11 @@ void writeondisk()
 		}
 	}
 	//fprintf(stdout,"\n");
+
+	// publish the whole snapshot at once
+	if (updated) {
+		sensorData.timestamp = (uint32_t)time(NULL);
+		sensor_shm_publish(sensorSeg, &sensorData);
+	}
 }
 
@@ -0,0 +1,197 @@
+/*
+ *	LOG CHANNELS
+ *
+ *	Registry of the variables that can be logged, and profiles choosing
+ *	which ones go to which log file, compiled once at startup into a flat
+ *	copy plan (see binlog.h, logger.h):
+ *		- LogChannel: name (column of the log files), address of a 4-byte
+ *		  variable (int, float or uint32_t as [type]), text precision and
+ *		  rate divisor: the channel is sampled every [divisor] log ticks
+ *		- LogProfile: for each stream (log file), its name, folder, a
+ *		  divisor applied to all its channels, and the channels in column
+ *		  order, "name" or "name/divisor" to override the channel rate
+ *		- logplan_compile(): resolves the names, builds the schema of each
+ *		  stream and one LogCopy per column, sorted by divisor, so the
+ *		  channels of every tick are a plain copy loop
+ *
+ *	Each log tick logplan_sample() copies the due channels into the record
+ *	of their stream, the others keep their last value, then the records of
+ *	the streams with a due channel into the snapshot handed to the logger
+ *	thread: a uint32_t mask of these streams, then the records at fixed
+ *	offsets. A stream writes a record on the ticks it has a due channel.
+ *
+ *	Adding a field to the logs: one registry line, its name in the profiles.
+ */
+
+#define LOG_PLAN_STREAMS	4
+#define LOG_PLAN_COLUMNS	64		// per stream
+#define LOG_TIME_CHANNEL	"MCU_timestamp"	// time column of the index (see log_index.h)
+
+typedef struct {
+	const char * name;
+	const void * var;
+	uint16_t type;				// LogType
+	int16_t  precision;			// decimals of the text export
+	uint16_t divisor;			// sampled every [divisor] log ticks
+} LogChannel;
+
+#define LOG_CHANNEL(name, var, type, precision, divisor)	{ #name, &(var), type, precision, divisor }
+
+typedef struct {
+	const char * name;			// schema name and file prefix, NULL: unused
+	const char * dir;			// folder of the files
+	int divisor;				// multiplies the divisors of the channels
+	const char * channels;			// "name,name/divisor,..."
+} LogStreamSpec;
+
+typedef struct {
+	const char * name;
+	LogStreamSpec stream[LOG_PLAN_STREAMS];
+} LogProfile;
+
+typedef struct {
+	const void * var;
+	uint32_t offset;			// in the record
+	uint32_t divisor;
+	uint32_t countdown;			// log ticks to the next sample
+} LogCopy;
+
+typedef struct {
+	const LogStreamSpec * spec;
+	LogSchema schema;
+	LogColumn column[LOG_PLAN_COLUMNS];
+	LogCopy copy[LOG_PLAN_COLUMNS];		// sorted by divisor
+	int every_tick;				// copies of divisor 1, first in [copy]
+	char * record;				// last values of the channels
+	uint32_t snapshot_off;			// of the record in a snapshot
+} LogStreamPlan;
+
+typedef struct {
+	const LogProfile * profile;
+	LogStreamPlan stream[LOG_PLAN_STREAMS];
+	int streams;
+	uint32_t snapshot_size;			// [bytes] mask and records
+} LogPlan;
+
+
+/*
+ *	Profile [name] of [profiles], NULL if there is none
+ */
+const LogProfile * logplan_profile(const LogProfile * profiles, int n, const char * name)
+{
+	int k;
+
+	for (k = 0; k < n; k++)
+		if (strcmp(profiles[k].name, name) == 0) return &profiles[k];
+	return NULL;
+}
+
+int logplan_copy_cmp(const void * a, const void * b)
+{
+	const LogCopy * x = (const LogCopy *)a, * y = (const LogCopy *)b;
+
+	if (x->divisor != y->divisor) return x->divisor < y->divisor ? -1 : 1;
+	return x->offset < y->offset ? -1 : 1;
+}
+
+/*
+ *	Compile [profile] against the registry [channel]. Return -1 (and print
+ *	why) if a channel is unknown or the profile is invalid.
+ */
+int logplan_compile(LogPlan * p, const LogProfile * profile, const LogChannel * channel, int channels)
+{
+	const LogStreamSpec * spec;
+	LogStreamPlan * sp;
+	char list[2048], * item, * save, * slash;
+	int s, c, n, divisor;
+
+	memset(p, 0, sizeof(LogPlan));
+	p->profile = profile;
+	p->snapshot_size = sizeof(uint32_t);
+	for (s = 0; s < LOG_PLAN_STREAMS && profile->stream[s].name != NULL; s++) {
+		spec = &profile->stream[s];
+		sp = &p->stream[s];
+		sp->spec = spec;
+		sp->schema.time_column = -1;
+		snprintf(list, sizeof(list), "%s", spec->channels);
+		n = 0;
+		for (item = strtok_r(list, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+			slash = strchr(item, '/');
+			if (slash != NULL) *slash++ = '\0';
+			for (c = 0; c < channels && strcmp(channel[c].name, item) != 0; c++);
+			if (c == channels) {
+				printf("ERROR: log profile %s: unknown channel %s.\n", profile->name, item);
+				return -1;
+			}
+			divisor = (slash != NULL ? atoi(slash) : channel[c].divisor) * (spec->divisor > 0 ? spec->divisor : 1);
+			if (n == LOG_PLAN_COLUMNS || divisor < 1) {
+				printf("ERROR: log profile %s: too many channels or invalid divisor in %s.\n", profile->name, spec->name);
+				return -1;
+			}
+			snprintf(sp->column[n].name, LOG_NAME_LEN, "%s", item);
+			sp->column[n].type = channel[c].type;
+			sp->column[n].offset = 4*n;
+			sp->column[n].precision = channel[c].precision;
+			sp->copy[n].var = channel[c].var;
+			sp->copy[n].offset = 4*n;
+			sp->copy[n].divisor = divisor;
+			sp->copy[n].countdown = 1;		// all sampled on the first tick
+			if (strcmp(item, LOG_TIME_CHANNEL) == 0 && channel[c].type == LOG_U32) sp->schema.time_column = n;
+			n++;
+		}
+		qsort(sp->copy, n, sizeof(LogCopy), logplan_copy_cmp);
+		for (sp->every_tick = 0; sp->every_tick < n && sp->copy[sp->every_tick].divisor == 1; sp->every_tick++);
+
+		sp->schema.name = spec->name;
+		sp->schema.column = sp->column;
+		sp->schema.columns = n;
+		sp->schema.record_size = 4*n;
+		sp->record = calloc(1, 4*n + 4);
+		if (sp->record == NULL) return -1;
+		sp->snapshot_off = p->snapshot_size;
+		p->snapshot_size += 4*n;
+	}
+	p->streams = s;
+	return 0;
+}
+
+/*
+ *	One log tick: sample the due channels and fill [snapshot]
+ *	(snapshot_size bytes). Return the mask of the streams to write.
+ */
+uint32_t logplan_sample(LogPlan * p, void * snapshot)
+{
+	LogStreamPlan * sp;
+	LogCopy * c;
+	uint32_t mask = 0;
+	int s, k, due;
+
+	for (s = 0; s < p->streams; s++) {
+		sp = &p->stream[s];
+		for (k = 0; k < sp->every_tick; k++) memcpy(sp->record + sp->copy[k].offset, sp->copy[k].var, 4);
+		due = sp->every_tick;
+		for (; k < sp->schema.columns; k++) {
+			c = &sp->copy[k];
+			if (--c->countdown > 0) continue;
+			c->countdown = c->divisor;
+			memcpy(sp->record + c->offset, c->var, 4);
+			due++;
+		}
+		if (due == 0) continue;
+		mask |= 1 << s;
+		memcpy((char *)snapshot + sp->snapshot_off, sp->record, sp->schema.record_size);
+	}
+	memcpy(snapshot, &mask, sizeof(mask));
+	return mask;
+}
+
+/*
+ *	Record of stream [s] in [snapshot], NULL if the stream has none this tick
+ */
+const void * logplan_record(const LogPlan * p, const void * snapshot, int s)
+{
+	uint32_t mask;
+
+	memcpy(&mask, snapshot, sizeof(mask));
+	return mask & (1 << s) ? (const char *)snapshot + p->stream[s].snapshot_off : NULL;
+}
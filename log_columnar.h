@@ -0,0 +1,185 @@
+/*
+ *	COLUMNAR LOG ARCHIVE
+ *
+ *	Offline format of the log archives for analysis (utils/logcol converts,
+ *	utils/logquery queries). One .col file per log file, read with mmap:
+ *		- ColFileHeader, then one ColColumn per column
+ *		- per block of COL_BLOCK_ROWS rows and per column, the min and max
+ *		  of the block (ColBlockStats): a scan skips the blocks a filter
+ *		  or a time window excludes without touching their data
+ *		- per column, aligned on COL_ALIGN: the dictionary of a
+ *		  COL_DICT column (<= 256 distinct integer values: modes, states,
+ *		  parameters), then the data, 1 byte code per row for COL_DICT,
+ *		  4 bytes (LogType) per row for COL_PLAIN
+ *
+ *	The column types and names are those of the log schemas (see binlog.h).
+ *	col_block() decodes the rows of one block of a column into doubles.
+ */
+
+#include <stdint.h>
+#include <sys/mman.h>
+
+#define COL_MAGIC	0x4c4f4353		// "SCOL"
+#define COL_VERSION	1
+#define COL_BLOCK_ROWS	4096
+#define COL_ALIGN	4096
+#define COL_DICT_MAX	256
+
+enum ColEncoding { COL_PLAIN, COL_DICT };
+
+typedef struct {
+	uint32_t magic, version;
+	uint64_t rows;
+	uint32_t columns;
+	uint32_t block_rows;
+	uint32_t blocks;
+	uint32_t reserved;
+	int64_t  created;			// unix time of the conversion
+	char     source[64];			// converted file (basename)
+} ColFileHeader;
+
+typedef struct {
+	char     name[LOG_NAME_LEN];
+	uint16_t type;				// LogType
+	uint16_t encoding;			// ColEncoding
+	int16_t  precision;			// decimals of the text export, -1: %f
+	uint16_t dict_size;
+	uint64_t stats_off;			// [bytes] blocks ColBlockStats
+	uint64_t dict_off;			// [COL_DICT] dict_size values of [type]
+	uint64_t data_off;
+} ColColumn;
+
+typedef struct {
+	double min, max;
+} ColBlockStats;
+
+typedef struct {
+	int fd;
+	size_t size;
+	const char * map;
+	const ColFileHeader * header;
+	const ColColumn * column;
+} ColFile;
+
+
+static inline uint64_t col_align(uint64_t off)
+{
+	return (off + COL_ALIGN - 1) / COL_ALIGN * COL_ALIGN;
+}
+
+/*
+ *	Check that the header, the columns and their data fit in the file
+ */
+int col_valid(const ColFile * f)
+{
+	const ColColumn * c;
+	uint64_t width;
+	int k;
+
+	if (f->header->magic != COL_MAGIC || f->header->version != COL_VERSION || f->header->block_rows == 0
+		|| f->header->blocks < (f->header->rows + f->header->block_rows - 1) / f->header->block_rows
+		|| sizeof(ColFileHeader) + (uint64_t)f->header->columns * sizeof(ColColumn) > f->size) return 0;
+	for (k = 0; k < (int)f->header->columns; k++) {
+		c = &f->column[k];
+		width = c->encoding == COL_DICT ? 1 : 4;
+		if (c->stats_off + (uint64_t)f->header->blocks * sizeof(ColBlockStats) > f->size
+			|| c->data_off + f->header->rows * width > f->size
+			|| (c->encoding == COL_DICT && (c->dict_size > COL_DICT_MAX || c->dict_off + (uint64_t)c->dict_size * 4 > f->size))) return 0;
+	}
+	return 1;
+}
+
+/*
+ *	Map a columnar file. Return -1 if it isn't one.
+ */
+int col_open(ColFile * f, const char * path)
+{
+	struct stat st;
+
+	memset(f, 0, sizeof(ColFile));
+	f->fd = open(path, O_RDONLY);
+	if (f->fd < 0) return -1;
+	if (fstat(f->fd, &st) < 0 || st.st_size < (off_t)sizeof(ColFileHeader)) {
+		close(f->fd);
+		return -1;
+	}
+	f->size = st.st_size;
+	f->map = mmap(NULL, f->size, PROT_READ, MAP_SHARED, f->fd, 0);
+	if (f->map == MAP_FAILED) {
+		close(f->fd);
+		return -1;
+	}
+	f->header = (const ColFileHeader *)f->map;
+	f->column = (const ColColumn *)(f->map + sizeof(ColFileHeader));
+	if (!col_valid(f)) {
+		munmap((void *)f->map, f->size);
+		close(f->fd);
+		return -1;
+	}
+	return 0;
+}
+
+void col_close(ColFile * f)
+{
+	munmap((void *)f->map, f->size);
+	close(f->fd);
+}
+
+/*
+ *	Column [name], -1 if the file has none
+ */
+int col_find(const ColFile * f, const char * name)
+{
+	int k;
+
+	for (k = 0; k < (int)f->header->columns; k++)
+		if (strncmp(f->column[k].name, name, LOG_NAME_LEN) == 0) return k;
+	return -1;
+}
+
+const ColBlockStats * col_stats(const ColFile * f, int c, uint32_t block)
+{
+	return (const ColBlockStats *)(f->map + f->column[c].stats_off) + block;
+}
+
+/*
+ *	4-byte value of [type] at [p] as a double
+ */
+static inline double col_value(int type, const char * p)
+{
+	uint32_t u;
+	int32_t  i;
+	float    v;
+
+	switch (type) {
+		case LOG_U32: memcpy(&u, p, 4); return u;
+		case LOG_I32: memcpy(&i, p, 4); return i;
+	}
+	memcpy(&v, p, 4);
+	return v;
+}
+
+/*
+ *	Decode the rows of [block] of column [c] into [out]. Return the number of rows.
+ */
+uint32_t col_block(const ColFile * f, int c, uint32_t block, double * out)
+{
+	const ColColumn * col = &f->column[c];
+	uint64_t first = (uint64_t)block * f->header->block_rows;
+	uint32_t n, k;
+	double dict[COL_DICT_MAX];
+
+	if (first >= f->header->rows) return 0;
+	n = f->header->rows - first < f->header->block_rows ? f->header->rows - first : f->header->block_rows;
+
+	if (col->encoding == COL_DICT) {
+		const uint8_t * code = (const uint8_t *)(f->map + col->data_off) + first;
+		for (k = 0; k < col->dict_size; k++) dict[k] = col_value(col->type, f->map + col->dict_off + 4*k);
+		for (k = 0; k < n; k++) out[k] = dict[code[k]];
+	}
+	else {
+		const char * p = f->map + col->data_off + first*4;
+		for (k = 0; k < n; k++) out[k] = col_value(col->type, p + 4*k);
+	}
+	return n;
+}
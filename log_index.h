@@ -0,0 +1,139 @@
+/*
+ *	LOG INDEX
+ *
+ *	Readers of the sidecar index written with each log file (see binlog.h):
+ *		- logidx_find(): binary search of the block entries by time, read
+ *		  with pread, O(log n) without loading the index
+ *		- log_reader_seek_time(): position a LogReader on the first record
+ *		  at or after a time, decoding one block at most
+ *		- logidx_latest(): the latest record written, from the index
+ *		  header, without touching the log file
+ *
+ *	The times are the [time_column] of the records (MCU_timestamp, unix
+ *	seconds) and are assumed not to go backwards within a file.
+ */
+
+typedef struct {
+	int fd;
+	LogIndexHeader header;
+	uint64_t entries;
+} LogIndex;
+
+
+/*
+ *	Open the index of the log file [log_path]. Return -1 if there is none.
+ */
+int logidx_open(LogIndex * x, const char * log_path)
+{
+	char path[256];
+	struct stat st;
+
+	snprintf(path, sizeof(path), "%s.idx", log_path);
+	x->fd = open(path, O_RDONLY);
+	if (x->fd < 0) return -1;
+	if (pread(x->fd, &x->header, sizeof(LogIndexHeader), 0) != sizeof(LogIndexHeader) || x->header.magic != LOG_INDEX_MAGIC
+		|| x->header.record_size == 0 || x->header.record_size > LOG_BLOCK - 16	// latest slot: see logidx_latest()
+		|| x->header.record_size + 16 + sizeof(LogIndexHeader) > x->header.entries_off
+		|| fstat(x->fd, &st) < 0) {
+		close(x->fd);
+		return -1;
+	}
+	x->entries = st.st_size > x->header.entries_off ? (st.st_size - x->header.entries_off) / sizeof(LogIndexEntry) : 0;
+	return 0;
+}
+
+void logidx_close(LogIndex * x)
+{
+	close(x->fd);
+}
+
+int logidx_entry(const LogIndex * x, uint64_t k, LogIndexEntry * e)
+{
+	off_t off = x->header.entries_off + (off_t)k * sizeof(LogIndexEntry);
+	return pread(x->fd, e, sizeof(LogIndexEntry), off) == sizeof(LogIndexEntry) ? 0 : -1;
+}
+
+/*
+ *	Last entry whose block starts before [time] (the first entry if [time]
+ *	is at or before the start of the file): the first record at [time] is
+ *	in that block or after it, also when several blocks start at [time].
+ *	Return -1 if the index is empty.
+ */
+int64_t logidx_find(const LogIndex * x, uint32_t time, LogIndexEntry * e)
+{
+	uint64_t lo = 0, hi = x->entries, mid;
+
+	if (x->entries == 0) return -1;
+	// invariant: entry [lo] starts before [time], or lo == 0
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		if (logidx_entry(x, mid, e) < 0) return -1;
+		if (e->time < time) lo = mid;
+		else hi = mid;
+	}
+	if (logidx_entry(x, lo, e) < 0) return -1;
+	return lo;
+}
+
+/*
+ *	Latest record written into [record] (header.record_size bytes) and its
+ *	sequence number (records written in the file) into [seq]. Return -1 if
+ *	there is none or it is being rewritten on every try.
+ */
+int logidx_latest(const LogIndex * x, void * record, uint64_t * seq)
+{
+	uint32_t size = x->header.record_size;
+	char slot[LOG_BLOCK];
+	uint64_t s1, s2;
+	int tries;
+
+	for (tries = 0; tries < 5; tries++) {
+		if (pread(x->fd, slot, size + 16, sizeof(LogIndexHeader)) != (ssize_t)(size + 16)) return -1;
+		memcpy(&s1, slot, 8);
+		memcpy(&s2, slot + 8 + size, 8);
+		if (s1 != s2) continue;
+		if (s1 == 0) return -1;
+		memcpy(record, slot + 8, size);
+		*seq = s1;
+		return 0;
+	}
+	return -1;
+}
+
+/*
+ *	Position [r] on the first record at or after [time]: index search, then
+ *	one block decoded at most. Return -1 if no record is that recent.
+ */
+int log_reader_seek_time(LogReader * r, const LogIndex * x, uint32_t time)
+{
+	LogIndexEntry e;
+	char * rec;
+	uint64_t k;
+	uint32_t t;
+	off_t off;
+	int found = -1;
+
+	if (x->header.record_size != r->header.record_size || logidx_find(x, time, &e) < 0) return log_reader_seek(r, 0);
+	if (e.record >= r->records) return -1;
+
+	// records of the block before [time] are skipped
+	off = (off_t)e.block * LOG_BLOCK;
+	if (r->header.flags & LOG_FLAG_PACKED) {
+		if (log_reader_seek_block(r, off, e.record, e.record) < 0) return -1;
+	}
+	else r->next = e.record;
+
+	rec = malloc(r->header.record_size);
+	if (rec == NULL) return -1;
+	for (k = e.record; log_reader_next(r, rec) == 0; k++) {
+		memcpy(&t, rec + x->header.time_offset, 4);
+		if (t >= time) { found = 0; break; }
+	}
+	free(rec);
+	if (found < 0) return -1;
+
+	// back on record [k]
+	if (r->header.flags & LOG_FLAG_PACKED) return log_reader_seek_block(r, off, e.record, k);
+	r->next = k;
+	return 0;
+}
@@ -0,0 +1,301 @@
+/*
+ *	LOG ROTATION
+ *
+ *	Names, opens and retires the log files of the LogWriters of a process
+ *	(see binlog.h) without ever listing the log folder on the write path:
+ *		- the file number comes from a persistent sequence counter
+ *		  [dir]/log_sequence, saved with write + rename. Only when the
+ *		  counter is missing (first start, older log folders) the folder is
+ *		  scanned once to continue after the highest logfile_NNNN
+ *		- the pointer file [dir]/current_logfile, read by the xbee scripts,
+ *		  is replaced atomically with rename(): a reader sees the old or the
+ *		  new name, never an empty or partial file
+ *		- rotation when the current files hold [max_records] records, reach
+ *		  [max_bytes] (first stream) or are [max_age_s] seconds old, each
+ *		  policy off when 0
+ *		- with [keep] > 0 a background thread deletes the older files and
+ *		  keeps those of the last [keep] rotations, the logger never waits
+ *		  for it
+ *		- at start, the files left open by the previous run (the number
+ *		  before the counter) are checked and their torn tail cut, see
+ *		  log_recover()
+ *
+ *	File names: [stream dir]/[prefix]_NNNN_YYYYmmdd_HHMM, the pointer holds
+ *	the name of the first stream.
+ */
+
+#include <dirent.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#define LOGROT_STREAMS		4
+#define LOGROT_PATH_LEN		96
+
+typedef struct {
+	LogWriter * log;
+	const char * dir;			// folder of the files
+	const char * prefix;			// file name prefix
+	char path[LOGROT_PATH_LEN];		// current file
+} LogRotateStream;
+
+typedef struct {
+	const char * dir;			// log folder (counter and pointer files)
+	LogRotateStream stream[LOGROT_STREAMS];
+	int streams;
+	uint32_t seq;				// number of the current files
+	int open;				// files open
+
+	// policy
+	uint64_t max_records;
+	uint64_t max_bytes;
+	int max_age_s;
+	int keep;				// rotations kept by the prune thread, 0: keep all
+	int64_t (*clock_ms)(void);		// time of [max_age_s], NULL: log_now_ms()
+
+	// current files
+	uint64_t records;
+	int64_t opened_ms;
+
+	// prune thread
+	pthread_t prune_thread;
+	sem_t prune_wake;
+	volatile uint32_t prune_below;		// files with a lower number are deleted
+
+	// statistics
+	uint64_t rotations, errors;
+	volatile uint64_t pruned;
+} LogRotation;
+
+
+void logrot_path(char * out, size_t len, const char * dir, const char * name)
+{
+	snprintf(out, len, "%s/%s", dir, name);
+}
+
+/*
+ *	Number of the file [name] = [prefix]_NNNN..., -1 if it isn't one
+ */
+long logrot_file_seq(const char * name, const char * prefix)
+{
+	size_t n = strlen(prefix);
+	char * end;
+	long seq;
+
+	if (strncmp(name, prefix, n) != 0 || name[n] != '_') return -1;
+	seq = strtol(name + n + 1, &end, 10);
+	if (end == name + n + 1 || *end != '_') return -1;
+	return seq;
+}
+
+/*
+ *	Replace [path] with [text] atomically (temporary file and rename). Return -1 on error.
+ */
+int logrot_replace(const char * path, const char * text)
+{
+	char tmp[LOGROT_PATH_LEN + 8];
+	size_t len = strlen(text);
+	int fd;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) return -1;
+	if (write(fd, text, len) != (ssize_t)len) {
+		close(fd);
+		unlink(tmp);
+		return -1;
+	}
+	close(fd);
+	return rename(tmp, path);
+}
+
+/*
+ *	Next free number after the files of the first stream, for a folder
+ *	without a counter (run once)
+ */
+uint32_t logrot_scan_seq(const LogRotation * r)
+{
+	DIR * dirp = opendir(r->stream[0].dir);
+	struct dirent * entry;
+	long seq, next = 0;
+
+	if (dirp == NULL) return 0;
+	while ((entry = readdir(dirp)) != NULL) {
+		seq = logrot_file_seq(entry->d_name, r->stream[0].prefix);
+		if (seq >= next) next = seq + 1;
+	}
+	closedir(dirp);
+	return next;
+}
+
+/*
+ *	Recover the files numbered [seq] of every stream, the last ones of the
+ *	previous run, which may have been cut by a power loss
+ */
+void logrot_recover(LogRotation * r, uint32_t seq)
+{
+	char path[LOGROT_PATH_LEN + 260];
+	struct dirent * entry;
+	LogRecovery rec;
+	size_t len;
+	DIR * dirp;
+	int k;
+
+	for (k = 0; k < r->streams; k++) {
+		dirp = opendir(r->stream[k].dir);
+		if (dirp == NULL) continue;
+		while ((entry = readdir(dirp)) != NULL) {
+			len = strlen(entry->d_name);
+			if (logrot_file_seq(entry->d_name, r->stream[k].prefix) != (long)seq
+				|| (len > 4 && strcmp(entry->d_name + len - 4, ".idx") == 0)) continue;
+			snprintf(path, sizeof(path), "%s/%s", r->stream[k].dir, entry->d_name);
+			if (log_recover(path, &rec) == 1)
+				printf("WARNING: %s was not closed, %lld bytes of torn tail removed, %llu records kept.\n", path,
+					(long long)rec.removed, (unsigned long long)rec.records);
+		}
+		closedir(dirp);
+		fflush(stdout);
+	}
+}
+
+/*
+ *	PRUNE THREAD: delete the files numbered below [prune_below], woken after
+ *	each rotation. Scanning the folders here costs the logger nothing.
+ */
+void * logrot_prune_thread(void * arg)
+{
+	LogRotation * r = (LogRotation *)arg;
+	char path[LOGROT_PATH_LEN + 260];		// folder and d_name
+	struct dirent * entry;
+	DIR * dirp;
+	long seq;
+	int k;
+
+	for (;;) {
+		while (sem_wait(&r->prune_wake) < 0 && errno == EINTR);
+		for (k = 0; k < r->streams; k++) {
+			dirp = opendir(r->stream[k].dir);
+			if (dirp == NULL) continue;
+			while ((entry = readdir(dirp)) != NULL) {
+				seq = logrot_file_seq(entry->d_name, r->stream[k].prefix);
+				if (seq < 0 || seq >= (long)r->prune_below) continue;
+				snprintf(path, sizeof(path), "%s/%s", r->stream[k].dir, entry->d_name);
+				if (unlink(path) == 0) r->pruned++;
+			}
+			closedir(dirp);
+		}
+	}
+	return NULL;
+}
+
+/*
+ *	Set up the rotation of the log folder [dir]: read the sequence counter,
+ *	recover the last files and start the prune thread if [keep] > 0. The streams and the policy are
+ *	set before. Return -1 on error.
+ */
+int logrot_init(LogRotation * r, const char * dir)
+{
+	char path[LOGROT_PATH_LEN], text[16];
+	ssize_t n;
+	int fd;
+
+	r->dir = dir;
+	r->open = 0;
+	logrot_path(path, sizeof(path), dir, "log_sequence");
+	fd = open(path, O_RDONLY);
+	n = fd < 0 ? -1 : read(fd, text, sizeof(text)-1);
+	if (fd >= 0) close(fd);
+	if (n > 0) {
+		text[n] = '\0';
+		r->seq = strtoul(text, NULL, 10);
+	}
+	else r->seq = logrot_scan_seq(r);
+	if (r->seq > 0) logrot_recover(r, r->seq - 1);
+
+	if (r->keep > 0) {
+		if (sem_init(&r->prune_wake, 0, 0) < 0) return -1;
+		if (pthread_create(&r->prune_thread, NULL, logrot_prune_thread, r) != 0) return -1;
+		pthread_detach(r->prune_thread);
+	}
+	return 0;
+}
+
+void logrot_add(LogRotation * r, LogWriter * log, const char * dir, const char * prefix)
+{
+	LogRotateStream * s = &r->stream[r->streams++];
+	s->log = log;
+	s->dir = dir;
+	s->prefix = prefix;
+	s->path[0] = '\0';
+}
+
+/*
+ *	Close the current files and open the next ones. Return the number of
+ *	files that could not be created.
+ */
+int logrot_rotate(LogRotation * r)
+{
+	char path[LOGROT_PATH_LEN], text[16], timestp[25];
+	const char * name;
+	time_t rawtime;
+	struct tm tm;
+	int k, failed = 0;
+
+	if (r->open) r->seq++;
+	time(&rawtime);
+	localtime_r(&rawtime, &tm);
+	strftime(timestp, sizeof timestp, "%Y%m%d_%H%M", &tm);
+
+	// the counter first: a crash after this point never reuses a number
+	snprintf(text, sizeof(text), "%u", r->seq + 1);
+	logrot_path(path, sizeof(path), r->dir, "log_sequence");
+	if (logrot_replace(path, text) < 0) r->errors++;
+
+	for (k = 0; k < r->streams; k++) {
+		LogRotateStream * s = &r->stream[k];
+		snprintf(s->path, LOGROT_PATH_LEN, "%s/%s_%.4u_%s", s->dir, s->prefix, r->seq, timestp);
+		if (log_open(s->log, s->path) < 0) {
+			printf("WARNING: Cannot create the log file %s.\n", s->path);
+			failed++;
+		}
+	}
+
+	// pointer to the new main file, relative to the log folder
+	name = r->stream[0].path + strlen(r->stream[0].dir) + 1;
+	logrot_path(path, sizeof(path), r->dir, "current_logfile");
+	if (logrot_replace(path, name) < 0) r->errors++;
+
+	r->open = 1;
+	r->records = 0;
+	r->opened_ms = r->clock_ms ? r->clock_ms() : log_now_ms();
+	r->rotations++;
+	r->errors += failed;
+
+	if (r->keep > 0 && r->seq >= (uint32_t)r->keep) {
+		r->prune_below = r->seq - r->keep + 1;
+		sem_post(&r->prune_wake);
+	}
+	return failed;
+}
+
+/*
+ *	True when the current files must be closed before the next record
+ */
+int logrot_due(const LogRotation * r)
+{
+	const LogWriter * w = r->stream[0].log;
+
+	if (!r->open) return 1;
+	if (r->max_records > 0 && r->records >= r->max_records) return 1;
+	if (r->max_bytes > 0 && (uint64_t)w->file_off + w->fill >= r->max_bytes) return 1;
+	if (r->max_age_s > 0 && (r->clock_ms ? r->clock_ms() : log_now_ms()) - r->opened_ms >= (int64_t)r->max_age_s * 1000) return 1;
+	return 0;
+}
+
+/*
+ *	Rotate if a policy asks for it, then count one record
+ */
+void logrot_record(LogRotation * r)
+{
+	if (logrot_due(r)) logrot_rotate(r);
+	r->records++;
+}
@@ -0,0 +1,142 @@
+/*
+ *	LOGGER
+ *
+ *	Background thread of the log files. The control thread hands it raw
+ *	state snapshots through an SPSC ring and returns at once: building the
+ *	records, rotating the files, buffering, disk writes and fdatasync all
+ *	run in the logger thread (see binlog.h).
+ *
+ *	The producer side never blocks: when the disk cannot keep up the ring
+ *	fills and new snapshots are dropped and counted in [ring.dropped]. The
+ *	logger thread reports new drops once per LOGGER_IDLE_MS.
+ *
+ *	[write] is called in the logger thread with each snapshot, in order.
+ *	The LogWriters given in [log] are polled when the logger is idle, so a
+ *	buffered record reaches the disk within their [flush_ms]. The idle wait
+ *	is shortened to a quarter of their [max_loss_ms] to keep that bound.
+ */
+
+#include <pthread.h>
+#include <semaphore.h>
+
+#define LOGGER_CAPACITY		256		// snapshots
+#define LOGGER_STREAMS		4
+#define LOGGER_IDLE_MS		500
+
+typedef void (*logger_function)(const void * snapshot);
+
+typedef struct {
+	SpscRing ring;
+	sem_t wake;
+	pthread_t thread;
+	const char * name;
+	logger_function write;			// logger thread
+	LogWriter * log[LOGGER_STREAMS];	// polled by the logger thread
+	volatile uint64_t written;		// snapshots handed to [write]
+	uint64_t dropped_seen;			// drops already reported (logger thread)
+	uint32_t lag_max;			// most snapshots queued when one was taken
+} Logger;
+
+
+/*
+ *	[ms] between two polls of the writers when no snapshot comes
+ */
+int logger_idle_ms(const Logger * l)
+{
+	int k, ms = LOGGER_IDLE_MS;
+
+	for (k = 0; k < LOGGER_STREAMS; k++)
+		if (l->log[k] != NULL && l->log[k]->max_loss_ms > 0 && l->log[k]->max_loss_ms / 4 < ms) ms = l->log[k]->max_loss_ms / 4;
+	return ms > 0 ? ms : 1;
+}
+
+void * logger_thread(void * arg)
+{
+	Logger * l = (Logger *)arg;
+	struct timespec t;
+	void * s;
+	uint64_t dropped;
+	uint32_t n;
+	int k;
+
+	prof_tid = 3;
+	for (;;) {
+		clock_gettime(CLOCK_REALTIME, &t);
+		t.tv_nsec += logger_idle_ms(l) * 1000000L;
+		t.tv_sec += t.tv_nsec / 1000000000L;
+		t.tv_nsec %= 1000000000L;
+		sem_timedwait(&l->wake, &t);
+		while ((s = spsc_peek(&l->ring)) != NULL) {
+			n = spsc_count(&l->ring);
+			if (n > l->lag_max) l->lag_max = n;
+			PROF_CALL(PROF_LOGGER, l->write(s));
+			spsc_release(&l->ring);
+			l->written++;
+		}
+		for (k = 0; k < LOGGER_STREAMS; k++)
+			if (l->log[k] != NULL) log_poll(l->log[k]);
+
+		dropped = l->ring.dropped;
+		if (dropped != l->dropped_seen) {
+			printf("WARNING: %s: %llu snapshots dropped, the disk cannot keep up (%llu in total).\n", l->name,
+				(unsigned long long)(dropped - l->dropped_seen), (unsigned long long)dropped);
+			fflush(stdout);
+			l->dropped_seen = dropped;
+		}
+	}
+	return NULL;
+}
+
+/*
+ *	Allocate the ring for snapshots of [size] bytes and start the logger
+ *	thread with [attr] (NULL for the default attributes). Set [log] before
+ *	the first snapshot. Return -1 on error.
+ */
+int logger_init(Logger * l, const char * name, uint32_t size, logger_function write, const pthread_attr_t * attr)
+{
+	memset(l, 0, sizeof(Logger));
+	l->name = name;
+	l->write = write;
+	if (spsc_init(&l->ring, size, LOGGER_CAPACITY) < 0) return -1;
+	if (sem_init(&l->wake, 0, 0) < 0) return -1;
+	if (pthread_create(&l->thread, attr, logger_thread, l) != 0) return -1;
+	return 0;
+}
+
+/*
+ *	Next snapshot to fill in place, NULL if the ring is full (the snapshot
+ *	is counted as dropped). Handed to the logger by logger_commit().
+ */
+void * logger_snapshot(Logger * l)
+{
+	return spsc_reserve(&l->ring);
+}
+
+void logger_commit(Logger * l)
+{
+	spsc_commit(&l->ring);
+	sem_post(&l->wake);
+}
+
+void logger_report(const Logger * l, FILE * out)
+{
+	int k;
+	uint64_t records = 0, writes = 0, syncs = 0, errors = 0, overruns = 0;
+	int64_t loss_max = 0;
+
+	for (k = 0; k < LOGGER_STREAMS; k++) {
+		if (l->log[k] == NULL) continue;
+		records += l->log[k]->records;
+		writes += l->log[k]->writes;
+		syncs += l->log[k]->syncs;
+		errors += l->log[k]->errors;
+		overruns += l->log[k]->loss_overruns;
+		if (l->log[k]->loss_max_ms > loss_max) loss_max = l->log[k]->loss_max_ms;
+	}
+	spsc_report(&l->ring, l->name, out);
+	fprintf(out, "%-10s snapshots %llu, max lag %u, records %llu, block writes %llu, syncs %llu, write errors %llu\n", l->name,
+		(unsigned long long)l->written, l->lag_max, (unsigned long long)records, (unsigned long long)writes,
+		(unsigned long long)syncs, (unsigned long long)errors);
+	fprintf(out, "%-10s loss window: oldest unsynced record %lld ms at most, %llu syncs over the bound\n", l->name,
+		(long long)loss_max, (unsigned long long)overruns);
+}
@@ -0,0 +1,208 @@
+/*
+ *	LOOP TIMER
+ *
+ *	Absolute-deadline scheduler for the main loop, based on timerfd and epoll.
+ *	The kernel timer fires on a fixed grid (start + n*period), so the period
+ *	doesn't drift by the time spent in the loop body. When the body takes
+ *	longer than a period, the missed deadlines are counted as overruns and the
+ *	loop goes on with the next one.
+ *
+ *	For every tick the start jitter (wake-up time - deadline) and the execution
+ *	time of the body are recorded in log2 histograms of microseconds.
+ *
+ *	Other file descriptors can be watched through the same epoll instance
+ *	with looptimer_add_fd(), their callbacks run while waiting for the tick.
+ */
+
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include <sys/epoll.h>
+
+#define LOOP_HIST_BINS	16		// bin n counts values in [2^(n-1), 2^n) microseconds, bin 0 is < 1 us
+#define LOOP_MAX_FDS	8		// extra file descriptors watched by the loop
+
+typedef void (*loop_fd_callback)(int fd, void * arg);
+
+typedef struct {
+	int  fd;
+	loop_fd_callback callback;
+	void * arg;
+} LoopFd;
+
+typedef struct {
+	int  tfd, epfd;
+	long period_ns;
+	struct timespec deadline;	// deadline of the current tick (start time before the first one)
+	struct timespec woke;		// time the current tick started
+	uint64_t ticks;			// ticks executed
+	uint64_t overruns;		// deadlines missed because the previous tick was too long
+	long jitter_max_us, exec_max_us;
+	uint64_t jitter_sum_us, exec_sum_us;
+	uint32_t jitter_hist[LOOP_HIST_BINS];
+	uint32_t exec_hist[LOOP_HIST_BINS];
+	int  nfds;
+	LoopFd fds[LOOP_MAX_FDS];
+} LoopTimer;
+
+
+/*
+ *	Difference a-b in microseconds
+ */
+long timespec_diff_us(const struct timespec * a, const struct timespec * b)
+{
+	return (a->tv_sec - b->tv_sec)*1000000L + (a->tv_nsec - b->tv_nsec)/1000;
+}
+
+void timespec_add_ns(struct timespec * t, long ns)
+{
+	t->tv_nsec += ns;
+	while (t->tv_nsec >= 1000000000L) { t->tv_nsec -= 1000000000L; t->tv_sec++; }
+}
+
+int loop_hist_bin(long us)
+{
+	int n = 0;
+	while (us > 0 && n < LOOP_HIST_BINS-1) { us >>= 1; n++; }
+	return n;
+}
+
+/*
+ *	Create the timer and arm it with the first deadline one period from now.
+ *	Return -1 on error.
+ */
+int looptimer_init(LoopTimer * t, long period_ns)
+{
+	struct itimerspec its;
+	struct epoll_event ev;
+
+	memset(t, 0, sizeof(LoopTimer));
+	t->period_ns = period_ns;
+
+	t->tfd = timerfd_create(CLOCK_MONOTONIC, 0);
+	if (t->tfd < 0) return -1;
+	t->epfd = epoll_create(LOOP_MAX_FDS+1);
+	if (t->epfd < 0) { close(t->tfd); return -1; }
+
+	ev.events = EPOLLIN;
+	ev.data.fd = t->tfd;
+	if (epoll_ctl(t->epfd, EPOLL_CTL_ADD, t->tfd, &ev) < 0) return -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t->deadline);
+	its.it_value = t->deadline;
+	timespec_add_ns(&its.it_value, period_ns);
+	its.it_interval.tv_sec  = period_ns / 1000000000L;
+	its.it_interval.tv_nsec = period_ns % 1000000000L;
+	if (timerfd_settime(t->tfd, TFD_TIMER_ABSTIME, &its, NULL) < 0) return -1;
+
+	return 0;
+}
+
+/*
+ *	Watch another file descriptor, [callback] is called when it is readable
+ */
+int looptimer_add_fd(LoopTimer * t, int fd, loop_fd_callback callback, void * arg)
+{
+	struct epoll_event ev;
+
+	if (t->nfds >= LOOP_MAX_FDS) return -1;
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	if (epoll_ctl(t->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) return -1;
+
+	t->fds[t->nfds].fd = fd;
+	t->fds[t->nfds].callback = callback;
+	t->fds[t->nfds].arg = arg;
+	t->nfds++;
+	return 0;
+}
+
+void looptimer_remove_fd(LoopTimer * t, int fd)
+{
+	int n;
+
+	epoll_ctl(t->epfd, EPOLL_CTL_DEL, fd, NULL);
+	for (n = 0; n < t->nfds; n++) {
+		if (t->fds[n].fd != fd) continue;
+		t->fds[n] = t->fds[--t->nfds];
+		return;
+	}
+}
+
+/*
+ *	Block until the next deadline, serving the other file descriptors meanwhile.
+ *	Return the number of deadlines elapsed (1 when the loop is on time).
+ */
+int looptimer_wait(LoopTimer * t)
+{
+	struct epoll_event ev[LOOP_MAX_FDS+1];
+	uint64_t expirations = 0;
+	long jitter;
+	int  n, i, k;
+
+	while (expirations == 0) {
+		n = epoll_wait(t->epfd, ev, LOOP_MAX_FDS+1, -1);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		for (i = 0; i < n; i++) {
+			if (ev[i].data.fd == t->tfd) {
+				if (read(t->tfd, &expirations, sizeof(expirations)) != sizeof(expirations)) expirations = 0;
+				continue;
+			}
+			for (k = 0; k < t->nfds; k++)
+				if (t->fds[k].fd == ev[i].data.fd) t->fds[k].callback(t->fds[k].fd, t->fds[k].arg);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t->woke);
+
+	// the current deadline is the last one that expired
+	for (k = 0; k < (int)expirations; k++) timespec_add_ns(&t->deadline, t->period_ns);
+	t->overruns += expirations-1;
+	t->ticks++;
+
+	jitter = timespec_diff_us(&t->woke, &t->deadline);
+	if (jitter < 0) jitter = 0;
+	if (jitter > t->jitter_max_us) t->jitter_max_us = jitter;
+	t->jitter_sum_us += jitter;
+	t->jitter_hist[loop_hist_bin(jitter)]++;
+
+	return (int)expirations;
+}
+
+/*
+ *	Mark the end of the loop body, record its execution time
+ */
+void looptimer_done(LoopTimer * t)
+{
+	struct timespec now;
+	long exec;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	exec = timespec_diff_us(&now, &t->woke);
+	if (exec > t->exec_max_us) t->exec_max_us = exec;
+	t->exec_sum_us += exec;
+	t->exec_hist[loop_hist_bin(exec)]++;
+}
+
+/*
+ *	Print the deadline statistics and histograms
+ */
+void looptimer_report(LoopTimer * t, FILE * out)
+{
+	int n;
+	uint64_t ticks = t->ticks ? t->ticks : 1;
+
+	fprintf(out, "---- main loop: period %ld us ----\n", t->period_ns/1000);
+	fprintf(out, "ticks: %llu  overruns: %llu\n", (unsigned long long)t->ticks, (unsigned long long)t->overruns);
+	fprintf(out, "jitter    mean: %llu us  max: %ld us\n", (unsigned long long)(t->jitter_sum_us/ticks), t->jitter_max_us);
+	fprintf(out, "execution mean: %llu us  max: %ld us\n", (unsigned long long)(t->exec_sum_us/ticks), t->exec_max_us);
+	fprintf(out, "%12s %10s %10s\n", "< us", "jitter", "execution");
+	for (n = 0; n < LOOP_HIST_BINS; n++) {
+		if (t->jitter_hist[n] == 0 && t->exec_hist[n] == 0) continue;
+		fprintf(out, "%12ld %10u %10u\n", 1L << n, t->jitter_hist[n], t->exec_hist[n]);
+	}
+	fflush(out);
+}
@@ -0,0 +1,149 @@
+/*
+ *	OUTPUT QUEUE
+ *
+ *	All the file writes of the control thread (actuator commands, GUI files)
+ *	are formatted into records of an SPSC ring and performed by a
+ *	dedicated output thread, so a slow write on the SD card or on /tmp never
+ *	stalls the control computation.
+ *
+ *	Records are applied in order:
+ *		- [OUT_WRITE]  replace the content of a file (as fopen "w")
+ *		- [OUT_CALL]   run a function in the output thread
+ *
+ *	Every write call returns the sequence number of its record (0 if the ring
+ *	was full and the record dropped, counted in [ring.dropped]: the caller
+ *	decides whether to send it again, as controller.c does for the actuator
+ *	commands). [done] is the sequence number of the
+ *	last record applied: a reader that samples [done] before reading a file
+ *	knows whether it can see a given write (see output_seen()).
+ *
+ *	A headless run (see controller.c -H) has no output thread: the records
+ *	are counted in [skipped] and never applied, the writes return 0.
+ *
+ *	The log files have a thread of their own (see logger.h): a slow log
+ *	write never delays the actuator commands.
+ */
+
+#include <stdarg.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#define OUTPUT_CAPACITY		256		// records
+#define OUTPUT_PATH_LEN		64
+#define OUTPUT_DATA_LEN		1000
+
+enum OutputKind { OUT_WRITE, OUT_CALL };
+
+typedef void (*output_function)(void);
+
+typedef struct {
+	int  kind;
+	output_function call;		// [OUT_CALL]
+	char path[OUTPUT_PATH_LEN];	// [OUT_WRITE]
+	char data[OUTPUT_DATA_LEN];
+} OutputRecord;
+
+typedef struct {
+	SpscRing ring;
+	sem_t wake;
+	pthread_t thread;
+	uint32_t seq;				// last sequence number given (producer)
+	volatile uint32_t done;			// last sequence number applied (output thread)
+	uint64_t errors;			// files that could not be written
+	int  headless;				// no output thread, records skipped
+	uint64_t skipped;
+} OutputQueue;
+
+
+void output_apply(OutputQueue * q, const OutputRecord * r)
+{
+	FILE * f;
+
+	switch (r->kind) {
+		case OUT_WRITE:
+			f = fopen(r->path, "w");
+			if (f == NULL) { q->errors++; return; }
+			fputs(r->data, f);
+			fclose(f);
+			break;
+		case OUT_CALL:
+			r->call();
+			break;
+	}
+}
+
+void * output_thread(void * arg)
+{
+	OutputQueue * q = (OutputQueue *)arg;
+	OutputRecord * r;
+
+	prof_tid = 2;
+	for (;;) {
+		while (sem_wait(&q->wake) < 0 && errno == EINTR);
+		while ((r = spsc_peek(&q->ring)) != NULL) {
+			PROF_CALL(PROF_OUTPUT, output_apply(q, r));
+			spsc_release(&q->ring);
+			q->done++;
+		}
+	}
+	return NULL;
+}
+
+/*
+ *	Allocate the ring and start the output thread with [attr] (NULL for the
+ *	default attributes). Return -1 on error.
+ */
+int output_init(OutputQueue * q, const pthread_attr_t * attr)
+{
+	memset(q, 0, sizeof(OutputQueue));
+	if (spsc_init(&q->ring, sizeof(OutputRecord), OUTPUT_CAPACITY) < 0) return -1;
+	if (sem_init(&q->wake, 0, 0) < 0) return -1;
+	if (pthread_create(&q->thread, attr, output_thread, q) != 0) return -1;
+	return 0;
+}
+
+/*
+ *	True if the record [seq] had been applied when [done] was sampled
+ */
+static inline int output_seen(uint32_t done, uint32_t seq)
+{
+	return (int32_t)(done - seq) >= 0;
+}
+
+uint32_t output_commit(OutputQueue * q)
+{
+	spsc_commit(&q->ring);
+	sem_post(&q->wake);
+	return ++q->seq;
+}
+
+/*
+ *	Replace the content of [path] with the formatted string
+ */
+uint32_t output_write(OutputQueue * q, const char * path, const char * fmt, ...)
+{
+	OutputRecord * r;
+	va_list ap;
+
+	if (q->headless) { q->skipped++; return 0; }
+	r = spsc_reserve(&q->ring);
+	if (r == NULL) return 0;
+	r->kind = OUT_WRITE;
+	snprintf(r->path, OUTPUT_PATH_LEN, "%s", path);
+	va_start(ap, fmt);
+	vsnprintf(r->data, OUTPUT_DATA_LEN, fmt, ap);
+	va_end(ap);
+	return output_commit(q);
+}
+
+uint32_t output_call(OutputQueue * q, output_function call)
+{
+	OutputRecord * r;
+
+	if (q->headless) { q->skipped++; return 0; }
+	r = spsc_reserve(&q->ring);
+	if (r == NULL) return 0;
+	r->kind = OUT_CALL;
+	r->call = call;
+	return output_commit(q);
+}
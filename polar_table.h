@@ -0,0 +1,181 @@
+/*
+ *	POLAR TABLE
+ *
+ *	Boat speed and heeling as a function of the wind angle (TWA, degrees
+ *	off the bow, 0..180) and the wind speed (TWS, m/s), on a regular grid,
+ *	bilinear interpolation between the nodes. Outside the grid the nearest
+ *	edge value is used.
+ *
+ *	File (polar_save/polar_load, utils/polar_tool), native endianness:
+ *		PolarFileHeader, then the speed grid and the heel grid as floats,
+ *		[n_tws] values per TWA row
+ *
+ *	The default table of the simulation is generated from the polynomials
+ *	of the boat model (see sim_polar_default() in boat_sim.h).
+ *	polar_lookup_batch() evaluates many points at once without branches, so
+ *	the compiler can vectorize it; polar_best_vmg() gives the angle of the
+ *	best upwind or downwind VMG (warm start of the hill climbing).
+ */
+
+#include <stdint.h>
+
+#define POLAR_MAGIC	0x524C4F50	// "POLR"
+#define POLAR_VERSION	1
+#define POLAR_MAX_NODES	(1 << 20)	// per grid, sanity limit of the files
+
+typedef struct {
+	uint32_t magic, version;
+	uint32_t n_twa, n_tws;		// nodes, at least 2 each
+	float twa0, twa_step;		// [degrees]
+	float tws0, tws_step;		// [m/s]
+	uint32_t reserved[4];
+} PolarFileHeader;
+
+typedef struct {
+	int   n_twa, n_tws;
+	float twa0, twa_step, tws0, tws_step;
+	float twa_inv, tws_inv;		// 1/step
+	float * speed;			// [m/s] [twa * n_tws + tws]
+	float * heel;
+} PolarTable;
+
+
+void polar_free(PolarTable * t)
+{
+	free(t->speed);
+	free(t->heel);
+	memset(t, 0, sizeof(PolarTable));
+}
+
+/*
+ *	Allocate the grids of [n_twa] x [n_tws] nodes. Return -1 on error.
+ */
+int polar_alloc(PolarTable * t, int n_twa, float twa0, float twa_step, int n_tws, float tws0, float tws_step)
+{
+	memset(t, 0, sizeof(PolarTable));
+	// nodes counted without overflow; finite origins, steps and 1/steps (a NaN would become a grid index)
+	if (n_twa < 2 || n_tws < 2 || n_tws > POLAR_MAX_NODES / n_twa
+		|| !isfinite(twa0) || !isfinite(twa_step) || twa_step <= 0 || !isfinite(1 / twa_step)
+		|| !isfinite(tws0) || !isfinite(tws_step) || tws_step <= 0 || !isfinite(1 / tws_step)) return -1;
+	t->n_twa = n_twa;
+	t->n_tws = n_tws;
+	t->twa0 = twa0;
+	t->twa_step = twa_step;
+	t->tws0 = tws0;
+	t->tws_step = tws_step;
+	t->twa_inv = 1 / twa_step;
+	t->tws_inv = 1 / tws_step;
+	t->speed = calloc(n_twa * n_tws, sizeof(float));
+	t->heel = calloc(n_twa * n_tws, sizeof(float));
+	if (t->speed == NULL || t->heel == NULL) {
+		polar_free(t);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ *	Load the table of [path]. Return -1 (nothing allocated) on error.
+ */
+int polar_load(PolarTable * t, const char * path)
+{
+	PolarFileHeader h;
+	FILE * f = fopen(path, "rb");
+	size_t n;
+	int err;
+
+	if (f == NULL) return -1;
+	err = fread(&h, sizeof(h), 1, f) != 1 || h.magic != POLAR_MAGIC || h.version != POLAR_VERSION
+		|| polar_alloc(t, h.n_twa, h.twa0, h.twa_step, h.n_tws, h.tws0, h.tws_step) < 0;
+	if (!err) {
+		n = (size_t)t->n_twa * t->n_tws;
+		if (fread(t->speed, sizeof(float), n, f) != n || fread(t->heel, sizeof(float), n, f) != n) {
+			polar_free(t);
+			err = 1;
+		}
+	}
+	fclose(f);
+	return err ? -1 : 0;
+}
+
+int polar_save(const PolarTable * t, const char * path)
+{
+	PolarFileHeader h;
+	FILE * f = fopen(path, "wb");
+	size_t n = (size_t)t->n_twa * t->n_tws;
+	int err;
+
+	if (f == NULL) return -1;
+	memset(&h, 0, sizeof(h));
+	h.magic = POLAR_MAGIC;
+	h.version = POLAR_VERSION;
+	h.n_twa = t->n_twa;
+	h.n_tws = t->n_tws;
+	h.twa0 = t->twa0;
+	h.twa_step = t->twa_step;
+	h.tws0 = t->tws0;
+	h.tws_step = t->tws_step;
+	err = fwrite(&h, sizeof(h), 1, f) != 1 || fwrite(t->speed, sizeof(float), n, f) != n || fwrite(t->heel, sizeof(float), n, f) != n;
+	return fclose(f) != 0 || err ? -1 : 0;
+}
+
+/*
+ *	Cell of a grid coordinate: index of the lower node (clamped to the
+ *	grid) and the weight of the upper one
+ */
+static inline int polar_cell(float x, float x0, float inv, int n, float * w)
+{
+	float u = (x - x0) * inv;
+	int i;
+
+	u = u < 0 ? 0 : u > n - 1 ? n - 1 : u;
+	i = (int)u;
+	i = i > n - 2 ? n - 2 : i;
+	*w = u - i;
+	return i;
+}
+
+/*
+ *	Speed and heeling at [twa] degrees, [tws] m/s
+ */
+static inline void polar_lookup(const PolarTable * t, float twa, float tws, float * speed, float * heel)
+{
+	float wa, ws;
+	int a = polar_cell(twa, t->twa0, t->twa_inv, t->n_twa, &wa);
+	int s = polar_cell(tws, t->tws0, t->tws_inv, t->n_tws, &ws);
+	int k = a * t->n_tws + s, n = t->n_tws;
+
+	*speed = (1-wa)*((1-ws)*t->speed[k] + ws*t->speed[k+1]) + wa*((1-ws)*t->speed[k+n] + ws*t->speed[k+n+1]);
+	*heel  = (1-wa)*((1-ws)*t->heel[k]  + ws*t->heel[k+1])  + wa*((1-ws)*t->heel[k+n]  + ws*t->heel[k+n+1]);
+}
+
+/*
+ *	[count] lookups: speed[k], heel[k] at twa[k], tws[k]
+ */
+void polar_lookup_batch(const PolarTable * t, const float * twa, const float * tws, int count, float * speed, float * heel)
+{
+	int k;
+
+	for (k = 0; k < count; k++) polar_lookup(t, twa[k], tws[k], &speed[k], &heel[k]);
+}
+
+/*
+ *	Angle [degrees] of the best VMG at [tws]: upwind (speed*cos(twa) max)
+ *	or downwind (min), searched on [steps] angles of the table range
+ */
+float polar_best_vmg(const PolarTable * t, float tws, int downwind, int steps)
+{
+	float twa, speed, heel, vmg, best = 0, best_twa = t->twa0;
+	int k;
+
+	for (k = 0; k <= steps; k++) {
+		twa = t->twa0 + (t->n_twa - 1) * t->twa_step * k / steps;
+		polar_lookup(t, twa, tws, &speed, &heel);
+		vmg = speed * cos(twa*PI/180) * (downwind ? -1 : 1);
+		if (vmg > best) {
+			best = vmg;
+			best_twa = twa;
+		}
+	}
+	return best_twa;
+}
@@ -0,0 +1,187 @@
+/*
+ *	STAGE PROFILER
+ *
+ *	Record the duration of the stages of the controller tick (guidance,
+ *	findAngle, hill climbing, move_sail, write_log_file...) into an in-memory
+ *	ring of events:
+ *
+ *		PROF_BEGIN(PROF_SAIL_CTRL);
+ *		sail_controller();
+ *		PROF_END(PROF_SAIL_CTRL);
+ *
+ *	or PROF_CALL(PROF_GUIDANCE, guidance()) for a single call.
+ *
+ *	The ring is lock-free: a writer reserves a slot with an atomic increment
+ *	and publishes it with a sequence number, so stages can be recorded from
+ *	any thread and read while they are written. The oldest events are
+ *	overwritten when the ring is full.
+ *
+ *	prof_report() prints the p50/p99/max duration of each stage over the
+ *	events still in the ring (and the all time count and max), prof_write_trace()
+ *	exports them as Chrome trace-event JSON (chrome://tracing, Perfetto).
+ *
+ *	When [profiler.enabled] is 0 a stage costs one test of a global variable.
+ *	Build with -DNO_PROFILER to remove the instrumentation completely.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define PROF_RING_SIZE	16384			// events, power of two
+
+enum ProfStage {
+	PROF_SENSORS,		// read_weather_station(_essential)
+	PROF_GUIDANCE,
+	PROF_FINDANGLE,
+	PROF_HEADING_HC,	// hill climbing and step heading controllers
+	PROF_SAIL_CTRL,		// sail hill climbing and default sail controller
+	PROF_MOVE_SAIL,
+	PROF_SIMULATE,
+	PROF_RUDDER_PID,
+	PROF_MOVE_RUDDER,
+	PROF_LOG,		// write_log_file: log snapshot
+	PROF_ACQUIRE,		// acquisition thread: sensors snapshot or files
+	PROF_OUTPUT,		// output thread: one file write
+	PROF_LOGGER,		// logger thread: records of one snapshot
+	PROF_COUNT
+};
+
+const char * prof_stage_name[PROF_COUNT] = {
+	"sensors", "guidance", "findAngle", "heading_hc", "sail_ctrl",
+	"move_sail", "simulate", "rudder_pid", "move_rudder", "log",
+	"acquire", "output", "logger"
+};
+
+typedef struct {
+	volatile uint64_t seq;		// index + 1 of the event stored in the slot, 0 while written
+	uint64_t start_ns;
+	uint32_t dur_ns;
+	uint16_t stage;
+	uint16_t tid;
+} ProfEvent;
+
+typedef struct {
+	volatile int enabled;
+	volatile uint64_t head;		// number of events recorded so far
+	uint64_t count[PROF_COUNT];
+	uint32_t max_ns[PROF_COUNT];
+	ProfEvent ring[PROF_RING_SIZE];
+} Profiler;
+
+Profiler profiler;
+__thread uint16_t prof_tid = 0;		// thread id shown in the trace
+
+
+static inline uint64_t prof_now_ns()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec*1000000000ULL + t.tv_nsec;
+}
+
+void prof_record(int stage, uint64_t start_ns)
+{
+	uint64_t dur = prof_now_ns() - start_ns;
+	uint64_t idx = __sync_fetch_and_add(&profiler.head, 1);
+	ProfEvent * e = &profiler.ring[idx & (PROF_RING_SIZE-1)];
+
+	e->seq = 0;
+	__sync_synchronize();
+	e->start_ns = start_ns;
+	e->dur_ns = dur > UINT32_MAX ? UINT32_MAX : dur;
+	e->stage = stage;
+	e->tid = prof_tid;
+	__sync_synchronize();
+	e->seq = idx + 1;
+
+	__sync_fetch_and_add(&profiler.count[stage], 1);
+	if (e->dur_ns > profiler.max_ns[stage]) profiler.max_ns[stage] = e->dur_ns;	// racy, only a statistic
+}
+
+#ifdef NO_PROFILER
+#define PROF_BEGIN(s)
+#define PROF_END(s)
+#else
+#define PROF_BEGIN(s)	uint64_t prof_t0_##s = profiler.enabled ? prof_now_ns() : 0
+#define PROF_END(s)	if (prof_t0_##s) prof_record(s, prof_t0_##s)
+#endif
+#define PROF_CALL(s, call)	do { PROF_BEGIN(s); call; PROF_END(s); } while (0)
+
+void prof_enable(int on)
+{
+	profiler.enabled = on;
+}
+
+/*
+ *	Copy the events of the ring, oldest first, into [out] (PROF_RING_SIZE
+ *	entries). Slots being written during the copy are skipped.
+ *	Return the number of events copied.
+ */
+int prof_snapshot(ProfEvent * out)
+{
+	uint64_t head = profiler.head, first, idx;
+	int n = 0;
+
+	first = head > PROF_RING_SIZE ? head - PROF_RING_SIZE : 0;
+	for (idx = first; idx < head; idx++) {
+		ProfEvent * e = &profiler.ring[idx & (PROF_RING_SIZE-1)];
+		if (e->seq != idx + 1) continue;
+		out[n] = *e;
+		__sync_synchronize();
+		if (e->seq != idx + 1) continue;	// overwritten during the copy
+		n++;
+	}
+	return n;
+}
+
+int prof_cmp_u32(const void * a, const void * b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+/*
+ *	Print p50/p99/max of each stage over the events in the ring
+ */
+void prof_report(FILE * out)
+{
+	static ProfEvent events[PROF_RING_SIZE];
+	static uint32_t dur[PROF_RING_SIZE];
+	int n, s, k, m;
+
+	n = prof_snapshot(events);
+	fprintf(out, "profiler %s, %d events in the ring\n", profiler.enabled ? "enabled" : "disabled", n);
+	fprintf(out, "%-12s %10s %10s %10s %10s %12s %10s\n", "stage", "samples", "p50 us", "p99 us", "max us", "total", "total max");
+	for (s = 0; s < PROF_COUNT; s++) {
+		if (profiler.count[s] == 0) continue;
+		for (k = 0, m = 0; k < n; k++)
+			if (events[k].stage == s) dur[m++] = events[k].dur_ns;
+		if (m > 0) qsort(dur, m, sizeof(uint32_t), prof_cmp_u32);
+		fprintf(out, "%-12s %10d %10.1f %10.1f %10.1f %12llu %10.1f\n", prof_stage_name[s], m,
+			m ? dur[(m-1)*50/100]/1000.0 : 0, m ? dur[(m-1)*99/100]/1000.0 : 0, m ? dur[m-1]/1000.0 : 0,
+			(unsigned long long)profiler.count[s], profiler.max_ns[s]/1000.0);
+	}
+	fflush(out);
+}
+
+/*
+ *	Export the events in the ring as Chrome trace-event JSON. Return -1 on error.
+ */
+int prof_write_trace(const char * path)
+{
+	static ProfEvent events[PROF_RING_SIZE];
+	FILE * f;
+	int n, k;
+
+	n = prof_snapshot(events);
+	f = fopen(path, "w");
+	if (f == NULL) return -1;
+	fprintf(f, "{\"traceEvents\":[\n");
+	for (k = 0; k < n; k++)
+		fprintf(f, "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u}%s\n",
+			prof_stage_name[events[k].stage], events[k].start_ns/1000.0, events[k].dur_ns/1000.0,
+			(int)getpid(), events[k].tid, k < n-1 ? "," : "");
+	fprintf(f, "],\"displayTimeUnit\":\"ms\"}\n");
+	fclose(f);
+	return 0;
+}
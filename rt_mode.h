@@ -0,0 +1,114 @@
+/*
+ *	REAL-TIME MODE
+ *
+ *	Opt-in real-time setup of a sailboat process (controller, actuators):
+ *		- mlockall(MCL_CURRENT | MCL_FUTURE): no page fault once running
+ *		- prefault RT_PREFAULT_STACK bytes of stack and the buffers given
+ *		  to rt_prefault() (log rings...)
+ *		- SCHED_FIFO with the configured priority
+ *		- CPU affinity to one CPU
+ *
+ *	Each step is reported at startup, a failing step (usually EPERM when not
+ *	run as root) doesn't stop the process, it runs with what succeeded.
+ *	Threads created after rt_setup() inherit the policy, rt_thread_attr()
+ *	gives them a small locked stack and a priority of their own.
+ */
+
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define RT_PREFAULT_STACK	(256*1024)
+#define RT_THREAD_STACK		(256*1024)
+
+typedef struct {
+	int  enabled;
+	int  priority;			// SCHED_FIFO priority, 1..99
+	int  cpu;			// CPU to run on, -1 for any
+	int  failures;			// steps that failed
+} RtConfig;
+
+RtConfig rt = { 0, 50, -1, 0 };
+
+
+void rt_step(const char * process, const char * step, int ok)
+{
+	if (ok) printf("-> %s RT: %s ok\n", process, step);
+	else {
+		printf("-> %s RT: %s FAILED (%s)\n", process, step, strerror(errno));
+		rt.failures++;
+	}
+}
+
+/*
+ *	Touch the stack once, so its pages are mapped (and locked) before the loop
+ */
+void rt_prefault_stack()
+{
+	char stack[RT_PREFAULT_STACK];
+	memset(stack, 0, sizeof(stack));
+	__asm__ volatile ("" : : "r" (stack) : "memory");	// keep the memset
+}
+
+/*
+ *	Write every page of [buf]: its first use doesn't fault, even when mlockall failed
+ */
+void rt_prefault(void * buf, size_t len)
+{
+	volatile char * p = (volatile char *)buf;
+	size_t n;
+	for (n = 0; n < len; n += 4096) p[n] = p[n];
+}
+
+/*
+ *	Apply the RT configuration to the calling process. Return the number of failed steps.
+ */
+int rt_setup(const char * process)
+{
+	struct sched_param sp;
+	unsigned long mask;
+
+	if (!rt.enabled) return 0;
+	rt.failures = 0;
+
+	rt_step(process, "mlockall", mlockall(MCL_CURRENT | MCL_FUTURE) == 0);
+	rt_prefault_stack();
+	printf("-> %s RT: %d KB of stack prefaulted\n", process, RT_PREFAULT_STACK/1024);
+
+	memset(&sp, 0, sizeof(sp));
+	sp.sched_priority = rt.priority;
+	if (sched_setscheduler(0, SCHED_FIFO, &sp) == 0) printf("-> %s RT: SCHED_FIFO priority %d ok\n", process, rt.priority);
+	else rt_step(process, "SCHED_FIFO", 0);
+
+	if (rt.cpu >= 0) {
+		// raw syscall: the cpu_set_t interface needs _GNU_SOURCE
+		mask = 1UL << rt.cpu;
+		if (syscall(SYS_sched_setaffinity, 0, sizeof(mask), &mask) == 0) printf("-> %s RT: pinned to CPU %d ok\n", process, rt.cpu);
+		else rt_step(process, "CPU affinity", 0);
+	}
+	fflush(stdout);
+	return rt.failures;
+}
+
+/*
+ *	Attributes for a thread created in RT mode: small stack, SCHED_FIFO at
+ *	[priority]. Return NULL (default attributes) when RT mode is off.
+ */
+pthread_attr_t * rt_thread_attr(pthread_attr_t * attr, int priority)
+{
+	struct sched_param sp;
+
+	if (!rt.enabled) return NULL;
+	pthread_attr_init(attr);
+	pthread_attr_setstacksize(attr, RT_THREAD_STACK);
+	if (sched_getscheduler(0) == SCHED_FIFO) {
+		memset(&sp, 0, sizeof(sp));
+		sp.sched_priority = priority < 1 ? 1 : priority;
+		pthread_attr_setinheritsched(attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(attr, SCHED_FIFO);
+		pthread_attr_setschedparam(attr, &sp);
+	}
+	return attr;
+}
@@ -0,0 +1,128 @@
+/*
+ *	SENSOR SNAPSHOT (shared memory interface between u200 and the controller)
+ *
+ *	u200 decodes the weather station fields into one SensorData struct and
+ *	publishes it as a whole in a POSIX shared memory segment. The controller
+ *	copies the struct out without any syscall.
+ *
+ *	The segment is protected by a sequence counter (seqlock): the writer makes
+ *	[seq] odd while it is updating the data and even again when it is done, a
+ *	reader retries until it sees the same even [seq] before and after the copy.
+ *	Every publish also increments [generation], so a reader can tell whether a
+ *	new snapshot arrived since its last read.
+ *
+ *	The /tmp/u200 text files are still available as a compatibility export
+ *	(u200 -f), they are only read by the controller when no snapshot exists.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SENSOR_SHM_NAME		"/sailboat_u200"
+#define SENSOR_SHM_MAGIC	0x55323030	// "U200"
+#define SENSOR_SHM_VERSION	1
+#define SENSOR_SHM_RETRIES	100		// max attempts to get a consistent copy
+#define SENSOR_SHM_TIMEOUT	5		// [seconds] a snapshot older than this is stale (u200 not running)
+
+// Fields of the snapshot, same order as the files in /tmp/u200
+enum SensorField {
+	SNS_RATE, SNS_HEADING, SNS_DEVIATION, SNS_VARIATION, SNS_YAW, SNS_PITCH, SNS_ROLL,
+	SNS_LATITUDE, SNS_LONGITUDE, SNS_COG, SNS_SOG, SNS_WIND_SPEED, SNS_WIND_ANGLE,
+	SNS_COUNT
+};
+
+typedef struct {
+	double   value[SNS_COUNT];	// decoded values, raw units as written in /tmp/u200
+	uint32_t valid;			// bitmask of the fields received at least once
+	uint32_t timestamp;		// [unix time] of the last publish
+} SensorData;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;			// sizeof(SensorSegment), rejects mismatching builds
+	volatile uint32_t seq;		// odd while the writer is updating [data]
+	volatile uint32_t generation;	// number of snapshots published so far
+	SensorData data;
+} SensorSegment;
+
+
+/*
+ *	Map the sensor segment. If [create] is set, the segment is created when
+ *	missing and its header is initialized. Return NULL if it can't be mapped
+ *	or if it was created by an incompatible build.
+ */
+SensorSegment * sensor_shm_open(int create)
+{
+	int fd;
+	struct stat st;
+	SensorSegment * seg;
+
+	fd = shm_open(SENSOR_SHM_NAME, create ? (O_RDWR | O_CREAT) : O_RDWR, 0666);
+	if (fd < 0) return NULL;
+
+	if (fstat(fd, &st) < 0) { close(fd); return NULL; }
+	if (st.st_size == 0 && create) {
+		if (ftruncate(fd, sizeof(SensorSegment)) < 0) { close(fd); return NULL; }
+	} else if (st.st_size < (off_t)sizeof(SensorSegment)) {
+		close(fd);
+		return NULL;
+	}
+
+	seg = mmap(NULL, sizeof(SensorSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (seg == MAP_FAILED) return NULL;
+
+	// a fresh segment is all zeros: stamp the header
+	if (seg->magic == 0 && create) {
+		seg->version = SENSOR_SHM_VERSION;
+		seg->size = sizeof(SensorSegment);
+		__sync_synchronize();
+		seg->magic = SENSOR_SHM_MAGIC;
+	}
+
+	if (seg->magic != SENSOR_SHM_MAGIC || seg->version != SENSOR_SHM_VERSION || seg->size != sizeof(SensorSegment)) {
+		munmap(seg, sizeof(SensorSegment));
+		return NULL;
+	}
+	return seg;
+}
+
+/*
+ *	Publish a full snapshot (single writer)
+ */
+void sensor_shm_publish(SensorSegment * seg, const SensorData * d)
+{
+	seg->seq++;			// odd: update in progress
+	__sync_synchronize();
+	memcpy((void *)&seg->data, d, sizeof(SensorData));
+	seg->generation++;
+	__sync_synchronize();
+	seg->seq++;			// even: snapshot consistent
+}
+
+/*
+ *	Copy a consistent snapshot into [d].
+ *	Return the generation of the copied snapshot, 0 if nothing has been published
+ *	yet or if no consistent copy could be taken.
+ */
+uint32_t sensor_shm_read(SensorSegment * seg, SensorData * d)
+{
+	uint32_t s1, gen;
+	int n;
+
+	for (n = 0; n < SENSOR_SHM_RETRIES; n++) {
+		s1 = seg->seq;
+		__sync_synchronize();
+		if (s1 & 1) continue;
+		memcpy(d, (const void *)&seg->data, sizeof(SensorData));
+		gen = seg->generation;
+		__sync_synchronize();
+		if (seg->seq == s1) return gen;
+	}
+	return 0;
+}
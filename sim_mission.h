@@ -0,0 +1,212 @@
+/*
+ *	SIMULATED MISSION
+ *
+ *	One mission of the controller core (see controller_core.h) against the
+ *	boat model (see boat_sim.h), in memory, from a start point to a target
+ *	point, with the rate groups of controller.c: each control step runs the
+ *	control group, moves the boat, then the rudder group [rudder_steps] times.
+ *
+ *	The seed draws the initial heading and the wind direction around the
+ *	values of the MissionSpec ([heading_sd], [wind_sd] standard deviations),
+ *	so a mission is the same for the same seed on any thread. The wind then
+ *	varies around it as the WindField of [wind] (see sim_wind.h), queried
+ *	at the boat position every control step. The controller reads the
+ *	boat and the wind through the impairments of [sensors] (see
+ *	sim_sensors.h, drawn from the seed too), the true values when it is
+ *	zero.
+ *
+ *	The boat moves on the polar table [polar] (see polar_table.h), or with
+ *	the 4-DOF model of boat_dyn.h as [model]. With
+ *	[warm_start] the hill climbing controllers start on the heading of the
+ *	best VMG of the table towards the target (as the GUI DIR_init).
+ *
+ *	Results:
+ *		- mean VMG: [m/s] distance made towards the target over the time
+ *		- convergence: first time after which the VMG, averaged over
+ *		  [steptime] seconds (the hill climbing period), stays within
+ *		  [conv_band] of the mean VMG of the last quarter of the mission,
+ *		  -1 if it doesn't settle before that quarter
+ *		- actuator travel: sum of the sail feedback moves [ticks] and of
+ *		  the rudder command changes [degrees]
+ */
+
+typedef struct {
+	float wind_angle, heading;		// [degrees]
+	float wind_speed;			// [m/s]
+	float wind_sd, heading_sd;		// [degrees] spread drawn from the seed
+	WindSpec wind;				// variation, zero: constant wind
+	SensorSpec sensors;			// impairments of the inputs, zero: true values
+	float lat, lon, target_lat, target_lon;
+	float duration;				// [s] unless the target is reached
+	int   rudder_steps;			// rudder steps per control step
+	float conv_band;			// relative band of the convergence
+	int   warm_start;
+	const PolarTable * polar;		// NULL: the polynomials of boat_sim.h
+	int   model;				// SIM_MODEL_* of boat_sim.h
+	ControllerParams params;
+} MissionSpec;
+
+typedef struct {
+	float time;				// [s] simulated
+	int   arrived;			// the target was reached
+	float convergence;			// [s], -1 never
+	float vmg_mean;				// [m/s]
+	float sail_travel, rudder_travel;
+} MissionResult;
+
+
+/*
+ *	Defaults of a MissionSpec: the GUI defaults, rudder group at 20 Hz
+ */
+void mission_default(MissionSpec * m)
+{
+	memset(m, 0, sizeof(MissionSpec));
+	m->heading = 270;
+	m->wind_angle = 30;
+	m->wind_speed = 5;
+	m->duration = 600;
+	m->rudder_steps = 5;
+	m->conv_band = 0.1;
+	controller_params_default(&m->params);
+}
+
+float mission_distance(const SimBoat * b, const MissionSpec * m)
+{
+	float dy = (b->Latitude - m->target_lat)*CONVLAT, dx = (b->Longitude - m->target_lon)*CONVLON;
+	return sqrt(dx*dx + dy*dy);
+}
+
+/*
+ *	Heading [degrees, 1..360] of the best VMG of the polar table from the
+ *	start towards the target with the wind from [wind]: the tack closer to
+ *	the bearing of the target, upwind or downwind
+ */
+int mission_warm_heading(const MissionSpec * m, float wind)
+{
+	float bearing = atan2((m->target_lon - m->lon)*CONVLON, (m->target_lat - m->lat)*CONVLAT)*180/PI;
+	float off = bearing - wind, twa, h1, h2;
+	int h;
+
+	off = atan2(sin(off*PI/180), cos(off*PI/180))*180/PI;
+	twa = polar_best_vmg(m->polar, m->wind_speed, fabs(off) > 90, 180);
+	h1 = wind + twa;
+	h2 = wind - twa;
+	h = round(fabs(sin((h1 - bearing)*PI/360)) < fabs(sin((h2 - bearing)*PI/360)) ? h1 : h2);
+	h = ((h % 360) + 360) % 360;
+	return h == 0 ? 360 : h;
+}
+
+/*
+ *	First time [s] after which the [window]-step mean of [vmg] stays within
+ *	[band] of the mean of the last quarter, -1 if it doesn't settle before
+ *	the last quarter (a mean ending there is always close to its own mean)
+ */
+float mission_convergence(const float * vmg, int steps, int window, float band)
+{
+	double sum = 0, final = 0, tol;
+	int k, from = 3*steps/4, settled = -1;
+
+	if (steps < 4 || window < 1) return -1;
+	for (k = from; k < steps; k++) final += vmg[k];
+	final /= steps - from;
+	tol = band * (fabs(final) > 0.1 ? fabs(final) : 0.1);
+
+	// moving mean ending at step k, scanned forwards: the last step out of the band
+	for (k = 0; k < steps; k++) {
+		sum += vmg[k];
+		if (k >= window) sum -= vmg[k - window];
+		if (k + 1 >= window && fabs(sum/window - final) > tol) settled = -1;
+		else if (k + 1 >= window && settled < 0) settled = k;
+	}
+	return settled < 0 || settled >= from ? -1 : (float)(settled + 1) / SEC;
+}
+
+/*
+ *	Run mission [m] with [seed]. [vmg] holds duration*SEC floats (scratch).
+ */
+void mission_run(const MissionSpec * m, uint64_t seed, float * vmg, MissionResult * r)
+{
+	ControllerState ctrl;
+	ControllerInputs in;
+	ControllerOutputs out;
+	SimBoat boat;
+	ControllerParams params = m->params;
+	SimRng rng;
+	WindField field;
+	SensorSim sensors;
+	float wind, wind_angle, wind_speed, d, d0, d1;
+	int steps = m->duration * SEC, k, j, sail = 0, sail_prev, rudder_prev = 0;
+
+	sim_rng_init(&rng, seed, 0);
+	memset(r, 0, sizeof(MissionResult));
+	memset(&boat, 0, sizeof(SimBoat));
+	boat.Heading = m->heading + m->heading_sd * sim_gauss(&rng);
+	boat.Latitude = m->lat;
+	boat.Longitude = m->lon;
+	boat.polar = m->polar;
+	boat.model = m->model;
+	wind = m->wind_angle + m->wind_sd * sim_gauss(&rng);
+	if (m->warm_start && m->polar != NULL) params.DIR_init = mission_warm_heading(m, wind);
+	wind_field_init(&field, &m->wind, wind, m->wind_speed, seed, 1/SEC);
+	sensor_sim_init(&sensors, &m->sensors, seed, 1/SEC);
+
+	controller_init(&ctrl);
+	memset(&in, 0, sizeof(ControllerInputs));
+	in.Navigation_System = 1;
+	in.Point_Start_Lat = m->lat;
+	in.Point_Start_Lon = m->lon;
+	in.Point_End_Lat = m->target_lat;
+	in.Point_End_Lon = m->target_lon;
+	in.params = params;
+	in.Simulation = 1;
+	d0 = d = mission_distance(&boat, m);
+
+	for (k = 0; k < steps; k++) {
+		wind_field_at(&field, k, boat.Latitude, boat.Longitude, &wind_angle, &wind_speed);
+		in.Wind_Angle = wind_angle;
+		in.Heading = boat.Heading;
+		in.Latitude = boat.Latitude;
+		in.Longitude = boat.Longitude;
+		in.Sail_Feedback = boat.Sail_Feedback;
+		in.v_poly = boat.v_poly;
+		in.heel_sim = boat.heel_sim;
+		if (sensors.active) {
+			sensor_sim_sample(&sensors, k, &in, SIMS_ALL);
+			sensor_sim_read(&sensors, &in);
+		}
+		controller_step(&ctrl, &in, &out);
+		if (out.updated & CTRL_SAIL) sail = out.sail;
+		r->rudder_travel += abs(ctrl.Rudder_Desired_Angle - rudder_prev);
+		rudder_prev = ctrl.Rudder_Desired_Angle;
+
+		sail_prev = boat.Sail_Feedback;
+		sim_step(&boat, ctrl.Rudder_Desired_Angle, sail, wind_angle, wind_speed);
+		r->sail_travel += abs(boat.Sail_Feedback - sail_prev);
+
+		in.Heading = boat.Heading;
+		in.Latitude = boat.Latitude;
+		in.Longitude = boat.Longitude;
+		if (sensors.active) {
+			// the heading and position of the next step, the other channels stay
+			sensor_sim_sample(&sensors, k + 1, &in, (1u << SIMS_HEADING) | (1u << SIMS_POSITION));
+			sensor_sim_read(&sensors, &in);
+		}
+		for (j = 0; j < m->rudder_steps; j++) {
+			controller_rudder_step(&ctrl, &in, &out);
+			r->rudder_travel += abs(ctrl.Rudder_Desired_Angle - rudder_prev);
+			rudder_prev = ctrl.Rudder_Desired_Angle;
+		}
+
+		d1 = mission_distance(&boat, m);
+		vmg[k] = (d - d1) * SEC;
+		d = d1;
+		if (d < RADIUSACCEPTED) {
+			r->arrived = 1;
+			k++;
+			break;
+		}
+	}
+	r->time = (float)k / SEC;
+	r->vmg_mean = k > 0 ? (d0 - d) / r->time : 0;
+	r->convergence = mission_convergence(vmg, k, m->params.steptime * SEC > 1 ? m->params.steptime * SEC : 1, m->conv_band);
+}
@@ -0,0 +1,60 @@
+/*
+ *	SIMULATION RANDOM NUMBERS
+ *
+ *	Small seedable generator for the simulations (xorshift64*, seeded
+ *	through splitmix64). Each simulated mission owns its SimRng, so a run
+ *	gives the same numbers for the same seed whatever thread executes it.
+ */
+
+#include <stdint.h>
+
+typedef struct {
+	uint64_t s;
+} SimRng;
+
+
+/*
+ *	splitmix64: spreads close seeds (1, 2, 3...) over the whole state space
+ */
+static inline uint64_t sim_mix64(uint64_t x)
+{
+	x += 0x9E3779B97F4A7C15ULL;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+}
+
+/*
+ *	Generator of [seed], [stream] separates the generators of one seed
+ *	(wind, sensor noise...)
+ */
+void sim_rng_init(SimRng * r, uint64_t seed, uint64_t stream)
+{
+	r->s = sim_mix64(sim_mix64(seed) ^ stream);
+	if (r->s == 0) r->s = 1;
+}
+
+static inline uint64_t sim_rand64(SimRng * r)
+{
+	r->s ^= r->s >> 12;
+	r->s ^= r->s << 25;
+	r->s ^= r->s >> 27;
+	return r->s * 0x2545F4914F6CDD1DULL;
+}
+
+/*
+ *	Uniform in [0, 1)
+ */
+static inline double sim_uniform(SimRng * r)
+{
+	return (sim_rand64(r) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ *	Normal, mean 0 and standard deviation 1 (Box-Muller)
+ */
+double sim_gauss(SimRng * r)
+{
+	double u = sim_uniform(r), v = sim_uniform(r);
+	return sqrt(-2*log(1 - u)) * cos(2*PI*v);
+}
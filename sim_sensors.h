@@ -0,0 +1,265 @@
+/*
+ *	SIMULATION SENSOR IMPAIRMENTS
+ *
+ *	What the controller reads of the simulated boat: between the true
+ *	values of the model and the controller inputs, each channel goes
+ *	through
+ *		- delay: the measurement is [delay] seconds old, plus a uniform
+ *		  random [jitter] (a later measurement never overtakes an
+ *		  earlier one)
+ *		- sample-and-hold: the source publishes every [hold] seconds
+ *		  (random phase), as u200 throttling a field at WRITE_INTERVAL or
+ *		  the actuators writing Sail_Feedback every 11 loops
+ *		- noise: [bias] plus Gaussian noise of standard deviation [noise],
+ *		  drawn once per measurement
+ *		- dropouts: [dropout_rate] per second, [dropout_time] seconds long,
+ *		  while the controller keeps the last value (as a missing file)
+ *
+ *	Channels and units: heading and wind_angle [degrees], position [m] on
+ *	each axis, speed [m/s] (v_poly), heel (heel_sim, see boat_sim.h) and
+ *	sail [ticks] (Sail_Feedback). The boat moves by control steps: a
+ *	measurement of a past time takes the step in effect at that time.
+ *
+ *	Each channel draws from its own generator (stream 2 + channel of the
+ *	seed), so impairing one channel doesn't change the others. A channel
+ *	with a zero spec passes the true values unchanged.
+ *
+ *		SensorSim s;
+ *		sensor_sim_init(&s, &spec, seed, 1/SEC);
+ *		loop:
+ *			sensor_sim_sample(&s, tick, &truth, SIMS_ALL);	// true values in a ControllerInputs
+ *			sensor_sim_read(&s, &in);
+ *
+ *	SensorSpec file (sensor_spec_load, controller -N), "key value..."
+ *	lines, # comments, for each channel:
+ *		<channel>_noise		noise [bias]
+ *		<channel>_delay		delay [jitter]
+ *		<channel>_hold		hold
+ *		<channel>_dropout	dropout_rate dropout_time
+ *		seed			seed of the impairments
+ */
+
+#define SIMS_MAX_LAG	30		// [s] largest delay + jitter + hold
+#define SIMS_HISTORY	128		// [steps] true values kept, more than SIMS_MAX_LAG*SEC
+#define SIMS_STREAM	2		// SimRng stream of the first channel
+
+enum SimSensor { SIMS_HEADING, SIMS_POSITION, SIMS_SPEED, SIMS_WIND_ANGLE, SIMS_HEEL, SIMS_SAIL, SIMS_CHANNELS };
+const char * sim_sensor_names[SIMS_CHANNELS] = { "heading", "position", "speed", "wind_angle", "heel", "sail" };
+#define SIMS_ALL	((1u << SIMS_CHANNELS) - 1)
+
+typedef struct {
+	float noise, bias;		// [units of the channel]
+	float delay, jitter;		// [s]
+	float hold;			// [s] 0: every step
+	float dropout_rate;		// [1/s]
+	float dropout_time;		// [s]
+} SensorChannelSpec;
+
+typedef struct {
+	SensorChannelSpec ch[SIMS_CHANNELS];
+} SensorSpec;
+
+typedef struct {
+	SensorChannelSpec spec;
+	SimRng rng;
+	double truth[SIMS_HISTORY][2];	// true values by step (position: latitude, longitude)
+	int64_t first, tick;		// first and last step sampled, -1: none
+	double src;			// [s] time of the last measurement
+	int64_t sample;			// measurement of [out]
+	int64_t dropout;		// steps of dropout left
+	double phase;			// [s] of the publications
+	double out[2];			// sensed values
+} SensorChannel;
+
+typedef struct {
+	SensorChannel ch[SIMS_CHANNELS];
+	unsigned active;		// impaired channels, SIMS_* bits
+	double dt;			// [s] per step
+} SensorSim;
+
+
+/*
+ *	Set [key] of [s] from its [n] values. Return 0 for an unknown key,
+ *	-1 for wrong values, 1 when set.
+ */
+int sensor_spec_set(SensorSpec * s, const char * key, const double * v, int n)
+{
+	const char * keys[] = { "noise", "delay", "hold", "dropout" };
+	const int min[] = { 1, 1, 1, 2 }, max[] = { 2, 2, 1, 2 };
+	SensorChannelSpec * c;
+	size_t len;
+	int ch, k;
+
+	for (ch = 0; ch < SIMS_CHANNELS; ch++) {
+		len = strlen(sim_sensor_names[ch]);
+		if (strncmp(key, sim_sensor_names[ch], len) == 0 && key[len] == '_') break;
+	}
+	if (ch == SIMS_CHANNELS) return 0;
+	key += len + 1;
+	for (k = 0; k < 4 && strcmp(key, keys[k]) != 0; k++);
+	if (k == 4) return 0;
+	if (n < min[k] || n > max[k]) return -1;
+	c = &s->ch[ch];
+	switch (k) {
+		case 0: c->noise = v[0]; c->bias = n > 1 ? v[1] : 0; break;
+		case 1: c->delay = v[0]; c->jitter = n > 1 ? v[1] : 0; break;
+		case 2: c->hold = v[0]; break;
+		case 3: c->dropout_rate = v[0]; c->dropout_time = v[1]; break;
+	}
+	if (c->noise < 0 || c->delay < 0 || c->jitter < 0 || c->hold < 0 || c->dropout_rate < 0 || c->dropout_time < 0
+		|| c->delay + c->jitter + c->hold > SIMS_MAX_LAG || (c->dropout_rate > 0 && c->dropout_time <= 0)) return -1;
+	return 1;
+}
+
+/*
+ *	Load a SensorSpec file. Return -1 on error.
+ */
+int sensor_spec_load(SensorSpec * s, uint64_t * seed, const char * path)
+{
+	FILE * f = fopen(path, "r");
+	char line[256], key[64], * p, * end;
+	double v[3];
+	int n, len, err = 0;
+
+	if (f == NULL) return -1;
+	memset(s, 0, sizeof(SensorSpec));
+	while (!err && fgets(line, sizeof(line), f) != NULL) {
+		line[strcspn(line, "#\r\n")] = '\0';
+		if (sscanf(line, "%63s%n", key, &len) != 1) continue;
+		for (n = 0, p = line + len; n < 3; n++, p = end) {
+			v[n] = strtod(p, &end);
+			if (end == p) break;
+		}
+		if (strcmp(key, "seed") == 0 && n == 1) *seed = v[0];
+		else if (sensor_spec_set(s, key, v, n) != 1) err = 1;
+		if (err) printf("ERROR: %s: invalid line \"%s\".\n", path, line);
+	}
+	fclose(f);
+	return err ? -1 : 0;
+}
+
+/*
+ *	Impairments of [spec], drawn from [seed], [dt] seconds per step
+ */
+void sensor_sim_init(SensorSim * s, const SensorSpec * spec, uint64_t seed, double dt)
+{
+	const SensorChannelSpec * c;
+	int ch;
+
+	memset(s, 0, sizeof(SensorSim));
+	s->dt = dt;
+	for (ch = 0; ch < SIMS_CHANNELS; ch++) {
+		c = &spec->ch[ch];
+		s->ch[ch].spec = *c;
+		s->ch[ch].first = s->ch[ch].tick = -1;
+		sim_rng_init(&s->ch[ch].rng, seed, SIMS_STREAM + ch);
+		if (c->hold > 0) s->ch[ch].phase = c->hold * sim_uniform(&s->ch[ch].rng);
+		if (c->noise != 0 || c->bias != 0 || c->delay != 0 || c->jitter != 0 || c->hold != 0 || c->dropout_rate != 0)
+			s->active |= 1u << ch;
+	}
+}
+
+/*
+ *	Channel [ch] at step [tick] with the true values [v]
+ */
+void sensor_channel_step(SensorSim * s, int ch, int64_t tick, const double * v)
+{
+	SensorChannel * c = &s->ch[ch];
+	const SensorChannelSpec * p = &c->spec;
+	double t, x, y;
+	int64_t k, pub;
+
+	c->truth[tick % SIMS_HISTORY][0] = v[0];
+	c->truth[tick % SIMS_HISTORY][1] = v[1];
+	c->tick = tick;
+	if (c->first < 0) {
+		c->first = tick;
+		c->src = tick * s->dt;
+		c->sample = INT64_MIN;
+		c->out[0] = v[0];
+		c->out[1] = v[1];
+	}
+
+	// dropout: the last value stays
+	if (c->dropout > 0) {
+		c->dropout--;
+		return;
+	}
+	if (p->dropout_rate > 0 && sim_uniform(&c->rng) < p->dropout_rate * s->dt) {
+		c->dropout = ceil(p->dropout_time / s->dt) - 1;
+		return;
+	}
+
+	// time of the measurement, then of its publication
+	t = tick * s->dt - p->delay;
+	if (p->jitter > 0) t -= p->jitter * sim_uniform(&c->rng);
+	if (t < c->src) t = c->src;
+	c->src = t;
+	if (p->hold > 0) {
+		pub = floor((t - c->phase) / p->hold);
+		t = c->phase + pub * p->hold;
+	}
+	k = floor(t / s->dt + 1e-6);
+	if (k < c->first) k = c->first;
+	if (p->hold <= 0) pub = k;
+	if (pub == c->sample) return;
+	c->sample = pub;
+
+	// a new measurement
+	x = y = p->bias;
+	if (p->noise > 0) x += p->noise * sim_gauss(&c->rng);
+	if (p->noise > 0 && ch == SIMS_POSITION) y += p->noise * sim_gauss(&c->rng);
+	c->out[0] = c->truth[k % SIMS_HISTORY][0];
+	c->out[1] = c->truth[k % SIMS_HISTORY][1];
+	switch (ch) {
+		case SIMS_POSITION:
+			c->out[0] += y / CONVLAT;
+			c->out[1] += x / CONVLON;
+			break;
+		case SIMS_HEADING:
+		case SIMS_WIND_ANGLE:
+			// an angle of 0..360 stays in 0..360
+			if (c->out[0] >= 0 && c->out[0] < 360) c->out[0] = fmod(c->out[0] + x + 360, 360);
+			else c->out[0] += x;
+			break;
+		default:
+			c->out[0] += x;
+	}
+}
+
+/*
+ *	Advance the channels of [mask] to step [tick] with the true values of
+ *	[truth]. Earlier or the same steps keep the last state, skipped steps
+ *	take the values of [truth].
+ */
+void sensor_sim_sample(SensorSim * s, int64_t tick, const ControllerInputs * truth, unsigned mask)
+{
+	double v[SIMS_CHANNELS][2] = {
+		{ truth->Heading, 0 }, { truth->Latitude, truth->Longitude }, { truth->v_poly, 0 },
+		{ truth->Wind_Angle, 0 }, { truth->heel_sim, 0 }, { truth->Sail_Feedback, 0 } };
+	int64_t k;
+	int ch;
+
+	for (ch = 0; ch < SIMS_CHANNELS; ch++) {
+		if (!(mask & s->active & (1u << ch))) continue;
+		for (k = s->ch[ch].tick < 0 ? tick : s->ch[ch].tick + 1; k <= tick; k++) sensor_channel_step(s, ch, k, v[ch]);
+	}
+}
+
+/*
+ *	Replace the inputs of the impaired channels by their sensed values
+ */
+void sensor_sim_read(const SensorSim * s, ControllerInputs * in)
+{
+	const SensorChannel * c = s->ch;
+
+	if (s->active & (1u << SIMS_HEADING)) in->Heading = c[SIMS_HEADING].out[0];
+	if (s->active & (1u << SIMS_POSITION)) {
+		in->Latitude = c[SIMS_POSITION].out[0];
+		in->Longitude = c[SIMS_POSITION].out[1];
+	}
+	if (s->active & (1u << SIMS_SPEED)) in->v_poly = c[SIMS_SPEED].out[0];
+	if (s->active & (1u << SIMS_WIND_ANGLE)) in->Wind_Angle = c[SIMS_WIND_ANGLE].out[0];
+	if (s->active & (1u << SIMS_HEEL)) in->heel_sim = c[SIMS_HEEL].out[0];
+	if (s->active & (1u << SIMS_SAIL)) in->Sail_Feedback = lround(c[SIMS_SAIL].out[0]);
+}
@@ -0,0 +1,198 @@
+/*
+ *	SIMULATION WIND FIELD
+ *
+ *	Wind of the simulations around a mean direction and speed, the same
+ *	for the same seed:
+ *		- gusts: Ornstein-Uhlenbeck speed ([gust_sd] standard deviation,
+ *		  [gust_tau] correlation time)
+ *		- direction noise: Ornstein-Uhlenbeck ([dir_sd], [dir_tau])
+ *		- persistent shifts: a veer of [shift_rate] degrees/s and a step
+ *		  of [shift] degrees at [shift_time]
+ *		- oscillating shift: [osc_amp] degrees, period [osc_period]
+ *		- spatial variation: direction and speed waves of wavelength
+ *		  [space_scale] metres over the mission area, drifting downwind
+ *		  with the mean wind
+ *
+ *	The field is evaluated when queried: wind_field_at() advances the
+ *	processes to the tick of the query (every tick in between, so the
+ *	result doesn't depend on how often it is queried) and keeps the part
+ *	common to all positions until the next tick. A field with a zero
+ *	WindSpec is the constant mean wind.
+ *
+ *	WindSpec file (wind_spec_load, controller -W), "key value..." lines,
+ *	# comments:
+ *		gust		gust_sd gust_tau
+ *		dir_noise	dir_sd dir_tau
+ *		shift_rate	shift_rate
+ *		shift		shift_time shift
+ *		oscillation	osc_amp osc_period
+ *		spatial		space_dir space_speed space_scale
+ *		seed		seed of the field
+ */
+
+#define WIND_MODES	3		// waves of the spatial variation
+
+typedef struct {
+	float gust_sd, gust_tau;	// [m/s], [s]
+	float dir_sd, dir_tau;		// [degrees], [s]
+	float shift_rate;		// [degrees/s]
+	float shift_time, shift;	// [s], [degrees]
+	float osc_amp, osc_period;	// [degrees], [s]
+	float space_dir, space_speed;	// [degrees], [m/s] standard deviation over the area
+	float space_scale;		// [m] wavelength
+} WindSpec;
+
+typedef struct {
+	WindSpec spec;
+	float angle, speed;		// mean wind
+	double dt;			// [s] per tick
+	SimRng rng;
+	int64_t tick;			// tick of the processes and the cache
+	float gust, veer;		// Ornstein-Uhlenbeck states
+	float gust_a, gust_b, veer_a, veer_b;	// x = a*x + b*gauss per tick
+	float osc_phase;
+	double kx[WIND_MODES], ky[WIND_MODES], phase[WIND_MODES];	// waves [rad/m], [rad]
+	float tick_angle, tick_speed;	// common part at [tick]
+} WindField;
+
+
+/*
+ *	Set [key] of [w] from its [n] values. Return 0 for an unknown key,
+ *	-1 for wrong values, 1 when set.
+ */
+int wind_spec_set(WindSpec * w, const char * key, const double * v, int n)
+{
+	const char * keys[] = { "gust", "dir_noise", "shift_rate", "shift", "oscillation", "spatial" };
+	const int values[] = { 2, 2, 1, 2, 2, 3 };
+	int k;
+
+	for (k = 0; k < 6 && strcmp(key, keys[k]) != 0; k++);
+	if (k == 6) return 0;
+	if (n != values[k]) return -1;
+	switch (k) {
+		case 0: w->gust_sd = v[0]; w->gust_tau = v[1]; break;
+		case 1: w->dir_sd = v[0]; w->dir_tau = v[1]; break;
+		case 2: w->shift_rate = v[0]; break;
+		case 3: w->shift_time = v[0]; w->shift = v[1]; break;
+		case 4: w->osc_amp = v[0]; w->osc_period = v[1]; break;
+		case 5: w->space_dir = v[0]; w->space_speed = v[1]; w->space_scale = v[2]; break;
+	}
+	if (w->gust_sd < 0 || w->dir_sd < 0 || (w->gust_sd > 0 && w->gust_tau <= 0) || (w->dir_sd > 0 && w->dir_tau <= 0)
+		|| (w->osc_amp != 0 && w->osc_period <= 0) || ((w->space_dir != 0 || w->space_speed != 0) && w->space_scale <= 0)) return -1;
+	return 1;
+}
+
+/*
+ *	Load a WindSpec file. Return -1 on error.
+ */
+int wind_spec_load(WindSpec * w, uint64_t * seed, const char * path)
+{
+	FILE * f = fopen(path, "r");
+	char line[256], key[64], * p, * end;
+	double v[3];
+	int n, len, err = 0;
+
+	if (f == NULL) return -1;
+	memset(w, 0, sizeof(WindSpec));
+	while (!err && fgets(line, sizeof(line), f) != NULL) {
+		line[strcspn(line, "#\r\n")] = '\0';
+		if (sscanf(line, "%63s%n", key, &len) != 1) continue;
+		for (n = 0, p = line + len; n < 3; n++, p = end) {
+			v[n] = strtod(p, &end);
+			if (end == p) break;
+		}
+		if (strcmp(key, "seed") == 0 && n == 1) *seed = v[0];
+		else if (wind_spec_set(w, key, v, n) != 1) err = 1;
+		if (err) printf("ERROR: %s: invalid line \"%s\".\n", path, line);
+	}
+	fclose(f);
+	return err ? -1 : 0;
+}
+
+/*
+ *	Field of [spec] around the wind from [angle] degrees at [speed] m/s,
+ *	[dt] seconds per tick, drawn from [seed]
+ */
+void wind_field_init(WindField * w, const WindSpec * spec, float angle, float speed, uint64_t seed, double dt)
+{
+	float dir;
+	int m;
+
+	memset(w, 0, sizeof(WindField));
+	w->spec = *spec;
+	w->angle = angle;
+	w->speed = speed;
+	w->dt = dt;
+	w->tick = -1;
+	sim_rng_init(&w->rng, seed, 1);
+
+	// stationary Ornstein-Uhlenbeck: x(t+dt) = a*x(t) + sd*sqrt(1-a^2)*gauss
+	if (spec->gust_sd > 0) {
+		w->gust_a = exp(-dt / spec->gust_tau);
+		w->gust_b = spec->gust_sd * sqrt(1 - w->gust_a * w->gust_a);
+		w->gust = spec->gust_sd * sim_gauss(&w->rng);
+	}
+	if (spec->dir_sd > 0) {
+		w->veer_a = exp(-dt / spec->dir_tau);
+		w->veer_b = spec->dir_sd * sqrt(1 - w->veer_a * w->veer_a);
+		w->veer = spec->dir_sd * sim_gauss(&w->rng);
+	}
+	w->osc_phase = 2*PI * sim_uniform(&w->rng);
+	for (m = 0; m < WIND_MODES && spec->space_scale > 0; m++) {
+		dir = 2*PI * sim_uniform(&w->rng);
+		w->kx[m] = 2*PI / spec->space_scale * sin(dir);
+		w->ky[m] = 2*PI / spec->space_scale * cos(dir);
+		w->phase[m] = 2*PI * sim_uniform(&w->rng);
+	}
+}
+
+/*
+ *	Advance the processes to [tick] and compute the common part.
+ *	Earlier ticks keep the last state.
+ */
+void wind_field_advance(WindField * w, int64_t tick)
+{
+	const WindSpec * s = &w->spec;
+	double t;
+
+	if (tick <= w->tick) return;
+	while (w->tick < tick) {
+		w->tick++;
+		if (w->tick == 0) continue;	// the initial state
+		if (s->gust_sd > 0) w->gust = w->gust_a * w->gust + w->gust_b * sim_gauss(&w->rng);
+		if (s->dir_sd > 0) w->veer = w->veer_a * w->veer + w->veer_b * sim_gauss(&w->rng);
+	}
+	t = tick * w->dt;
+	w->tick_angle = w->angle + w->veer + s->shift_rate * t + (t >= s->shift_time ? s->shift : 0);
+	if (s->osc_amp != 0) w->tick_angle += s->osc_amp * sin(2*PI * t / s->osc_period + w->osc_phase);
+	w->tick_speed = w->speed + w->gust;
+}
+
+/*
+ *	Wind direction [degrees, around the mean, not wrapped] and speed [m/s]
+ *	at [tick], [lat] [lon]
+ */
+void wind_field_at(WindField * w, int64_t tick, float lat, float lon, float * angle, float * speed)
+{
+	const WindSpec * s = &w->spec;
+	double x, y, drift, u = 0, v = 0;
+	int m;
+
+	wind_field_advance(w, tick);
+	*angle = w->tick_angle;
+	*speed = w->tick_speed;
+
+	// waves frozen in the mean wind, which blows towards angle+180
+	if (s->space_dir != 0 || s->space_speed != 0) {
+		drift = w->speed * tick * w->dt;
+		x = (double)lon * CONVLON + drift * sin(w->angle*PI/180);
+		y = (double)lat * CONVLAT + drift * cos(w->angle*PI/180);
+		for (m = 0; m < WIND_MODES; m++) {
+			u += sin(w->kx[m]*x + w->ky[m]*y + w->phase[m]);
+			v += cos(w->kx[m]*x + w->ky[m]*y + w->phase[m]);
+		}
+		*angle += s->space_dir * u / sqrt(WIND_MODES/2.0);
+		*speed += s->space_speed * v / sqrt(WIND_MODES/2.0);
+	}
+	if (*speed < 0) *speed = 0;
+}
@@ -0,0 +1,112 @@
+/*
+ *	SPSC RING
+ *
+ *	Bounded single-producer/single-consumer queue of fixed-size records,
+ *	used to pass data between the controller threads without locks.
+ *	Only the producer writes [head] and only the consumer writes [tail].
+ *
+ *	A record can be filled in place: spsc_reserve() returns the next free
+ *	slot (NULL when the ring is full, the record is then counted as dropped)
+ *	and spsc_commit() makes it visible to the consumer. spsc_push() copies a
+ *	record. On the consumer side, spsc_peek()/spsc_release() or spsc_pop().
+ *
+ *	Neither side ever blocks: a producer that finds the ring full drops the
+ *	record. [high_water] is the largest number of records seen queued.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+	volatile uint32_t head;		// records committed so far (producer)
+	volatile uint32_t tail;		// records released so far (consumer)
+	uint32_t capacity;		// power of two
+	uint32_t size;			// bytes per record
+	char * buf;
+	uint32_t high_water;		// statistics, written by the producer
+	uint64_t pushed, dropped;
+} SpscRing;
+
+
+/*
+ *	Allocate a ring of [capacity] records of [size] bytes (capacity is
+ *	rounded up to a power of two). Return -1 on error.
+ */
+int spsc_init(SpscRing * r, uint32_t size, uint32_t capacity)
+{
+	uint32_t c = 1;
+
+	memset(r, 0, sizeof(SpscRing));
+	while (c < capacity) c <<= 1;
+	r->buf = calloc(c, size);
+	if (r->buf == NULL) return -1;
+	r->capacity = c;
+	r->size = size;
+	return 0;
+}
+
+static inline uint32_t spsc_count(const SpscRing * r)
+{
+	return r->head - r->tail;
+}
+
+void * spsc_reserve(SpscRing * r)
+{
+	if (r->head - r->tail >= r->capacity) {
+		r->dropped++;
+		return NULL;
+	}
+	return r->buf + (size_t)(r->head & (r->capacity-1)) * r->size;
+}
+
+void spsc_commit(SpscRing * r)
+{
+	uint32_t n;
+
+	__sync_synchronize();		// the record is written before [head] moves
+	r->head++;
+	r->pushed++;
+	n = r->head - r->tail;
+	if (n > r->high_water) r->high_water = n;
+}
+
+int spsc_push(SpscRing * r, const void * rec)
+{
+	void * slot = spsc_reserve(r);
+	if (slot == NULL) return -1;
+	memcpy(slot, rec, r->size);
+	spsc_commit(r);
+	return 0;
+}
+
+/*
+ *	Oldest record of the ring, NULL if empty. It stays valid until spsc_release().
+ */
+void * spsc_peek(SpscRing * r)
+{
+	if (r->head == r->tail) return NULL;
+	__sync_synchronize();		// [head] is read before the record
+	return r->buf + (size_t)(r->tail & (r->capacity-1)) * r->size;
+}
+
+void spsc_release(SpscRing * r)
+{
+	__sync_synchronize();		// the record is read before the slot is given back
+	r->tail++;
+}
+
+int spsc_pop(SpscRing * r, void * rec)
+{
+	void * slot = spsc_peek(r);
+	if (slot == NULL) return -1;
+	memcpy(rec, slot, r->size);
+	spsc_release(r);
+	return 0;
+}
+
+void spsc_report(const SpscRing * r, const char * name, FILE * out)
+{
+	fprintf(out, "%-10s queued %4u/%-4u high-water %4u  pushed %10llu  dropped %llu\n", name,
+		spsc_count(r), r->capacity, r->high_water, (unsigned long long)r->pushed, (unsigned long long)r->dropped);
+}
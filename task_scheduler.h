@@ -0,0 +1,160 @@
+/*
+ *	TASK SCHEDULER (rate groups)
+ *
+ *	Run each stage of the controller at its own period from a single timebase.
+ *	The base tick of the LoopTimer is the greatest common divisor of the task
+ *	periods, a task runs every [divisor] base ticks. Tasks due on the same tick
+ *	run in the order they were added.
+ *
+ *	The execution time of every task is recorded (mean, max and a log2
+ *	histogram), so a rate can be raised without guessing its cost.
+ *
+ *	Without the timer (tasks_plan() and tasks_run()) the ticks run back to
+ *	back: [tick] * [base_us] is then the virtual time of a headless run.
+ */
+
+#define TASKS_MAX	8
+
+typedef void (*task_function)(void);
+
+typedef struct {
+	const char * name;
+	long period_us;
+	int  divisor;			// run every [divisor] base ticks
+	task_function run;
+	uint64_t runs;
+	long exec_max_us;
+	uint64_t exec_sum_us;
+	uint32_t exec_hist[LOOP_HIST_BINS];
+} Task;
+
+typedef struct {
+	LoopTimer timer;
+	long base_us;
+	uint64_t tick;
+	uint64_t wait_errors;		// timer waits that failed, a base tick slept instead
+	int  ntasks;
+	Task tasks[TASKS_MAX];
+} TaskScheduler;
+
+
+long gcd_long(long a, long b)
+{
+	long r;
+	while (b != 0) { r = a % b; a = b; b = r; }
+	return a;
+}
+
+/*
+ *	Add a task running every [period_us] microseconds. Return -1 if full.
+ */
+int tasks_add(TaskScheduler * s, const char * name, long period_us, task_function run)
+{
+	Task * t;
+
+	if (s->ntasks >= TASKS_MAX || period_us <= 0) return -1;
+	t = &s->tasks[s->ntasks++];
+	memset(t, 0, sizeof(Task));
+	t->name = name;
+	t->period_us = period_us;
+	t->run = run;
+	return 0;
+}
+
+/*
+ *	Compute the base tick, without the timer. Return -1 if there is no task.
+ */
+int tasks_plan(TaskScheduler * s)
+{
+	int n;
+
+	if (s->ntasks == 0) return -1;
+	s->base_us = s->tasks[0].period_us;
+	for (n = 1; n < s->ntasks; n++) s->base_us = gcd_long(s->base_us, s->tasks[n].period_us);
+	for (n = 0; n < s->ntasks; n++) s->tasks[n].divisor = s->tasks[n].period_us / s->base_us;
+	s->tick = 0;
+	return 0;
+}
+
+/*
+ *	Compute the base tick and start the timer. Return -1 on error.
+ *	Extra file descriptors can be added to [s->timer] after this call.
+ */
+int tasks_start(TaskScheduler * s)
+{
+	if (tasks_plan(s) < 0) return -1;
+	return looptimer_init(&s->timer, s->base_us*1000L);
+}
+
+/*
+ *	Run the tasks due on the current base tick, then go to the next one
+ */
+void tasks_run(TaskScheduler * s)
+{
+	struct timespec t0, t1;
+	long exec;
+	int  n;
+
+	for (n = 0; n < s->ntasks; n++) {
+		Task * t = &s->tasks[n];
+		if (s->tick % t->divisor != 0) continue;
+
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		t->run();
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+
+		exec = timespec_diff_us(&t1, &t0);
+		t->runs++;
+		t->exec_sum_us += exec;
+		if (exec > t->exec_max_us) t->exec_max_us = exec;
+		t->exec_hist[loop_hist_bin(exec)]++;
+	}
+	s->tick++;
+}
+
+/*
+ *	Wait for the next base tick and run the tasks that are due.
+ *	When deadlines were missed, the skipped ticks are not replayed but
+ *	counted in [tick], so the tasks stay in phase with the clock. If the
+ *	timer can't be waited on, a base tick is slept instead (no busy loop
+ *	at real-time priority).
+ */
+void tasks_tick(TaskScheduler * s)
+{
+	struct timespec period = { s->base_us / 1000000, s->base_us % 1000000 * 1000 };
+	int expirations = looptimer_wait(&s->timer);
+
+	if (expirations < 0) {
+		s->wait_errors++;
+		nanosleep(&period, NULL);
+		expirations = 1;
+	}
+	s->tick += expirations - 1;
+	tasks_run(s);
+	looptimer_done(&s->timer);
+}
+
+/*
+ *	Print the timer statistics and the execution time of each task
+ */
+void tasks_report(TaskScheduler * s, FILE * out)
+{
+	int n, b;
+
+	if (s->timer.period_ns > 0) looptimer_report(&s->timer, out);
+	if (s->wait_errors) fprintf(out, "timer wait errors: %llu\n", (unsigned long long)s->wait_errors);
+	fprintf(out, "%-10s %8s %10s %10s %10s\n", "task", "Hz", "runs", "mean us", "max us");
+	for (n = 0; n < s->ntasks; n++) {
+		Task * t = &s->tasks[n];
+		fprintf(out, "%-10s %8.2f %10llu %10llu %10ld\n", t->name, 1000000.0/t->period_us,
+			(unsigned long long)t->runs, (unsigned long long)(t->runs ? t->exec_sum_us/t->runs : 0), t->exec_max_us);
+	}
+	for (n = 0; n < s->ntasks; n++) {
+		Task * t = &s->tasks[n];
+		fprintf(out, "%s execution histogram (< us: count):", t->name);
+		for (b = 0; b < LOOP_HIST_BINS; b++)
+			if (t->exec_hist[b]) fprintf(out, " %ld:%u", 1L << b, t->exec_hist[b]);
+		fprintf(out, "\n");
+	}
+	fflush(out);
+}
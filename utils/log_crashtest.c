@@ -0,0 +1,230 @@
+/*
+ *	LOG_CRASHTEST
+ *
+ *	Fault injection for the log files (see binlog.h). In each run a child
+ *	process writes records as fast as it can through a LogWriter and is
+ *	killed (SIGKILL) at a random time. Then a power loss is simulated on
+ *	the file: what was written after the last fdatasync is cut at a random
+ *	point, garbled or followed by zeros. log_recover() must leave a file
+ *	holding every synced record, each one intact, and nothing else.
+ *
+ *	log_crashtest [-n runs] [-m framed|plain|packed] [-L max_loss_ms] [-d dir] [-s seed]
+ *
+ *	One line per run (records written and synced at the kill, damage,
+ *	records kept, check), then the throughput and the worst loss window.
+ *	Plain and packed files have no checksum: garbled tails are expected to
+ *	fail there, that is what the framed format is for.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "../binlog.h"
+
+#define WORDS	16
+
+enum { MODE_PLAIN, MODE_FRAMED, MODE_PACKED };
+enum { DAMAGE_NONE, DAMAGE_CUT, DAMAGE_GARBLE, DAMAGE_ZEROS };
+const char * mode_names[] = { "plain", "framed", "packed" };
+const char * damage_names[] = { "none", "cut", "garble", "zeros" };
+
+typedef struct {
+	uint32_t seq, time;
+	uint32_t counter[6];
+	float    value[8];
+} CrashRecord;
+
+const LogColumn crash_columns[] = {
+	LOG_COLUMN(CrashRecord, seq, LOG_U32, 0),
+	LOG_COLUMN(CrashRecord, time, LOG_U32, 0),
+	LOG_COLUMN(CrashRecord, counter[0], LOG_U32, 0),
+	LOG_COLUMN(CrashRecord, counter[1], LOG_U32, 0),
+	LOG_COLUMN(CrashRecord, counter[2], LOG_U32, 0),
+	LOG_COLUMN(CrashRecord, counter[3], LOG_U32, 0),
+	LOG_COLUMN(CrashRecord, counter[4], LOG_U32, 0),
+	LOG_COLUMN(CrashRecord, counter[5], LOG_U32, 0),
+	LOG_COLUMN(CrashRecord, value[0], LOG_F32, 3),
+	LOG_COLUMN(CrashRecord, value[1], LOG_F32, 3),
+	LOG_COLUMN(CrashRecord, value[2], LOG_F32, 3),
+	LOG_COLUMN(CrashRecord, value[3], LOG_F32, 3),
+	LOG_COLUMN(CrashRecord, value[4], LOG_F32, 3),
+	LOG_COLUMN(CrashRecord, value[5], LOG_F32, 3),
+	LOG_COLUMN(CrashRecord, value[6], LOG_F32, 3),
+	LOG_COLUMN(CrashRecord, value[7], LOG_F32, 3),
+};
+const LogSchema crash_schema = { "crashtest", crash_columns, sizeof(crash_columns)/sizeof(LogColumn), sizeof(CrashRecord), 1 };
+
+// published by the writer after every record
+typedef struct {
+	volatile uint64_t written;
+	volatile uint64_t synced;		// records on the disk
+	volatile uint64_t synced_bytes;		// file bytes on the disk
+	volatile int64_t loss_max_ms;
+	volatile int64_t start_ms;
+} Shared;
+
+
+/*
+ *	Record [k], the same in the writer and the checker
+ */
+void make_record(CrashRecord * r, uint64_t k)
+{
+	int j;
+
+	memset(r, 0, sizeof(CrashRecord));
+	r->seq = k;
+	r->time = 1700000000 + k / 100;
+	for (j = 0; j < 6; j++) r->counter[j] = j < 3 ? k >> (4*j) : j;
+	for (j = 0; j < 8; j++) r->value[j] = (float)(k % 1000) * 0.25f + j;
+}
+
+void writer_child(const char * path, int mode, int max_loss_ms, Shared * sh)
+{
+	LogWriter w;
+	CrashRecord r;
+	uint64_t k;
+
+	if (log_writer_init(&w, &crash_schema) < 0) exit(1);
+	w.packed = mode == MODE_PACKED;
+	w.framed = mode == MODE_FRAMED;
+	w.sync = LOG_SYNC_PERIOD;
+	w.sync_ms = max_loss_ms;
+	w.max_loss_ms = max_loss_ms;
+	if (log_open(&w, path) < 0) exit(1);
+	sh->synced_bytes = w.file_off + w.flushed;
+	sh->start_ms = log_now_ms();
+	for (k = 0; ; k++) {
+		make_record(&r, k);
+		log_write(&w, &r);
+		if (w.synced_records != sh->synced) {
+			sh->synced_bytes = w.file_off + w.flushed;
+			sh->synced = w.synced_records;
+		}
+		sh->loss_max_ms = w.loss_max_ms;
+		sh->written = k + 1;
+	}
+}
+
+/*
+ *	Power loss on [path]: the bytes after [durable] may be anything
+ */
+void damage_file(const char * path, off_t durable, int damage, unsigned int * seed)
+{
+	struct stat st;
+	off_t cut, pos;
+	uint8_t junk;
+	int fd, k;
+
+	fd = open(path, O_RDWR);
+	if (fd < 0 || fstat(fd, &st) < 0) exit(1);
+	if (damage != DAMAGE_NONE && st.st_size > durable) {
+		cut = durable + rand_r(seed) % (st.st_size - durable + 1);
+		if (ftruncate(fd, cut) < 0) exit(1);
+		if (damage == DAMAGE_GARBLE && cut > durable) {
+			for (k = 0; k < 64; k++) {
+				pos = durable + rand_r(seed) % (cut - durable);
+				junk = rand_r(seed);
+				if (pwrite(fd, &junk, 1, pos) != 1) exit(1);
+			}
+		}
+		if (damage == DAMAGE_ZEROS && ftruncate(fd, cut + LOG_BLOCK * (1 + rand_r(seed) % 3)) < 0) exit(1);
+	}
+	close(fd);
+}
+
+/*
+ *	Every record of the recovered file is record k, and there are at least
+ *	[synced]. Return the records read, -1 if one is wrong.
+ */
+int64_t check_file(const char * path, uint64_t synced)
+{
+	LogReader r;
+	CrashRecord got, want;
+	LogRecovery again;
+	uint64_t k;
+
+	if (log_reader_open(&r, path) < 0) return -1;
+	for (k = 0; log_reader_next(&r, &got) == 0; k++) {
+		make_record(&want, k);
+		if (memcmp(&got, &want, sizeof(CrashRecord)) != 0) break;
+	}
+	if (k != r.records || k < synced) {
+		log_reader_close(&r);
+		return -1;
+	}
+	log_reader_close(&r);
+	if (log_recover(path, &again) != 0) return -1;		// nothing left to cut
+	return k;
+}
+
+int main(int argc, char ** argv)
+{
+	const char * dir = "/tmp";
+	char path[256];
+	unsigned int seed = time(NULL);
+	int runs = 20, mode = MODE_FRAMED, max_loss_ms = 50, failed = 0, opt, run, damage, status;
+	double records = 0, seconds = 0;
+	int64_t loss_max = 0, kept;
+	LogRecovery rec;
+	Shared * sh;
+	pid_t pid;
+
+	while ((opt = getopt(argc, argv, "n:m:L:d:s:")) != -1) {
+		switch (opt) {
+			case 'n': runs = atoi(optarg); break;
+			case 'm':
+				for (mode = 0; mode < 3 && strcmp(optarg, mode_names[mode]) != 0; mode++);
+				break;
+			case 'L': max_loss_ms = atoi(optarg); break;
+			case 'd': dir = optarg; break;
+			case 's': seed = atoi(optarg); break;
+			default: mode = -1;
+		}
+	}
+	if (runs <= 0 || mode < 0 || mode > 2 || max_loss_ms <= 0) {
+		fprintf(stderr, "usage: %s [-n runs] [-m framed|plain|packed] [-L max_loss_ms] [-d dir] [-s seed]\n", argv[0]);
+		exit(1);
+	}
+	sh = mmap(NULL, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (sh == MAP_FAILED) exit(1);
+	snprintf(path, sizeof(path), "%s/crashtest_%d", dir, (int)getpid());
+	printf("mode %s, max loss %d ms, seed %u\n", mode_names[mode], max_loss_ms, seed);
+	printf("%4s %10s %10s %7s %10s %10s  %s\n", "run", "written", "synced", "damage", "cut bytes", "kept", "check");
+
+	for (run = 0; run < runs; run++) {
+		memset(sh, 0, sizeof(Shared));
+		pid = fork();
+		if (pid < 0) exit(1);
+		if (pid == 0) writer_child(path, mode, max_loss_ms, sh);
+
+		usleep(20000 + rand_r(&seed) % 200000);
+		kill(pid, SIGKILL);
+		waitpid(pid, &status, 0);
+		if (sh->start_ms == 0) {
+			fprintf(stderr, "ERROR: the writer could not create %s.\n", path);
+			exit(1);
+		}
+		records += sh->written;
+		seconds += (log_now_ms() - sh->start_ms) / 1000.0;
+		if (sh->loss_max_ms > loss_max) loss_max = sh->loss_max_ms;
+
+		damage = rand_r(&seed) % 4;
+		damage_file(path, sh->synced_bytes, damage, &seed);
+		rec.removed = 0;
+		kept = log_recover(path, &rec) < 0 ? -1 : check_file(path, sh->synced);
+		if (kept < 0) failed++;
+		printf("%4d %10llu %10llu %7s %10lld %10lld  %s\n", run, (unsigned long long)sh->written, (unsigned long long)sh->synced,
+			damage_names[damage], (long long)rec.removed, (long long)kept, kept < 0 ? "FAILED" : "ok");
+	}
+	unlink(path);
+	strcat(path, ".idx");
+	unlink(path);
+
+	printf("%d runs, %d failed; %.0f records/s (%.1f MB/s) with fdatasync; worst loss window %lld ms (bound %d ms)\n",
+		runs, failed, records / seconds, records * sizeof(CrashRecord) / seconds / 1e6, (long long)loss_max, max_loss_ms);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,121 @@
+/*
+ *	LOGCAT
+ *
+ *	Print a binary log file of the controller (see binlog.h) as CSV: the
+ *	column names and the text precision come from the file header. Packed
+ *	files are decoded block by block while they are printed.
+ *
+ *	logcat [-n last_records] [-t time] [-L] [-q] [-s] <logfile>
+ *		-n  only the last records
+ *		-t  from the first record at [time]: unix time, or seconds since
+ *		    the first record when smaller than a day (-t 2820: minute 47),
+ *		    found through the sidecar index (see log_index.h)
+ *		-L  the latest record written, from the index (replaces tail -1)
+ *		-q  no header line
+ *		-s  print the schema instead of the records
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../binlog.h"
+#include "../log_index.h"
+
+void usage() {
+	fprintf(stderr, "usage: logcat [-n last_records] [-t time] [-L] [-q] [-s] <logfile>\n");
+	exit(1);
+}
+
+void print_record(const LogReader * r, const char * rec)
+{
+	char field[64];
+	int c;
+
+	for (c = 0; c < (int)r->header.columns; c++) {
+		if (r->column[c].offset + 4 > r->header.record_size) continue;
+		log_format_field(field, sizeof(field), &r->column[c], rec);
+		printf("%s%s", c ? "," : "", field);
+	}
+	printf("\n");
+}
+
+int main(int argc, char ** argv) {
+
+	static const char * types[] = { "u32", "i32", "f32" };
+	LogReader r;
+	LogIndex x;
+	char * rec;
+	long last = -1, from = -1;
+	int  header = 1, schema = 0, latest = 0, opt, c;
+	uint32_t t0;
+	uint64_t k, seq;
+
+	while ((opt = getopt(argc, argv, "n:t:Lqs")) != -1) {
+		switch (opt) {
+			case 'n': last = atol(optarg); break;
+			case 't': from = atol(optarg); break;
+			case 'L': latest = 1; break;
+			case 'q': header = 0; break;
+			case 's': schema = 1; break;
+			default: usage();
+		}
+	}
+	if (optind != argc-1) usage();
+
+	if (log_reader_open(&r, argv[optind]) < 0) {
+		fprintf(stderr, "ERROR: %s is not a binary log file.\n", argv[optind]);
+		exit(1);
+	}
+
+	if (schema) {
+		printf("schema %.32s, record %u bytes, %llu records%s\n", r.header.name, r.header.record_size, (unsigned long long)r.records,
+			r.header.flags & LOG_FLAG_PACKED ? ", packed" : r.header.flags & LOG_FLAG_FRAMED ? ", framed" : "");
+		for (c = 0; c < (int)r.header.columns; c++)
+			printf("%4u  %-24.24s %s %d\n", r.column[c].offset, r.column[c].name, r.column[c].type <= LOG_F32 ? types[r.column[c].type] : "?", r.column[c].precision);
+		log_reader_close(&r);
+		return 0;
+	}
+
+	if (header) {
+		for (c = 0; c < (int)r.header.columns; c++) printf("%s%.24s", c ? "," : "", r.column[c].name);
+		printf("\n");
+	}
+
+	rec = malloc(r.header.record_size);
+	if (rec == NULL) exit(1);
+	if (latest) {
+		// latest record from the index (of the same schema), else the last one of the file
+		if (logidx_open(&x, argv[optind]) == 0) {
+			c = x.header.record_size == r.header.record_size ? logidx_latest(&x, rec, &seq) : -1;
+			logidx_close(&x);
+			if (c == 0) {
+				print_record(&r, rec);
+				free(rec);
+				log_reader_close(&r);
+				return 0;
+			}
+		}
+		last = 1;
+	}
+
+	k = (last >= 0 && (uint64_t)last < r.records) ? r.records - last : 0;
+	if (k > 0) log_reader_seek(&r, k);
+	if (from >= 0) {
+		if (logidx_open(&x, argv[optind]) < 0) {
+			fprintf(stderr, "ERROR: %s has no index.\n", argv[optind]);
+			exit(1);
+		}
+		if (from < 86400 && log_reader_next(&r, rec) == 0) {
+			memcpy(&t0, rec + x.header.time_offset, 4);
+			from += t0;
+		}
+		c = log_reader_seek_time(&r, &x, from);
+		logidx_close(&x);
+		if (c < 0) return 0;
+	}
+	while (log_reader_next(&r, rec) == 0) print_record(&r, rec);
+	free(rec);
+	log_reader_close(&r);
+	return 0;
+}
@@ -0,0 +1,286 @@
+/*
+ *	LOGCOL
+ *
+ *	Convert log files into the columnar archive format of log_columnar.h,
+ *	for utils/logquery. The inputs are the binary log files (see binlog.h)
+ *	or the CSV archives written before them (sailboat-log/thesis/thesis_*):
+ *	for a CSV the column types come from the values (integers or floats,
+ *	decimals kept as text precision), MCU_timestamp is a LOG_U32.
+ *	Integer columns with at most COL_DICT_MAX distinct values are
+ *	dictionary-encoded.
+ *
+ *	logcol [-o output_dir] <logfile>...
+ *		each input gives [output_dir or its own dir]/[name].col
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <libgen.h>
+#include "../binlog.h"
+#include "../log_columnar.h"
+
+#define LINE_LEN	8192
+#define MAX_COLUMNS	256
+
+typedef struct {
+	int columns;
+	uint64_t rows, capacity;
+	char name[MAX_COLUMNS][LOG_NAME_LEN];
+	int type[MAX_COLUMNS];
+	int precision[MAX_COLUMNS];
+	double * value[MAX_COLUMNS];
+} Table;
+
+
+void table_free(Table * t)
+{
+	int c;
+	for (c = 0; c < t->columns; c++) free(t->value[c]);
+	memset(t, 0, sizeof(Table));
+}
+
+int table_grow(Table * t)
+{
+	double * v;
+	int c;
+
+	if (t->rows < t->capacity) return 0;
+	t->capacity = t->capacity ? t->capacity * 2 : 65536;
+	for (c = 0; c < t->columns; c++) {
+		v = realloc(t->value[c], t->capacity * sizeof(double));
+		if (v == NULL) return -1;
+		t->value[c] = v;
+	}
+	return 0;
+}
+
+/*
+ *	Binary log: the schema gives the columns
+ */
+int load_binary(Table * t, const char * path)
+{
+	LogReader r;
+	char * rec;
+	int c;
+
+	if (log_reader_open(&r, path) < 0) return -1;
+	t->columns = r.header.columns < MAX_COLUMNS ? r.header.columns : MAX_COLUMNS;
+	for (c = 0; c < t->columns; c++) {
+		snprintf(t->name[c], LOG_NAME_LEN, "%.*s", LOG_NAME_LEN-1, r.column[c].name);
+		t->type[c] = r.column[c].type;
+		t->precision[c] = r.column[c].precision;
+	}
+	rec = malloc(r.header.record_size);
+	while (rec != NULL && log_reader_next(&r, rec) == 0) {
+		if (table_grow(t) < 0) break;
+		for (c = 0; c < t->columns; c++)
+			t->value[c][t->rows] = r.column[c].offset + 4 <= r.header.record_size ? col_value(t->type[c], rec + r.column[c].offset) : 0;
+		t->rows++;
+	}
+	free(rec);
+	log_reader_close(&r);
+	return 0;
+}
+
+/*
+ *	CSV archive: header line, then the rows. Incomplete rows (last line of
+ *	a log cut by a power loss) are skipped.
+ */
+int load_csv(Table * t, const char * path)
+{
+	FILE * f = fopen(path, "r");
+	static char line[LINE_LEN];
+	char * field, * save, * end;
+	int is_int[MAX_COLUMNS], c, decimals;
+	double v;
+
+	if (f == NULL) return -1;
+	if (fgets(line, sizeof(line), f) == NULL) { fclose(f); return -1; }
+	line[strcspn(line, "\r\n")] = '\0';
+	for (field = strtok_r(line, ",", &save); field != NULL && t->columns < MAX_COLUMNS; field = strtok_r(NULL, ",", &save)) {
+		snprintf(t->name[t->columns], LOG_NAME_LEN, "%s", field);
+		is_int[t->columns] = 1;
+		t->precision[t->columns] = 0;
+		t->columns++;
+	}
+	if (t->columns == 0) { fclose(f); return -1; }
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		line[strcspn(line, "\r\n")] = '\0';
+		if (table_grow(t) < 0) break;
+		c = 0;
+		for (field = strtok_r(line, ",", &save); field != NULL && c < t->columns; field = strtok_r(NULL, ",", &save), c++) {
+			v = strtod(field, &end);
+			if (end == field) break;
+			t->value[c][t->rows] = v;
+			if (strchr(field, '.') != NULL || strchr(field, 'e') != NULL || strchr(field, 'n') != NULL) {
+				is_int[c] = 0;
+				decimals = strchr(field, '.') ? strlen(strchr(field, '.') + 1) : 0;
+				if (decimals > t->precision[c]) t->precision[c] = decimals;
+			}
+		}
+		if (c == t->columns && field == NULL) t->rows++;
+	}
+	fclose(f);
+
+	for (c = 0; c < t->columns; c++) {
+		if (strcmp(t->name[c], "MCU_timestamp") == 0) t->type[c] = LOG_U32;
+		else t->type[c] = is_int[c] ? LOG_I32 : LOG_F32;
+		if (is_int[c]) t->precision[c] = 0;
+	}
+	return 0;
+}
+
+/*
+ *	Values as stored in the file (floats rounded), for exact block statistics
+ */
+void store_value(char * p, int type, double v)
+{
+	uint32_t u = v;
+	int32_t  i = v;
+	float    f = v;
+
+	if (type == LOG_U32) memcpy(p, &u, 4);
+	else if (type == LOG_I32) memcpy(p, &i, 4);
+	else memcpy(p, &f, 4);
+}
+
+/*
+ *	Dictionary of column [c] if it is an integer column with few values.
+ *	Return its size, 0 if the column stays plain.
+ */
+int make_dict(const Table * t, int c, double * dict)
+{
+	uint64_t r;
+	int n = 0, k;
+
+	if (t->type[c] == LOG_F32) return 0;
+	for (r = 0; r < t->rows; r++) {
+		for (k = 0; k < n && dict[k] != t->value[c][r]; k++);
+		if (k < n) continue;
+		if (n == COL_DICT_MAX) return 0;
+		dict[n++] = t->value[c][r];
+	}
+	return n;
+}
+
+int write_col(const Table * t, const char * out, const char * source)
+{
+	ColFileHeader h;
+	ColColumn col[MAX_COLUMNS];
+	ColBlockStats * stats;
+	static double dict[MAX_COLUMNS][COL_DICT_MAX];
+	char * data, cell[4];
+	uint32_t blocks = (t->rows + COL_BLOCK_ROWS - 1) / COL_BLOCK_ROWS, b;
+	uint64_t off, r, width, len;
+	double v;
+	int c, k, fd, err = 0;
+
+	memset(&h, 0, sizeof(h));
+	h.magic = COL_MAGIC;
+	h.version = COL_VERSION;
+	h.rows = t->rows;
+	h.columns = t->columns;
+	h.block_rows = COL_BLOCK_ROWS;
+	h.blocks = blocks;
+	h.created = time(NULL);
+	snprintf(h.source, sizeof(h.source), "%s", source);
+
+	// layout
+	memset(col, 0, sizeof(col));
+	off = col_align(sizeof(ColFileHeader) + t->columns * sizeof(ColColumn));
+	for (c = 0; c < t->columns; c++) {
+		memcpy(col[c].name, t->name[c], LOG_NAME_LEN);
+		col[c].type = t->type[c];
+		col[c].precision = t->precision[c];
+		col[c].dict_size = make_dict(t, c, dict[c]);
+		col[c].encoding = col[c].dict_size > 0 ? COL_DICT : COL_PLAIN;
+		col[c].stats_off = off;
+		off += blocks * sizeof(ColBlockStats);
+		col[c].dict_off = off;
+		off += col[c].dict_size * 4;
+		col[c].data_off = off = col_align(off);
+		off = col_align(off + t->rows * (col[c].encoding == COL_DICT ? 1 : 4));
+	}
+
+	fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) return -1;
+	if (pwrite(fd, &h, sizeof(h), 0) != sizeof(h)
+		|| pwrite(fd, col, t->columns * sizeof(ColColumn), sizeof(h)) != (ssize_t)(t->columns * sizeof(ColColumn))) err = -1;
+
+	stats = malloc((blocks + 1) * sizeof(ColBlockStats));
+	data = malloc(t->rows * 4 + 1);
+	for (c = 0; c < t->columns && err == 0 && stats != NULL && data != NULL; c++) {
+		width = col[c].encoding == COL_DICT ? 1 : 4;
+		for (b = 0; b < blocks; b++) {
+			stats[b].min = 1e300;
+			stats[b].max = -1e300;
+		}
+		for (r = 0; r < t->rows; r++) {
+			store_value(cell, t->type[c], t->value[c][r]);
+			v = col_value(t->type[c], cell);
+			b = r / COL_BLOCK_ROWS;
+			if (v < stats[b].min) stats[b].min = v;
+			if (v > stats[b].max) stats[b].max = v;
+			if (width == 1) {
+				for (k = 0; dict[c][k] != t->value[c][r]; k++);
+				data[r] = k;
+			}
+			else memcpy(data + r*4, cell, 4);
+		}
+		for (k = 0; k < col[c].dict_size; k++) {
+			store_value(cell, t->type[c], dict[c][k]);
+			err |= pwrite(fd, cell, 4, col[c].dict_off + 4*k) != 4;
+		}
+		len = t->rows * width;
+		err |= pwrite(fd, stats, blocks * sizeof(ColBlockStats), col[c].stats_off) != (ssize_t)(blocks * sizeof(ColBlockStats));
+		err |= pwrite(fd, data, len, col[c].data_off) != (ssize_t)len;
+	}
+	if (stats == NULL || data == NULL || ftruncate(fd, off) < 0) err = -1;
+	free(stats);
+	free(data);
+	close(fd);
+	return err ? -1 : 0;
+}
+
+int main(int argc, char ** argv) {
+
+	const char * outdir = NULL;
+	char out[512], in[512], dir[512];
+	Table t;
+	int opt, f, failed = 0;
+
+	while ((opt = getopt(argc, argv, "o:")) != -1) {
+		switch (opt) {
+			case 'o': outdir = optarg; break;
+			default:
+				fprintf(stderr, "usage: %s [-o output_dir] <logfile>...\n", argv[0]);
+				exit(1);
+		}
+	}
+	if (optind >= argc) {
+		fprintf(stderr, "usage: %s [-o output_dir] <logfile>...\n", argv[0]);
+		exit(1);
+	}
+
+	memset(&t, 0, sizeof(t));
+	for (f = optind; f < argc; f++) {
+		snprintf(in, sizeof(in), "%s", argv[f]);
+		snprintf(dir, sizeof(dir), "%s", argv[f]);
+		snprintf(out, sizeof(out), "%s/%s.col", outdir ? outdir : dirname(dir), basename(in));
+
+		if (load_binary(&t, argv[f]) < 0 && load_csv(&t, argv[f]) < 0) {
+			printf("WARNING: Cannot read %s.\n", argv[f]);
+			failed++;
+		}
+		else if (write_col(&t, out, basename(in)) < 0) {
+			printf("WARNING: Cannot write %s.\n", out);
+			failed++;
+		}
+		else printf("%s: %llu rows, %d columns -> %s\n", argv[f], (unsigned long long)t.rows, t.columns, out);
+		table_free(&t);
+	}
+	return failed ? 1 : 0;
+}
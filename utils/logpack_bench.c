@@ -0,0 +1,150 @@
+/*
+ *	LOGPACK_BENCH
+ *
+ *	Size and CPU cost of the packed log format (see binlog.h) on real log
+ *	files: the records of each file are packed into blocks as the logger
+ *	does, then decoded and compared with the originals.
+ *
+ *	logpack_bench [-r repetitions] <logfile>...
+ *
+ *	For each file: records, raw and packed bytes per record (block headers
+ *	and padding included), ratio, ns per record to pack and to unpack.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../binlog.h"
+
+double now_ns()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec*1e9 + t.tv_nsec;
+}
+
+/*
+ *	Pack [n] records into LOG_BLOCK blocks of [out] like log_write_packed().
+ *	Return the size of the packed data, as in a file: whole blocks and the
+ *	used part of the last one.
+ */
+size_t pack_blocks(uint8_t * out, const char * recs, uint64_t n, uint32_t size, const uint8_t * type, char * prev)
+{
+	uint8_t packed[LOG_BLOCK];
+	LogBlockHeader * h = NULL;
+	size_t fill = 0, used = 0, len;
+	uint64_t k;
+
+	for (k = 0; k < n; k++) {
+		len = log_pack_record(packed, recs + k*size, prev, type, size/4);
+		if (used != 0 && used + len > LOG_BLOCK) {
+			fill += LOG_BLOCK;
+			used = 0;
+			memset(prev, 0, size);
+			len = log_pack_record(packed, recs + k*size, prev, type, size/4);
+		}
+		if (used == 0) {
+			h = (LogBlockHeader *)(out + fill);
+			h->records = 0;
+			h->bytes = sizeof(LogBlockHeader);
+			used = sizeof(LogBlockHeader);
+		}
+		memcpy(out + fill + used, packed, len);
+		used += len;
+		h->records++;
+		h->bytes += len;
+		memcpy(prev, recs + k*size, size);
+	}
+	return fill + used;
+}
+
+/*
+ *	Decode the blocks of [in] into [recs]. Return the number of records.
+ */
+uint64_t unpack_blocks(char * recs, const uint8_t * in, size_t bytes, uint32_t size, const uint8_t * type, char * prev)
+{
+	const LogBlockHeader * h;
+	uint64_t n = 0;
+	size_t off, pos;
+	int k, len;
+
+	for (off = 0; off + sizeof(LogBlockHeader) <= bytes; off += LOG_BLOCK) {
+		h = (const LogBlockHeader *)(in + off);
+		memset(prev, 0, size);
+		for (k = 0, pos = sizeof(LogBlockHeader); k < h->records; k++, pos += len) {
+			len = log_unpack_record(in + off + pos, h->bytes - pos, prev, type, size/4);
+			if (len < 0) return n;
+			memcpy(recs + n*size, prev, size);
+			n++;
+		}
+	}
+	return n;
+}
+
+int main(int argc, char ** argv)
+{
+	LogReader r;
+	char * recs, * back, * prev;
+	uint8_t * packed, * type;
+	uint64_t n, k;
+	size_t bytes = 0;
+	double t0, t_pack, t_unpack;
+	int reps = 20, opt, rep, f;
+
+	while ((opt = getopt(argc, argv, "r:")) != -1) {
+		switch (opt) {
+			case 'r': reps = atoi(optarg); break;
+			default:
+				fprintf(stderr, "usage: %s [-r repetitions] <logfile>...\n", argv[0]);
+				exit(1);
+		}
+	}
+	if (optind >= argc || reps <= 0) {
+		fprintf(stderr, "usage: %s [-r repetitions] <logfile>...\n", argv[0]);
+		exit(1);
+	}
+
+	printf("%-32s %8s %8s %8s %7s %10s %10s  %s\n", "file", "records", "raw B/r", "pack B/r", "ratio", "pack ns/r", "unpack ns/r", "check");
+	for (f = optind; f < argc; f++) {
+		if (log_reader_open(&r, argv[f]) < 0) {
+			fprintf(stderr, "WARNING: %s is not a binary log file.\n", argv[f]);
+			continue;
+		}
+		n = r.records;
+		recs = malloc(n * r.header.record_size + 1);
+		back = malloc(n * r.header.record_size + 1);
+		packed = malloc((n + 1) * LOG_BLOCK);		// one block per record at worst
+		prev = malloc(r.header.record_size);
+		type = r.word_type;
+		if (recs == NULL || back == NULL || packed == NULL || prev == NULL) {
+			fprintf(stderr, "ERROR: Not enough memory for %s.\n", argv[f]);
+			exit(1);
+		}
+		for (k = 0; k < n && log_reader_next(&r, recs + k*r.header.record_size) == 0; k++);
+		n = k;
+
+		t0 = now_ns();
+		for (rep = 0; rep < reps; rep++) {
+			memset(prev, 0, r.header.record_size);
+			bytes = pack_blocks(packed, recs, n, r.header.record_size, type, prev);
+		}
+		t_pack = (now_ns() - t0) / reps;
+
+		t0 = now_ns();
+		for (rep = 0; rep < reps; rep++) k = unpack_blocks(back, packed, bytes, r.header.record_size, type, prev);
+		t_unpack = (now_ns() - t0) / reps;
+
+		printf("%-32.32s %8llu %8u %8.1f %6.1fx %10.1f %10.1f  %s\n", argv[f], (unsigned long long)n, r.header.record_size,
+			n ? (double)bytes/n : 0, bytes ? (double)n*r.header.record_size/bytes : 0, n ? t_pack/n : 0, n ? t_unpack/n : 0,
+			k == n && memcmp(recs, back, n*r.header.record_size) == 0 ? "ok" : "MISMATCH");
+
+		free(recs);
+		free(back);
+		free(packed);
+		free(prev);
+		log_reader_close(&r);
+	}
+	return 0;
+}
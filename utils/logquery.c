@@ -0,0 +1,486 @@
+/*
+ *	LOGQUERY
+ *
+ *	Filter, group and aggregate columnar log archives (see logcol and
+ *	log_columnar.h). The blocks of all the files are shared out between
+ *	[threads] workers, each one with its own groups, merged at the end. A
+ *	block whose min/max statistics exclude a filter or the time window is
+ *	skipped without reading its data.
+ *
+ *	logquery [-j threads] [-w filter]... [-t from:to] [-g col[,col...]] [-W seconds]
+ *		 [-a aggregates] <file.col>...
+ *		-w  "column op value", op: < <= > >= == !=, the filters are ANDed
+ *		-t  time window on MCU_timestamp, unix seconds, a side can be empty
+ *		-g  group by these columns (heading_state,sail_state...)
+ *		-W  also group by time windows of [seconds]
+ *		-a  comma separated: count, mean:col, sum:col, min:col, max:col, std:col
+ *		    (default count)
+ *
+ *	Output: CSV, one line per group sorted by group values.
+ *	e.g. logquery -g heading_state -a count,mean:ctri_sail,mean:u_sail,mean:SOG thesis_*.col
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "../binlog.h"
+#include "../log_columnar.h"
+
+#define MAX_FILTERS	16
+#define MAX_GROUPS	4			// group-by columns, the time window is one more key
+#define MAX_AGGS	16
+#define MAX_SLOTS	(MAX_FILTERS + MAX_GROUPS + MAX_AGGS + 1)
+#define TIME_COLUMN	"MCU_timestamp"
+
+enum FilterOp { OP_LT, OP_LE, OP_GT, OP_GE, OP_EQ, OP_NE };
+enum AggKind { AGG_COUNT, AGG_SUM, AGG_MEAN, AGG_MIN, AGG_MAX, AGG_STD };
+
+typedef struct { int slot; int op; double value; } Filter;
+typedef struct { int kind; int slot; char label[48]; } Aggregate;
+
+typedef struct {
+	uint64_t n;
+	double sum, sum2, min, max;
+} Acc;
+
+typedef struct {
+	int used;
+	double key[MAX_GROUPS + 1];
+	uint64_t count;
+	Acc acc[MAX_AGGS];
+} Group;
+
+typedef struct {
+	Group * slot;
+	uint32_t capacity, n;
+} GroupTable;
+
+// query, shared read-only by the workers
+char slot_name[MAX_SLOTS][LOG_NAME_LEN];
+int slots = 0;
+Filter filter[MAX_FILTERS];
+int filters = 0;
+int group_slot[MAX_GROUPS];
+int groups = 0;
+Aggregate agg[MAX_AGGS];
+int aggs = 0;
+int time_slot = -1;
+double window = 0;			// [s] time window group, 0: none
+double time_from = -INFINITY, time_to = INFINITY;
+
+// files and work
+ColFile * file;
+int (* file_slot)[MAX_SLOTS];		// column of each slot in each file
+int files = 0;
+typedef struct { int file; uint32_t block; } WorkItem;
+WorkItem * work;
+uint32_t work_items = 0;
+volatile uint32_t work_next = 0;
+volatile uint64_t blocks_skipped = 0, rows_scanned = 0;
+
+typedef struct {
+	pthread_t thread;
+	GroupTable table;
+} Worker;
+
+
+int slot_of(const char * name)
+{
+	int k;
+
+	for (k = 0; k < slots; k++)
+		if (strncmp(slot_name[k], name, LOG_NAME_LEN) == 0) return k;
+	if (slots == MAX_SLOTS) {
+		fprintf(stderr, "ERROR: too many columns in the query.\n");
+		exit(1);
+	}
+	snprintf(slot_name[slots], LOG_NAME_LEN, "%s", name);
+	return slots++;
+}
+
+/*
+ *	GROUPS
+ */
+
+uint32_t group_hash(const double * key, int n)
+{
+	uint64_t h = 1469598103934665603ULL, bits;
+	int k;
+
+	for (k = 0; k < n; k++) {
+		memcpy(&bits, &key[k], 8);
+		h = (h ^ bits) * 1099511628211ULL;
+		h ^= h >> 29;
+	}
+	return (uint32_t)h;
+}
+
+void group_init(GroupTable * t, uint32_t capacity)
+{
+	t->capacity = capacity;
+	t->n = 0;
+	t->slot = calloc(capacity, sizeof(Group));
+	if (t->slot == NULL) {
+		fprintf(stderr, "ERROR: Not enough memory for the groups.\n");
+		exit(1);
+	}
+}
+
+Group * group_find(GroupTable * t, const double * key, int n);
+
+void group_grow(GroupTable * t)
+{
+	GroupTable bigger;
+	Group * g;
+	uint32_t k;
+
+	group_init(&bigger, t->capacity * 2);
+	for (k = 0; k < t->capacity; k++) {
+		if (!t->slot[k].used) continue;
+		g = group_find(&bigger, t->slot[k].key, MAX_GROUPS + 1);
+		*g = t->slot[k];
+	}
+	free(t->slot);
+	*t = bigger;
+}
+
+/*
+ *	Group of [key], created empty if new
+ */
+Group * group_find(GroupTable * t, const double * key, int n)
+{
+	uint32_t k;
+	Group * g;
+	int a;
+
+	if (2 * (t->n + 1) > t->capacity) group_grow(t);
+	for (k = group_hash(key, n) & (t->capacity - 1); ; k = (k + 1) & (t->capacity - 1)) {
+		g = &t->slot[k];
+		if (!g->used) break;
+		if (memcmp(g->key, key, n * sizeof(double)) == 0) return g;
+	}
+	g->used = 1;
+	memcpy(g->key, key, n * sizeof(double));
+	g->count = 0;
+	for (a = 0; a < MAX_AGGS; a++) {
+		memset(&g->acc[a], 0, sizeof(Acc));
+		g->acc[a].min = INFINITY;
+		g->acc[a].max = -INFINITY;
+	}
+	t->n++;
+	return g;
+}
+
+void acc_merge(Acc * a, const Acc * b)
+{
+	a->n += b->n;
+	a->sum += b->sum;
+	a->sum2 += b->sum2;
+	if (b->min < a->min) a->min = b->min;
+	if (b->max > a->max) a->max = b->max;
+}
+
+/*
+ *	SCAN
+ */
+
+int filter_pass(int op, double v, double ref)
+{
+	switch (op) {
+		case OP_LT: return v < ref;
+		case OP_LE: return v <= ref;
+		case OP_GT: return v > ref;
+		case OP_GE: return v >= ref;
+		case OP_EQ: return v == ref;
+	}
+	return v != ref;
+}
+
+/*
+ *	True if no row of a block with these statistics can pass the filter
+ */
+int filter_excludes(int op, const ColBlockStats * s, double ref)
+{
+	switch (op) {
+		case OP_LT: return s->min >= ref;
+		case OP_LE: return s->min > ref;
+		case OP_GT: return s->max <= ref;
+		case OP_GE: return s->max < ref;
+		case OP_EQ: return ref < s->min || ref > s->max;
+	}
+	return s->min == ref && s->max == ref;
+}
+
+int block_skipped(const ColFile * f, const int * fslot, uint32_t block)
+{
+	const ColBlockStats * s;
+	int k;
+
+	for (k = 0; k < filters; k++)
+		if (filter_excludes(filter[k].op, col_stats(f, fslot[filter[k].slot], block), filter[k].value)) return 1;
+	if (time_slot >= 0) {
+		s = col_stats(f, fslot[time_slot], block);
+		if (s->max < time_from || s->min >= time_to) return 1;
+	}
+	return 0;
+}
+
+void * worker_thread(void * arg)
+{
+	Worker * w = (Worker *)arg;
+	double * value[MAX_SLOTS];
+	double key[MAX_GROUPS + 1];
+	const ColFile * f;
+	const int * fslot;
+	uint32_t item, rows, r;
+	uint64_t scanned = 0, skipped = 0;
+	Group * g;
+	double v;
+	int k, pass;
+
+	for (k = 0; k < slots; k++) {
+		value[k] = malloc(COL_BLOCK_ROWS * sizeof(double));
+		if (value[k] == NULL) exit(1);
+	}
+	group_init(&w->table, 256);
+
+	while ((item = __sync_fetch_and_add(&work_next, 1)) < work_items) {
+		f = &file[work[item].file];
+		fslot = file_slot[work[item].file];
+		if (block_skipped(f, fslot, work[item].block)) {
+			skipped++;
+			continue;
+		}
+		rows = 0;
+		for (k = 0; k < slots; k++) rows = col_block(f, fslot[k], work[item].block, value[k]);
+		scanned += rows;
+
+		memset(key, 0, sizeof(key));
+		for (r = 0; r < rows; r++) {
+			pass = 1;
+			for (k = 0; k < filters && pass; k++) pass = filter_pass(filter[k].op, value[filter[k].slot][r], filter[k].value);
+			if (pass && time_slot >= 0) pass = value[time_slot][r] >= time_from && value[time_slot][r] < time_to;
+			if (!pass) continue;
+
+			for (k = 0; k < groups; k++) key[k] = value[group_slot[k]][r];
+			if (window > 0) key[groups] = floor(value[time_slot][r] / window) * window;
+			g = group_find(&w->table, key, MAX_GROUPS + 1);
+			g->count++;
+			for (k = 0; k < aggs; k++) {
+				if (agg[k].kind == AGG_COUNT) continue;
+				v = value[agg[k].slot][r];
+				g->acc[k].n++;
+				g->acc[k].sum += v;
+				g->acc[k].sum2 += v*v;
+				if (v < g->acc[k].min) g->acc[k].min = v;
+				if (v > g->acc[k].max) g->acc[k].max = v;
+			}
+		}
+	}
+	__sync_fetch_and_add(&rows_scanned, scanned);
+	__sync_fetch_and_add(&blocks_skipped, skipped);
+	for (k = 0; k < slots; k++) free(value[k]);
+	return NULL;
+}
+
+/*
+ *	OUTPUT
+ */
+
+int group_cmp(const void * a, const void * b)
+{
+	const Group * x = *(const Group **)a, * y = *(const Group **)b;
+	int k;
+
+	for (k = 0; k <= MAX_GROUPS; k++) {
+		if (x->key[k] < y->key[k]) return -1;
+		if (x->key[k] > y->key[k]) return 1;
+	}
+	return 0;
+}
+
+double agg_value(const Aggregate * a, const Group * g, const Acc * acc)
+{
+	double mean = acc->n ? acc->sum / acc->n : NAN;
+
+	switch (a->kind) {
+		case AGG_COUNT: return g->count;
+		case AGG_SUM: return acc->sum;
+		case AGG_MEAN: return mean;
+		case AGG_MIN: return acc->n ? acc->min : NAN;
+		case AGG_MAX: return acc->n ? acc->max : NAN;
+	}
+	return acc->n > 1 ? sqrt(fmax(0, (acc->sum2 - acc->n * mean * mean) / (acc->n - 1))) : NAN;
+}
+
+/*
+ *	ARGUMENTS
+ */
+
+void parse_filter(const char * s)
+{
+	static const char * ops[] = { "<=", ">=", "==", "!=", "<", ">" };
+	static const int codes[] = { OP_LE, OP_GE, OP_EQ, OP_NE, OP_LT, OP_GT };
+	char name[LOG_NAME_LEN];
+	const char * p;
+	int k, len;
+
+	if (filters == MAX_FILTERS) { fprintf(stderr, "ERROR: too many filters.\n"); exit(1); }
+	for (k = 0; k < 6; k++) {
+		p = strstr(s, ops[k]);
+		if (p == NULL) continue;
+		len = p - s;
+		while (len > 0 && s[len-1] == ' ') len--;
+		snprintf(name, sizeof(name), "%.*s", len, s);
+		filter[filters].slot = slot_of(name);
+		filter[filters].op = codes[k];
+		filter[filters].value = atof(p + strlen(ops[k]));
+		filters++;
+		return;
+	}
+	fprintf(stderr, "ERROR: invalid filter \"%s\".\n", s);
+	exit(1);
+}
+
+void parse_aggregates(char * s)
+{
+	static const char * kinds[] = { "count", "sum", "mean", "min", "max", "std" };
+	char * item, * save, * col;
+	int k;
+
+	for (item = strtok_r(s, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+		if (aggs == MAX_AGGS) { fprintf(stderr, "ERROR: too many aggregates.\n"); exit(1); }
+		col = strchr(item, ':');
+		if (col != NULL) *col++ = '\0';
+		for (k = 0; k < 6 && strcmp(item, kinds[k]) != 0; k++);
+		if (k == 6 || (k != AGG_COUNT && col == NULL)) {
+			fprintf(stderr, "ERROR: invalid aggregate \"%s\".\n", item);
+			exit(1);
+		}
+		agg[aggs].kind = k;
+		agg[aggs].slot = k == AGG_COUNT ? -1 : slot_of(col);
+		if (k == AGG_COUNT) snprintf(agg[aggs].label, sizeof(agg[aggs].label), "count");
+		else snprintf(agg[aggs].label, sizeof(agg[aggs].label), "%s(%s)", kinds[k], col);
+		aggs++;
+	}
+}
+
+void usage(const char * name)
+{
+	fprintf(stderr, "usage: %s [-j threads] [-w filter]... [-t from:to] [-g col[,col...]] [-W seconds] [-a aggregates] <file.col>...\n", name);
+	exit(1);
+}
+
+int main(int argc, char ** argv)
+{
+	Worker * worker;
+	GroupTable * all;
+	Group ** sorted, * g;
+	char * item, * save, * colon, aggs_default[] = "count";
+	uint32_t b, k, n;
+	int threads = sysconf(_SC_NPROCESSORS_ONLN), opt, f, s, a;
+
+	while ((opt = getopt(argc, argv, "j:w:t:g:W:a:")) != -1) {
+		switch (opt) {
+			case 'j': threads = atoi(optarg); break;
+			case 'w': parse_filter(optarg); break;
+			case 't':
+				colon = strchr(optarg, ':');
+				if (colon == NULL) usage(argv[0]);
+				if (colon != optarg) time_from = atof(optarg);
+				if (colon[1] != '\0') time_to = atof(colon + 1);
+				time_slot = slot_of(TIME_COLUMN);
+				break;
+			case 'g':
+				for (item = strtok_r(optarg, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+					if (groups == MAX_GROUPS) { fprintf(stderr, "ERROR: too many group columns.\n"); exit(1); }
+					group_slot[groups++] = slot_of(item);
+				}
+				break;
+			case 'W':
+				window = atof(optarg);
+				time_slot = slot_of(TIME_COLUMN);
+				break;
+			case 'a': parse_aggregates(optarg); break;
+			default: usage(argv[0]);
+		}
+	}
+	if (optind >= argc || threads <= 0 || window < 0) usage(argv[0]);
+	if (aggs == 0) parse_aggregates(aggs_default);
+
+	// files and their blocks
+	file = calloc(argc - optind, sizeof(ColFile));
+	file_slot = calloc(argc - optind, sizeof(*file_slot));
+	if (file == NULL || file_slot == NULL) exit(1);
+	for (f = optind; f < argc; f++) {
+		if (col_open(&file[files], argv[f]) < 0) {
+			fprintf(stderr, "WARNING: %s is not a columnar log file, skipped.\n", argv[f]);
+			continue;
+		}
+		for (s = 0; s < slots; s++) {
+			file_slot[files][s] = col_find(&file[files], slot_name[s]);
+			if (file_slot[files][s] < 0) break;
+		}
+		if (s < slots) {
+			fprintf(stderr, "WARNING: %s has no column %s, skipped.\n", argv[f], slot_name[s]);
+			col_close(&file[files]);
+			continue;
+		}
+		work_items += file[files].header->blocks;
+		files++;
+	}
+	work = malloc((work_items + 1) * sizeof(WorkItem));
+	if (work == NULL) exit(1);
+	for (f = 0, n = 0; f < files; f++)
+		for (b = 0; b < file[f].header->blocks; b++) {
+			work[n].file = f;
+			work[n++].block = b;
+		}
+
+	// scan
+	worker = calloc(threads, sizeof(Worker));
+	if (worker == NULL) exit(1);
+	for (k = 0; k < (uint32_t)threads; k++)
+		if (pthread_create(&worker[k].thread, NULL, worker_thread, &worker[k]) != 0) {
+			fprintf(stderr, "ERROR: Cannot start the worker threads.\n");
+			exit(1);
+		}
+	for (k = 0; k < (uint32_t)threads; k++) pthread_join(worker[k].thread, NULL);
+
+	// merge
+	all = &worker[0].table;
+	for (k = 1; k < (uint32_t)threads; k++) {
+		for (b = 0; b < worker[k].table.capacity; b++) {
+			const Group * src = &worker[k].table.slot[b];
+			if (!src->used) continue;
+			g = group_find(all, src->key, MAX_GROUPS + 1);
+			g->count += src->count;
+			for (a = 0; a < aggs; a++) acc_merge(&g->acc[a], &src->acc[a]);
+		}
+		free(worker[k].table.slot);
+	}
+	sorted = malloc((all->n + 1) * sizeof(Group *));
+	if (sorted == NULL) exit(1);
+	for (b = 0, n = 0; b < all->capacity; b++)
+		if (all->slot[b].used) sorted[n++] = &all->slot[b];
+	qsort(sorted, n, sizeof(Group *), group_cmp);
+
+	// output
+	for (k = 0; k < (uint32_t)groups; k++) printf("%s,", slot_name[group_slot[k]]);
+	if (window > 0) printf("window,");
+	for (a = 0; a < aggs; a++) printf("%s%s", agg[a].label, a < aggs-1 ? "," : "\n");
+	for (b = 0; b < n; b++) {
+		g = sorted[b];
+		for (k = 0; k < (uint32_t)groups; k++) printf("%g,", g->key[k]);
+		if (window > 0) printf("%.0f,", g->key[groups]);
+		for (a = 0; a < aggs; a++) printf("%.6g%s", agg_value(&agg[a], g, &g->acc[a]), a < aggs-1 ? "," : "\n");
+	}
+	fprintf(stderr, "%d files, %u blocks (%llu skipped), %llu rows scanned, %u groups, %d threads\n", files, work_items,
+		(unsigned long long)blocks_skipped, (unsigned long long)rows_scanned, n, threads);
+
+	for (f = 0; f < files; f++) col_close(&file[f]);
+	return 0;
+}
@@ -1,4 +1,4 @@
 #!/bin/bash
 
-./u200_arm /dev/ttyUSB0 
+./u200_arm -f /dev/ttyUSB0 
 ./mcu_launcher_u200.sh
@@ -0,0 +1,112 @@
+/*
+ *	POLAR_TOOL
+ *
+ *	Polar tables of the boat model (see polar_table.h, boat_sim.h)
+ *
+ *	polar_tool [-o out.polar] [-p table.polar] [-e]
+ *		-o  write the default table, generated from the polynomials
+ *		-p  print a table as CSV: twa,tws,speed,heel
+ *		-e  error of the default table against the polynomials
+ *		    (0..179.99 degrees in 0.01 degree steps, the polynomial is
+ *		    cut at 180 and below 0.22 rad), and the time per
+ *		    lookup of the batch API against the polynomials
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "../controller_core.h"
+#include "../polar_table.h"
+#include "../boat_dyn.h"
+#include "../boat_sim.h"
+
+#define BENCH_POINTS	18000
+
+double now_s()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+void check_default(const PolarTable * t)
+{
+	static float twa[BENCH_POINTS], tws[BENCH_POINTS], speed[BENCH_POINTS], heel[BENCH_POINTS];
+	float v, h, err_v = 0, err_h = 0, at_v = 0;
+	double t0, t_table, t_poly, sum = 0;
+	int k, r, rounds = 200;
+
+	for (k = 0; k < BENCH_POINTS; k++) {
+		twa[k] = k * 0.01;
+		tws[k] = (k % 7) * 4.0;
+	}
+	polar_lookup_batch(t, twa, tws, BENCH_POINTS, speed, heel);
+	for (k = 0; k < BENCH_POINTS; k++) {
+		sim_polynomials(twa[k]*PI/180, &v, &h);
+		if (fabs(speed[k] - v) > err_v) { err_v = fabs(speed[k] - v); at_v = twa[k]; }
+		if (fabs(heel[k] - h) > err_h) err_h = fabs(heel[k] - h);
+	}
+	printf("max error: speed %.4f m/s (at %.2f degrees), heel %.5f\n", err_v, at_v, err_h);
+
+	t0 = now_s();
+	for (r = 0; r < rounds; r++) {
+		polar_lookup_batch(t, twa, tws, BENCH_POINTS, speed, heel);
+		sum += speed[r];
+	}
+	t_table = (now_s() - t0) / rounds / BENCH_POINTS;
+	t0 = now_s();
+	for (r = 0; r < rounds; r++)
+		for (k = 0; k < BENCH_POINTS; k++) {
+			sim_polynomials(twa[k]*PI/180, &v, &h);
+			sum += v;
+		}
+	t_poly = (now_s() - t0) / rounds / BENCH_POINTS;
+	printf("lookup %.2f ns (batch), polynomials %.2f ns%s\n", t_table*1e9, t_poly*1e9, sum == 0.5 ? " " : "");
+}
+
+int main(int argc, char ** argv)
+{
+	PolarTable t;
+	const char * out = NULL, * print = NULL;
+	int check = 0, opt, a, s;
+
+	while ((opt = getopt(argc, argv, "o:p:e")) != -1) {
+		switch (opt) {
+			case 'o': out = optarg; break;
+			case 'p': print = optarg; break;
+			case 'e': check = 1; break;
+			default:
+				fprintf(stderr, "usage: %s [-o out.polar] [-p table.polar] [-e]\n", argv[0]);
+				exit(1);
+		}
+	}
+	if (out == NULL && print == NULL && !check) {
+		fprintf(stderr, "usage: %s [-o out.polar] [-p table.polar] [-e]\n", argv[0]);
+		exit(1);
+	}
+
+	if (out != NULL || check) {
+		if (sim_polar_default(&t) < 0) exit(1);
+		if (out != NULL && polar_save(&t, out) < 0) {
+			printf("ERROR: Cannot write %s.\n", out);
+			exit(1);
+		}
+		if (out != NULL) printf("%s: %d x %d nodes\n", out, t.n_twa, t.n_tws);
+		if (check) check_default(&t);
+		polar_free(&t);
+	}
+	if (print != NULL) {
+		if (polar_load(&t, print) < 0) {
+			printf("ERROR: Cannot read %s.\n", print);
+			exit(1);
+		}
+		printf("twa,tws,speed,heel\n");
+		for (a = 0; a < t.n_twa; a++)
+			for (s = 0; s < t.n_tws; s++)
+				printf("%g,%g,%.4f,%.4f\n", t.twa0 + a*t.twa_step, t.tws0 + s*t.tws_step, t.speed[a*t.n_tws + s], t.heel[a*t.n_tws + s]);
+		polar_free(&t);
+	}
+	return 0;
+}
@@ -0,0 +1,115 @@
+/*
+ *	RT_JITTER
+ *
+ *	Wake-up jitter of a periodic loop (the controller main loop timer) in the
+ *	default scheduling mode and in the real-time mode of rt_mode.h, while
+ *	[load] processes keep the CPUs busy and touch memory.
+ *
+ *	rt_jitter [-t seconds per mode] [-p period_us] [-l load_processes] [-R rt_priority] [-C cpu]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../loop_timer.h"
+#include "../rt_mode.h"
+
+#define LOAD_MEMORY	(4*1024*1024)
+
+/*
+ *	Busy loop walking through a buffer, until killed
+ */
+void load_process()
+{
+	char * buf = malloc(LOAD_MEMORY);
+	unsigned long n = 0;
+
+	if (buf == NULL) exit(1);
+	for (;;) {
+		buf[(n * 4096 + n) % LOAD_MEMORY] += n;
+		n++;
+	}
+}
+
+int cmp_long(const void * a, const void * b)
+{
+	long x = *(const long *)a, y = *(const long *)b;
+	return (x > y) - (x < y);
+}
+
+/*
+ *	Run the loop for [ticks] periods and print the jitter statistics
+ */
+void measure(const char * mode, long period_us, long ticks)
+{
+	LoopTimer timer;
+	long * jitter = malloc(ticks * sizeof(long));
+	long n, sum = 0;
+
+	if (jitter == NULL || looptimer_init(&timer, period_us*1000L) < 0) {
+		fprintf(stderr, "ERROR: Cannot create the timer.\n");
+		exit(1);
+	}
+	for (n = 0; n < ticks; n++) {
+		looptimer_wait(&timer);
+		jitter[n] = timespec_diff_us(&timer.woke, &timer.deadline);
+		if (jitter[n] < 0) jitter[n] = 0;
+		sum += jitter[n];
+		looptimer_done(&timer);
+	}
+	close(timer.tfd);
+	close(timer.epfd);
+
+	qsort(jitter, ticks, sizeof(long), cmp_long);
+	printf("%-8s %8ld %10.1f %10ld %10ld %10ld %10ld %10llu\n", mode, ticks, (double)sum/ticks,
+		jitter[ticks/2], jitter[ticks*99/100], jitter[ticks*999/1000], jitter[ticks-1], (unsigned long long)timer.overruns);
+	fflush(stdout);
+	free(jitter);
+}
+
+int main(int argc, char ** argv)
+{
+	long seconds = 10, period_us = 1000;
+	int  load = 2, opt, n;
+	pid_t * pids;
+
+	rt.enabled = 1;
+	while ((opt = getopt(argc, argv, "t:p:l:R:C:")) != -1) {
+		switch (opt) {
+			case 't': seconds = atol(optarg); break;
+			case 'p': period_us = atol(optarg); break;
+			case 'l': load = atoi(optarg); break;
+			case 'R': rt.priority = atoi(optarg); break;
+			case 'C': rt.cpu = atoi(optarg); break;
+			default:
+				fprintf(stderr, "usage: %s [-t seconds] [-p period_us] [-l load_processes] [-R rt_priority] [-C cpu]\n", argv[0]);
+				exit(1);
+		}
+	}
+	if (seconds <= 0 || period_us <= 0 || load < 0) {
+		fprintf(stderr, "ERROR: invalid arguments.\n");
+		exit(1);
+	}
+
+	pids = calloc(load, sizeof(pid_t));
+	for (n = 0; n < load; n++) {
+		pids[n] = fork();
+		if (pids[n] == 0) load_process();
+	}
+	printf("%d load processes, period %ld us, %ld s per mode\n", load, period_us, seconds);
+
+	printf("%-8s %8s %10s %10s %10s %10s %10s %10s\n", "mode", "ticks", "mean us", "p50 us", "p99 us", "p99.9 us", "max us", "overruns");
+	measure("default", period_us, seconds*1000000/period_us);
+	if (rt_setup("rt_jitter") > 0) printf("WARNING: RT mode incomplete, the comparison is not meaningful.\n");
+	measure("rt", period_us, seconds*1000000/period_us);
+
+	for (n = 0; n < load; n++) {
+		kill(pids[n], SIGKILL);
+		waitpid(pids[n], NULL, 0);
+	}
+	return 0;
+}
@@ -0,0 +1,83 @@
+/*
+ *	SAILCTL
+ *
+ *	Send one command to the controller command channel and print the ack.
+ *
+ *	sailctl mode <Navigation_System>
+ *	sailctl manual <on> <rudder_angle> <sail_position>
+ *	sailctl target <latitude> <longitude>
+ *	sailctl param <ext_name> <value>
+ *	sailctl sim <on>
+ *	sailctl profile <on|off|dump>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../command_protocol.h"
+
+void usage() {
+	fprintf(stderr, "usage: sailctl mode <n> | manual <on> <rudder> <sail> | target <lat> <lon> | param <ext_name> <value> | sim <on> | profile <on|off|dump>\n");
+	exit(1);
+}
+
+int main(int argc, char ** argv) {
+
+	struct sockaddr_un addr;
+	Command cmd;
+	CommandAck ack;
+	int fd;
+
+	if (argc < 3) usage();
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.seq = getpid();
+
+	if (strcmp(argv[1], "mode") == 0) {
+		cmd.type = CMD_SET_MODE;
+		cmd.arg_i[0] = atoi(argv[2]);
+	} else if (strcmp(argv[1], "manual") == 0 && argc == 5) {
+		cmd.type = CMD_MANUAL;
+		cmd.arg_i[0] = atoi(argv[2]);
+		cmd.arg_i[1] = atoi(argv[3]);
+		cmd.arg_i[2] = atoi(argv[4]);
+	} else if (strcmp(argv[1], "target") == 0 && argc == 4) {
+		cmd.type = CMD_SET_TARGET;
+		cmd.arg_d[0] = atof(argv[2]);
+		cmd.arg_d[1] = atof(argv[3]);
+	} else if (strcmp(argv[1], "param") == 0 && argc == 4) {
+		cmd.type = CMD_SET_PARAM;
+		snprintf(cmd.name, sizeof(cmd.name), "%s", argv[2]);
+		cmd.arg_i[0] = atoi(argv[3]);
+		cmd.arg_d[0] = atof(argv[3]);
+	} else if (strcmp(argv[1], "sim") == 0) {
+		cmd.type = CMD_SIMULATION;
+		cmd.arg_i[0] = atoi(argv[2]);
+	} else if (strcmp(argv[1], "profile") == 0) {
+		cmd.type = CMD_PROFILE;
+		if (strcmp(argv[2], "on") == 0) cmd.arg_i[0] = PROFILE_ON;
+		else if (strcmp(argv[2], "off") == 0) cmd.arg_i[0] = PROFILE_OFF;
+		else if (strcmp(argv[2], "dump") == 0) cmd.arg_i[0] = PROFILE_DUMP;
+		else usage();
+	} else usage();
+
+	fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", COMMAND_SOCKET);
+	if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		fprintf(stderr, "ERROR: Cannot connect to %s\n", COMMAND_SOCKET);
+		exit(1);
+	}
+
+	if (send(fd, &cmd, sizeof(cmd), 0) != sizeof(cmd) || recv(fd, &ack, sizeof(ack), 0) != sizeof(ack)) {
+		fprintf(stderr, "ERROR: No answer from the controller\n");
+		exit(1);
+	}
+	close(fd);
+
+	printf("status: %u, tick: %llu, latency: %u us\n", ack.status, (unsigned long long)ack.tick, ack.latency_us);
+	return ack.status;
+}
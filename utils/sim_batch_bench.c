@@ -0,0 +1,175 @@
+/*
+ *	SIM_BATCH_BENCH
+ *
+ *	Batch boat simulator (see boat_sim_batch.h) against the scalar model of
+ *	boat_sim.h: [boats] boats with their own rudder, sail and wind inputs
+ *	are moved for [steps] control loops by both, then every kernel of this
+ *	build and sim_step() are timed.
+ *
+ *	sim_batch_bench [-n boats] [-s steps]
+ *
+ *	Output: the largest differences of heading, actuators, speed and heel
+ *	over the run, the largest one-step position difference (batch step
+ *	against the displacement of sim_step() from the same state, in metres)
+ *	and the position difference at the end (sim_step() rounds the latitude
+ *	and longitude to floats every step), then boat-steps/s per kernel.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "../controller_core.h"
+#include "../polar_table.h"
+#include "../boat_dyn.h"
+#include "../boat_sim.h"
+#include "../boat_sim_batch.h"
+
+#define LAT0	38.7f
+#define LON0	-9.1f
+
+double now_s()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// inputs of boat [k] at step [t]
+void inputs(int k, int t, int * rudder, int * sail, float * wind_angle, float * wind_speed)
+{
+	*rudder = (k*7 + t/8) % 61 - 30;
+	*sail = (k*37 + t/4) % 400;
+	*wind_angle = (k*11) % 360 + 0.1f*t;
+	*wind_speed = 2 + k % 20;
+}
+
+void set_inputs(SimBatch * b, int t)
+{
+	int k, r, s;
+
+	for (k = 0; k < b->n; k++) {
+		inputs(k, t, &r, &s, &b->wind_angle[k], &b->wind_speed[k]);
+		b->rudder[k] = r;
+		b->sail[k] = s;
+	}
+}
+
+void init_boat(SimBoat * boat, int k, const PolarTable * polar)
+{
+	memset(boat, 0, sizeof(SimBoat));
+	boat->Heading = (k*53) % 360;
+	boat->Latitude = LAT0 + (k % 100) * 1e-4f;
+	boat->Longitude = LON0 + (k / 100 % 100) * 1e-4f;
+	boat->Sail_Feedback = (k*17) % 400;
+	boat->polar = polar;
+}
+
+void compare(const PolarTable * polar, int n, int steps)
+{
+	SimBatch b;
+	SimBoat * boat = malloc(n * sizeof(SimBoat));
+	float * x0 = malloc(n * sizeof(float)), * y0 = malloc(n * sizeof(float));
+	double e_head = 0, e_v = 0, e_heel = 0, e_step = 0, e_end = 0, d, x, y;
+	int e_act = 0, k, t;
+
+	if (boat == NULL || x0 == NULL || y0 == NULL || sim_batch_alloc(&b, n, polar, LAT0, LON0) < 0) {
+		printf("ERROR: Cannot allocate %d boats.\n", n);
+		exit(1);
+	}
+	for (k = 0; k < n; k++) {
+		init_boat(&boat[k], k, polar);
+		sim_batch_set(&b, k, &boat[k]);
+	}
+	for (t = 0; t < steps; t++) {
+		set_inputs(&b, t);
+		memcpy(x0, b.x, n * sizeof(float));
+		memcpy(y0, b.y, n * sizeof(float));
+		sim_batch_step(&b);
+		for (k = 0; k < n; k++) {
+			sim_step(&boat[k], b.rudder[k], b.sail[k], b.wind_angle[k], b.wind_speed[k]);
+			e_head = fmax(e_head, fabs(boat[k].Heading - b.heading[k]));
+			e_act = fmax(e_act, abs(boat[k].Sail_Feedback - b.sail_fb[k]));
+			e_act = fmax(e_act, abs(boat[k].Rudder_Feedback - b.rudder_fb[k]));
+			e_v = fmax(e_v, fabs(boat[k].v_poly - b.v[k]));
+			e_heel = fmax(e_heel, fabs(boat[k].heel_sim - b.heel[k]));
+
+			// displacement of sim_step() with the heading and speed of the batch
+			d = (double)b.v[k] / SEC;
+			x = x0[k] + d * sinf(b.heading[k]*PI/180) - b.x[k];
+			y = y0[k] + d * cosf(b.heading[k]*PI/180) - b.y[k];
+			e_step = fmax(e_step, sqrt(x*x + y*y));
+		}
+	}
+	for (k = 0; k < n; k++) {
+		x = ((double)boat[k].Longitude - LON0) * CONVLON - b.x[k];
+		y = ((double)boat[k].Latitude - LAT0) * CONVLAT - b.y[k];
+		e_end = fmax(e_end, sqrt(x*x + y*y));
+	}
+	printf("%d boats, %d steps (%.0f s)\n", n, steps, steps / SEC);
+	printf("max difference: heading %.2e deg, actuators %d, speed %.2e m/s, heel %.2e\n", e_head, e_act, e_v, e_heel);
+	printf("max difference: position step %.2e m, position at the end %.3f m\n", e_step, e_end);
+	sim_batch_free(&b);
+	free(boat);
+	free(x0);
+	free(y0);
+}
+
+void bench(const PolarTable * polar, int n, int steps)
+{
+	SimBatch b;
+	SimBoat * boat = malloc(n * sizeof(SimBoat));
+	double t0, scalar, batch;
+	int i, k, t;
+
+	if (boat == NULL || sim_batch_alloc(&b, n, polar, LAT0, LON0) < 0) {
+		printf("ERROR: Cannot allocate %d boats.\n", n);
+		exit(1);
+	}
+	set_inputs(&b, 0);
+
+	for (k = 0; k < n; k++) init_boat(&boat[k], k, polar);
+	t0 = now_s();
+	for (t = 0; t < steps; t++)
+		for (k = 0; k < n; k++) sim_step(&boat[k], b.rudder[k], b.sail[k], b.wind_angle[k], b.wind_speed[k]);
+	scalar = (double)n * steps / (now_s() - t0);
+	printf("%-8s %8.1f M boat-steps/s\n", "scalar", scalar / 1e6);
+
+	for (i = 0; i < SIMB_ISAS; i++) {
+		if (sim_batch_select(sim_batch_isa[i].name) < 0) continue;
+		for (k = 0; k < n; k++) sim_batch_set(&b, k, &boat[k]);
+		t0 = now_s();
+		for (t = 0; t < steps; t++) sim_batch_step(&b);
+		batch = (double)n * steps / (now_s() - t0);
+		printf("%-8s %8.1f M boat-steps/s (x%.1f)\n", sim_batch_isa[i].name, batch / 1e6, batch / scalar);
+	}
+	sim_batch_free(&b);
+	free(boat);
+}
+
+int main(int argc, char ** argv)
+{
+	PolarTable polar;
+	int n = 4096, steps = 2400, opt;
+
+	while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+		switch (opt) {
+			case 'n': n = atoi(optarg); break;
+			case 's': steps = atoi(optarg); break;
+			default:
+				fprintf(stderr, "usage: %s [-n boats] [-s steps]\n", argv[0]);
+				exit(1);
+		}
+	}
+	if (n <= 0 || steps <= 0) {
+		fprintf(stderr, "usage: %s [-n boats] [-s steps]\n", argv[0]);
+		exit(1);
+	}
+	if (sim_polar_default(&polar) < 0) exit(1);
+
+	compare(&polar, n, steps);
+	bench(&polar, n, steps);
+	polar_free(&polar);
+	return 0;
+}
@@ -0,0 +1,400 @@
+/*
+ *	SIM_SWEEP
+ *
+ *	Monte-Carlo sweeps of the hill climbing parameters in simulation (see
+ *	sim_mission.h): every combination of the steptime, stepsize,
+ *	sail_stepsize and des_slope values of a scenario file is run once per
+ *	seed, the missions are shared out between [threads] workers that steal
+ *	work from each other, and the results are aggregated per combination.
+ *	A mission depends on its seed only: the report is the same for any
+ *	number of threads.
+ *
+ *	sim_sweep [-j threads] [-r runs.csv] <scenario>
+ *
+ *	Scenario: one "key value..." per line, # comments
+ *		wind_angle, heading		[degrees] wind direction, initial heading
+ *		wind_speed			[m/s]
+ *		polar				polar table file (default: the boat model)
+ *		model				kinematic (default) or 4dof (see boat_dyn.h)
+ *		warm_start			1: hill climbing from the best VMG of the polar
+ *		wind_sd, heading_sd		[degrees] spread drawn from each seed
+ *		gust, dir_noise, shift_rate, shift, oscillation, spatial
+ *						wind variation (see sim_wind.h)
+ *		sensors				sensor impairments file (see sim_sensors.h)
+ *		<channel>_noise, _delay, _hold, _dropout
+ *						sensor impairments, as in the file
+ *						(after a sensors line: change it)
+ *		start, target			lat lon
+ *		duration			[s] of a mission, unless the target is reached
+ *		heading_state, sail_state	algorithms (see controller_core.h)
+ *		rudder_rate			[Hz] rudder group, 20 as controller.c
+ *		conv_band			convergence band, relative to the final VMG
+ *		vLOS, stepDIR, DIR_init, des_heading, des_app_w, sail_pos
+ *		steptime, stepsize, sail_stepsize, des_slope	grid: lists of values
+ *		seeds				list of seeds, or first-last
+ *
+ *	Output: CSV, one line per combination (means and standard deviations
+ *	over the seeds), then the throughput on stderr.
+ *	e.g. utils/sim_sweep_example.txt
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include "../controller_core.h"
+#include "../polar_table.h"
+#include "../boat_dyn.h"
+#include "../boat_sim.h"
+#include "../sim_random.h"
+#include "../sim_wind.h"
+#include "../sim_sensors.h"
+#include "../sim_mission.h"
+
+#define GRID_VALUES	16
+#define MAX_SEEDS	100000
+#define LINE_LEN	1024
+
+enum GridKey { GRID_STEPTIME, GRID_STEPSIZE, GRID_SAIL_STEPSIZE, GRID_DES_SLOPE, GRID_KEYS };
+const char * grid_names[GRID_KEYS] = { "steptime", "stepsize", "sail_stepsize", "des_slope" };
+
+typedef struct {
+	MissionSpec base;
+	PolarTable polar;
+	double grid[GRID_KEYS][GRID_VALUES];
+	int    grid_n[GRID_KEYS];
+	uint64_t * seed;
+	int    seeds, points;
+} Scenario;
+
+// work-stealing deque of job numbers: the owner takes from [lo], thieves from [hi]
+typedef struct {
+	pthread_mutex_t lock;
+	int lo, hi;
+	pthread_t thread;
+	int id;
+	uint64_t runs, steals;
+	float * vmg;
+} Worker;
+
+Scenario scn;
+Worker * worker;
+int threads;
+MissionResult * result;			// [point * seeds + seed]
+
+
+/*
+ *	Mission of grid point [point]
+ */
+void point_spec(int point, MissionSpec * m)
+{
+	int g, v[GRID_KEYS];
+
+	for (g = 0; g < GRID_KEYS; g++) {
+		v[g] = point % scn.grid_n[g];
+		point /= scn.grid_n[g];
+	}
+	*m = scn.base;
+	m->params.steptime = scn.grid[GRID_STEPTIME][v[GRID_STEPTIME]];
+	m->params.stepsize = scn.grid[GRID_STEPSIZE][v[GRID_STEPSIZE]];
+	m->params.sail_stepsize = scn.grid[GRID_SAIL_STEPSIZE][v[GRID_SAIL_STEPSIZE]];
+	m->params.des_slope = scn.grid[GRID_DES_SLOPE][v[GRID_DES_SLOPE]];
+}
+
+int parse_list(char * s, double * out, int max)
+{
+	char * save, * item;
+	int n = 0;
+
+	for (item = strtok_r(s, " \t", &save); item != NULL && n < max; item = strtok_r(NULL, " \t", &save)) out[n++] = atof(item);
+	return n;
+}
+
+int load_scenario(const char * path)
+{
+	FILE * f = fopen(path, "r");
+	char line[LINE_LEN], key[64], polar[256] = "", file[256], * rest;
+	double v[GRID_VALUES];
+	ControllerParams * p = &scn.base.params;
+	unsigned long long first, last, s;
+	uint64_t sensor_seed;
+	int g, n, len, rudder_rate = 20, err = 0;
+
+	if (f == NULL) return -1;
+	mission_default(&scn.base);
+	for (g = 0; g < GRID_KEYS; g++) scn.grid_n[g] = 0;
+	scn.seed = malloc(MAX_SEEDS * sizeof(uint64_t));
+	if (scn.seed == NULL) { fclose(f); return -1; }
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		line[strcspn(line, "#\r\n")] = '\0';
+		if (sscanf(line, "%63s%n", key, &len) != 1) continue;
+		rest = line + len;
+		for (g = 0; g < GRID_KEYS && strcmp(key, grid_names[g]) != 0; g++);
+		if (g < GRID_KEYS) {
+			scn.grid_n[g] = parse_list(rest, scn.grid[g], GRID_VALUES);
+			continue;
+		}
+		if (strcmp(key, "polar") == 0) {
+			if (sscanf(rest, "%255s", polar) != 1) err = 1;
+			continue;
+		}
+		if (strcmp(key, "model") == 0) {
+			if (sscanf(rest, "%63s", key) != 1 || (scn.base.model = sim_model_find(key)) < 0) {
+				printf("ERROR: %s: unknown model \"%s\".\n", path, rest);
+				fclose(f);
+				return -1;
+			}
+			continue;
+		}
+		if (strcmp(key, "sensors") == 0) {
+			// the impairments are drawn from each mission seed, not the seed of the file
+			if (sscanf(rest, "%255s", file) != 1 || sensor_spec_load(&scn.base.sensors, &sensor_seed, file) < 0) {
+				printf("ERROR: %s: cannot load the sensor impairments \"%s\".\n", path, rest);
+				fclose(f);
+				return -1;
+			}
+			continue;
+		}
+		if (strcmp(key, "seeds") == 0) {
+			if (sscanf(rest, "%llu-%llu", &first, &last) == 2) {
+				for (s = first; s <= last && scn.seeds < MAX_SEEDS; s++) scn.seed[scn.seeds++] = s;
+				continue;
+			}
+			n = parse_list(rest, v, GRID_VALUES);
+			for (g = 0; g < n && scn.seeds < MAX_SEEDS; g++) scn.seed[scn.seeds++] = v[g];
+			continue;
+		}
+		n = parse_list(rest, v, 3);
+		if (n == 0) err = 1;
+		else if (strcmp(key, "wind_angle") == 0) scn.base.wind_angle = v[0];
+		else if (strcmp(key, "heading") == 0) scn.base.heading = v[0];
+		else if (strcmp(key, "wind_speed") == 0) scn.base.wind_speed = v[0];
+		else if (strcmp(key, "warm_start") == 0) scn.base.warm_start = v[0];
+		else if (strcmp(key, "wind_sd") == 0) scn.base.wind_sd = v[0];
+		else if (strcmp(key, "heading_sd") == 0) scn.base.heading_sd = v[0];
+		else if (strcmp(key, "start") == 0 && n == 2) { scn.base.lat = v[0]; scn.base.lon = v[1]; }
+		else if (strcmp(key, "target") == 0 && n == 2) { scn.base.target_lat = v[0]; scn.base.target_lon = v[1]; }
+		else if (strcmp(key, "duration") == 0) scn.base.duration = v[0];
+		else if (strcmp(key, "rudder_rate") == 0) rudder_rate = v[0];
+		else if (strcmp(key, "conv_band") == 0) scn.base.conv_band = v[0];
+		else if (strcmp(key, "heading_state") == 0) p->heading_state = v[0];
+		else if (strcmp(key, "sail_state") == 0) p->sail_state = v[0];
+		else if (strcmp(key, "vLOS") == 0) p->vLOS = v[0];
+		else if (strcmp(key, "stepDIR") == 0) p->stepDIR = v[0];
+		else if (strcmp(key, "DIR_init") == 0) p->DIR_init = v[0];
+		else if (strcmp(key, "des_heading") == 0) p->des_heading = v[0];
+		else if (strcmp(key, "des_app_w") == 0) p->des_app_w = v[0];
+		else if (strcmp(key, "sail_pos") == 0) p->sail_pos = v[0];
+		else if ((g = wind_spec_set(&scn.base.wind, key, v, n)) != 0) err = g != 1;
+		else err = sensor_spec_set(&scn.base.sensors, key, v, n) != 1;
+		if (err) {
+			printf("ERROR: %s: invalid line \"%s\".\n", path, line);
+			fclose(f);
+			return -1;
+		}
+	}
+	fclose(f);
+	if (err || (polar[0] ? polar_load(&scn.polar, polar) : sim_polar_default(&scn.polar)) < 0) {
+		printf("ERROR: %s: cannot load the polar table %s.\n", path, polar[0] ? polar : "(default)");
+		return -1;
+	}
+	scn.base.polar = &scn.polar;
+
+	// keys without a grid take the GUI default
+	if (scn.grid_n[GRID_STEPTIME] == 0) scn.grid[GRID_STEPTIME][scn.grid_n[GRID_STEPTIME]++] = p->steptime;
+	if (scn.grid_n[GRID_STEPSIZE] == 0) scn.grid[GRID_STEPSIZE][scn.grid_n[GRID_STEPSIZE]++] = p->stepsize;
+	if (scn.grid_n[GRID_SAIL_STEPSIZE] == 0) scn.grid[GRID_SAIL_STEPSIZE][scn.grid_n[GRID_SAIL_STEPSIZE]++] = p->sail_stepsize;
+	if (scn.grid_n[GRID_DES_SLOPE] == 0) scn.grid[GRID_DES_SLOPE][scn.grid_n[GRID_DES_SLOPE]++] = p->des_slope;
+	if (scn.seeds == 0) scn.seed[scn.seeds++] = 1;
+
+	for (g = 0; g < scn.grid_n[GRID_STEPTIME]; g++)
+		if (scn.grid[GRID_STEPTIME][g] < 1 || scn.grid[GRID_STEPTIME][g] * SEC / 2 > VMG_BUFFER) {
+			printf("ERROR: %s: steptime must be in 1..%d s (VMG_BUFFER).\n", path, (int)(2 * VMG_BUFFER / SEC));
+			return -1;
+		}
+	if (scn.base.duration * SEC < 4 || rudder_rate < SEC) {
+		printf("ERROR: %s: invalid duration or rudder_rate.\n", path);
+		return -1;
+	}
+	scn.base.rudder_steps = round(rudder_rate / SEC);
+	scn.points = 1;
+	for (g = 0; g < GRID_KEYS; g++) scn.points *= scn.grid_n[g];
+	return 0;
+}
+
+/*
+ *	Next job of worker [w]: its own deque first, then half of the largest
+ *	deque of the others. -1 when there is no work left.
+ */
+int next_job(Worker * w)
+{
+	Worker * v;
+	int job = -1, k, best, left, half;
+
+	pthread_mutex_lock(&w->lock);
+	if (w->lo < w->hi) job = w->lo++;
+	pthread_mutex_unlock(&w->lock);
+	while (job < 0) {
+		best = -1;
+		left = 0;
+		for (k = 0; k < threads; k++)
+			if (worker[k].hi - worker[k].lo > left) { left = worker[k].hi - worker[k].lo; best = k; }
+		if (best < 0) return -1;
+
+		v = &worker[best];
+		pthread_mutex_lock(&v->lock);
+		half = (v->hi - v->lo + 1) / 2;
+		if (half > 0) {
+			v->hi -= half;
+			job = v->hi;
+		}
+		pthread_mutex_unlock(&v->lock);
+		if (half == 0) continue;
+
+		// keep the rest of the stolen half
+		pthread_mutex_lock(&w->lock);
+		w->lo = job + 1;
+		w->hi = job + half;
+		w->steals++;
+		pthread_mutex_unlock(&w->lock);
+	}
+	return job;
+}
+
+void * worker_thread(void * arg)
+{
+	Worker * w = (Worker *)arg;
+	MissionSpec m;
+	int job;
+
+	while ((job = next_job(w)) >= 0) {
+		point_spec(job / scn.seeds, &m);
+		mission_run(&m, scn.seed[job % scn.seeds], w->vmg, &result[job]);
+		w->runs++;
+	}
+	return NULL;
+}
+
+void mean_sd(const double * x, int n, double * mean, double * sd)
+{
+	double s = 0, q = 0;
+	int k;
+
+	for (k = 0; k < n; k++) s += x[k];
+	*mean = n > 0 ? s / n : 0;
+	for (k = 0; k < n; k++) q += (x[k] - *mean) * (x[k] - *mean);
+	*sd = n > 1 ? sqrt(q / (n - 1)) : 0;
+}
+
+void report(FILE * out)
+{
+	MissionSpec m;
+	MissionResult * r;
+	double * conv = malloc(scn.seeds * sizeof(double)), * vmg = malloc(scn.seeds * sizeof(double));
+	double conv_m, conv_sd, vmg_m, vmg_sd, sail, rudder, time;
+	int point, k, arrived, converged;
+
+	if (conv == NULL || vmg == NULL) exit(1);
+	fprintf(out, "steptime,stepsize,sail_stepsize,des_slope,runs,arrived,converged,conv_s,conv_sd,vmg,vmg_sd,sail_travel,rudder_travel,time_s\n");
+	for (point = 0; point < scn.points; point++) {
+		point_spec(point, &m);
+		arrived = converged = 0;
+		sail = rudder = time = 0;
+		for (k = 0; k < scn.seeds; k++) {
+			r = &result[point * scn.seeds + k];
+			arrived += r->arrived;
+			if (r->convergence >= 0) conv[converged++] = r->convergence;
+			vmg[k] = r->vmg_mean;
+			sail += r->sail_travel;
+			rudder += r->rudder_travel;
+			time += r->time;
+		}
+		mean_sd(conv, converged, &conv_m, &conv_sd);
+		mean_sd(vmg, scn.seeds, &vmg_m, &vmg_sd);
+		fprintf(out, "%d,%d,%d,%g,%d,%d,%d,%.1f,%.1f,%.4f,%.4f,%.0f,%.0f,%.1f\n", m.params.steptime, m.params.stepsize,
+			m.params.sail_stepsize, m.params.des_slope, scn.seeds, arrived, converged, converged ? conv_m : -1, conv_sd,
+			vmg_m, vmg_sd, sail / scn.seeds, rudder / scn.seeds, time / scn.seeds);
+	}
+	free(conv);
+	free(vmg);
+}
+
+int write_runs(const char * path)
+{
+	FILE * f = fopen(path, "w");
+	MissionSpec m;
+	MissionResult * r;
+	int job;
+
+	if (f == NULL) return -1;
+	fprintf(f, "steptime,stepsize,sail_stepsize,des_slope,seed,arrived,time_s,conv_s,vmg,sail_travel,rudder_travel\n");
+	for (job = 0; job < scn.points * scn.seeds; job++) {
+		point_spec(job / scn.seeds, &m);
+		r = &result[job];
+		fprintf(f, "%d,%d,%d,%g,%llu,%d,%.2f,%.2f,%.4f,%.0f,%.0f\n", m.params.steptime, m.params.stepsize, m.params.sail_stepsize,
+			m.params.des_slope, (unsigned long long)scn.seed[job % scn.seeds], r->arrived, r->time, r->convergence,
+			r->vmg_mean, r->sail_travel, r->rudder_travel);
+	}
+	return fclose(f);
+}
+
+int main(int argc, char ** argv)
+{
+	const char * runs_path = NULL;
+	struct timespec t0, t1;
+	double wall, simulated = 0;
+	uint64_t steals = 0;
+	int jobs, opt, k;
+
+	threads = sysconf(_SC_NPROCESSORS_ONLN);
+	while ((opt = getopt(argc, argv, "j:r:")) != -1) {
+		switch (opt) {
+			case 'j': threads = atoi(optarg); break;
+			case 'r': runs_path = optarg; break;
+			default: threads = 0;
+		}
+	}
+	if (optind != argc - 1 || threads <= 0) {
+		fprintf(stderr, "usage: %s [-j threads] [-r runs.csv] <scenario>\n", argv[0]);
+		exit(1);
+	}
+	if (load_scenario(argv[optind]) < 0) {
+		fprintf(stderr, "ERROR: Cannot load the scenario %s.\n", argv[optind]);
+		exit(1);
+	}
+	jobs = scn.points * scn.seeds;
+	result = calloc(jobs, sizeof(MissionResult));
+	worker = calloc(threads, sizeof(Worker));
+	if (result == NULL || worker == NULL) exit(1);
+
+	// contiguous shares, the workers rebalance by stealing
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (k = 0; k < threads; k++) {
+		worker[k].id = k;
+		worker[k].lo = (int64_t)jobs * k / threads;
+		worker[k].hi = (int64_t)jobs * (k + 1) / threads;
+		worker[k].vmg = malloc(((int)(scn.base.duration * SEC) + 1) * sizeof(float));
+		if (worker[k].vmg == NULL || pthread_mutex_init(&worker[k].lock, NULL) != 0) exit(1);
+	}
+	for (k = 0; k < threads; k++)
+		if (pthread_create(&worker[k].thread, NULL, worker_thread, &worker[k]) != 0) {
+			fprintf(stderr, "ERROR: Cannot start the worker threads.\n");
+			exit(1);
+		}
+	for (k = 0; k < threads; k++) {
+		pthread_join(worker[k].thread, NULL);
+		steals += worker[k].steals;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	for (k = 0; k < jobs; k++) simulated += result[k].time;
+
+	report(stdout);
+	if (runs_path != NULL && write_runs(runs_path) != 0) fprintf(stderr, "WARNING: Cannot write %s.\n", runs_path);
+	fprintf(stderr, "%d missions (%d combinations x %d seeds) on %d threads in %.2f s: %.0f missions/s, %.0fx real time, %llu steals\n",
+		jobs, scn.points, scn.seeds, threads, wall, jobs / wall, simulated / wall, (unsigned long long)steals);
+	return 0;
+}
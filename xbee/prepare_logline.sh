@@ -7,7 +7,7 @@ REF=sailboat-log/current_logfile
 if [ -f "$REF" ]; then
 
 	FP=$(cat $REF)
-	STR=$(tail -1 sailboat-log/$FP)
+	STR=$(./logcat_arm -q -L sailboat-log/$FP)
 	
 	# READ NAVSYSTEM
 	NAV=$(echo $STR | cut -f2 -d,)